@@ -0,0 +1,47 @@
+#ifndef BENCH_H
+#define BENCH_H
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Микробенчмарки: каждый печатает строки "имя значение единица", результаты сведены в bench/README.md
+ */
+namespace bench
+{
+    using Clock = std::chrono::steady_clock;
+
+    inline double elapsedNs(Clock::time_point start)
+    {
+        return std::chrono::duration< double, std::nano >(Clock::now() - start).count();
+    }
+
+    inline void report(const std::string& name, double value, const char* unit)
+    {
+        std::printf("%-48s %12.1f %s\n", name.c_str(), value, unit);
+        std::fflush(stdout);
+    }
+
+    /**
+     * @brief Перцентиль выборки, выборка сортируется на месте
+     * @param Доля от 0 до 1
+     */
+    inline double percentile(std::vector< double >& samples, double part)
+    {
+        if (samples.empty()) return 0;
+
+        std::sort(samples.begin(), samples.end());
+        return samples[std::min(samples.size() - 1, size_t(part * samples.size()))];
+    }
+
+    void poolDispatch();
+    void poolScaling();
+    void eventDispatch();
+    void postLatency();
+    void pingPongLatency();
+}  // namespace bench
+
+#endif  // BENCH_H
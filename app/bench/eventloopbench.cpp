@@ -0,0 +1,336 @@
+#include "../sources/event_loop/eventloop.h"
+#include "bench.h"
+
+#include <atomic>
+#include <arpa/inet.h>
+#include <malloc.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+    const size_t events_ { 2000000 };
+    const size_t posts_ { 1000000 };
+    const size_t wakeUps_ { 20000 };
+    const size_t roundTrips_ { 20000 };
+    const size_t message_ { 64 };
+
+    /**
+     * @brief Слот-счётчик: останавливает event loop, когда вызван нужное количество раз
+     */
+    struct Counter
+    {
+        size_t calls { 0 };
+        size_t target { 0 };
+
+        EVENT_LOOP_SIGNALS onRead() { return ++calls >= target ? SIG_EXIT : SIG_NONE; }
+    };
+
+    /**
+     * @brief Event loop с fdCount всегда готовыми к чтению eventfd: в eventfd записано значение, которое никто не читает,
+     * так что epoll отдаёт их на каждой итерации и вся работа - это разбор событий и вызов слотов
+     * @param Слоты через std::function (true) или через указатель на функцию bindSlot< &Method > (false)
+     * @return нс на вызов слота
+     */
+    double dispatchAll(size_t fdCount, bool viaFunction)
+    {
+        EventLoop loop;
+        loop.initEventPoll();
+        loop.setMaxEvents(static_cast< int >(fdCount));
+
+        Counter            counter { 0, events_ };
+        std::vector< int > fds;
+
+        for (size_t i = 0; i < fdCount; i++)
+        {
+            auto     fd  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            uint64_t one = 1;
+            std::ignore  = ::write(fd, &one, sizeof(one));
+
+            loop.addFd(fd, EPOLLIN);
+
+            if (viaFunction)
+            {
+                loop.bindSlot(fd, EPOLLIN, [&counter]() { return counter.onRead(); });
+            }
+            else
+            {
+                loop.bindSlot< &Counter::onRead >(fd, EPOLLIN, &counter);
+            }
+
+            fds.push_back(fd);
+        }
+
+        auto start = bench::Clock::now();
+        loop.start();
+        auto ns = bench::elapsedNs(start) / counter.calls;
+
+        for (auto fd : fds)
+        {
+            loop.removeFd(fd);
+            ::close(fd);
+        }
+
+        return ns;
+    }
+
+    /**
+     * @brief Сколько памяти в куче event loop тратит на один дескриптор со слотом
+     * @return байт на дескриптор
+     */
+    double heapPerFd(size_t fdCount)
+    {
+        EventLoop loop;
+        loop.initEventPoll();
+
+        Counter            counter;
+        std::vector< int > fds;
+
+        for (size_t i = 0; i < fdCount; i++)
+        {
+            fds.push_back(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+        }
+
+        // Большие блоки malloc отдаёт через mmap, они учитываются отдельно
+        auto heap   = []() { auto info = mallinfo2(); return info.uordblks + info.hblkhd; };
+        auto before = heap();
+
+        for (auto fd : fds)
+        {
+            loop.addFd(fd, EPOLLIN);
+            loop.bindSlot< &Counter::onRead >(fd, EPOLLIN, &counter);
+        }
+
+        auto used = heap() - before;
+
+        for (auto fd : fds)
+        {
+            loop.removeFd(fd);
+            ::close(fd);
+        }
+
+        return static_cast< double >(used) / fdCount;
+    }
+
+    /**
+     * @brief Event loop в отдельном потоке, останавливается в деструкторе
+     */
+    struct LoopThread
+    {
+        EventLoop   loop;
+        std::thread thread;
+
+        explicit LoopThread(EventLoop::Backend backend = EventLoop::Backend::EPOLL, int spinUs = 0)
+        {
+            loop.initEventPoll(backend);
+            loop.setBusyPoll(spinUs);
+            thread = std::thread([this]() { loop.start(); });
+        }
+
+        ~LoopThread()
+        {
+            loop.breakEventLoop();
+            thread.join();
+        }
+    };
+
+    /**
+     * @brief Задержка от post() до начала выполнения задачи, когда event loop спит в epoll_wait:
+     * каждая задача ставится только после выполнения предыдущей и паузы, за которую поток успевает уснуть
+     */
+    void postWakeUp()
+    {
+        LoopThread               runner;
+        std::atomic< bool >      done { false };
+        bench::Clock::time_point started;
+        std::vector< double >    samples;
+
+        samples.reserve(wakeUps_);
+
+        for (size_t i = 0; i < wakeUps_; i++)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+
+            done       = false;
+            auto start = bench::Clock::now();
+
+            runner.loop.post([&done, &started]() {
+                started = bench::Clock::now();
+                done.store(true, std::memory_order_release);
+            });
+
+            // Ядро одно: ждём не занимая его, время отсчитывается до начала задачи
+            while (!done.load(std::memory_order_acquire))
+            {
+                std::this_thread::yield();
+            }
+
+            samples.push_back(std::chrono::duration< double, std::nano >(started - start).count());
+        }
+
+        bench::report("post to sleeping loop, p50", bench::percentile(samples, 0.5), "ns");
+        bench::report("post to sleeping loop, p99", bench::percentile(samples, 0.99), "ns");
+    }
+
+    /**
+     * @brief Поток ставит posts_ задач подряд: большая часть попадает в event loop, который ещё не разобрал
+     * прошлое пробуждение, так что запись в eventfd пропускается
+     * @return нс на задачу от первой постановки до выполнения последней
+     */
+    double postBurst()
+    {
+        LoopThread            runner;
+        std::atomic< size_t > executed { 0 };
+        size_t                counter { 0 };
+
+        auto start = bench::Clock::now();
+
+        for (size_t i = 0; i < posts_; i++)
+        {
+            runner.loop.post([&executed, &counter]() {
+                executed.store(++counter, std::memory_order_release);
+            });
+        }
+
+        while (executed.load(std::memory_order_acquire) < posts_)
+        {
+            std::this_thread::yield();
+        }
+
+        return bench::elapsedNs(start) / posts_;
+    }
+
+    /**
+     * @brief Пара соединённых через loopback TCP сокетов, как у клиента и сервера
+     * @return false если соединиться не удалось
+     */
+    bool connectPair(int& client, int& server)
+    {
+        auto listener = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+        sockaddr_in addr {};
+        addr.sin_family      = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len        = sizeof(addr);
+
+        auto ok = ::bind(listener, reinterpret_cast< sockaddr* >(&addr), len) == 0 && ::listen(listener, 1) == 0 &&
+                  ::getsockname(listener, reinterpret_cast< sockaddr* >(&addr), &len) == 0;
+
+        client = ok ? ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0) : -1;
+        ok     = ok && ::connect(client, reinterpret_cast< sockaddr* >(&addr), len) == 0;
+        server = ok ? ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC) : -1;
+        ::close(listener);
+
+        int one = 1;
+        ::setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        ::setsockopt(server, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return server >= 0;
+    }
+
+    /**
+     * @brief Клиент отправляет message_ байт и ждёт их обратно, event loop в другом потоке отвечает эхом.
+     * Так видно, сколько к задержке добавляет пробуждение event loop и сколько из этого экономит опрос без сна
+     */
+    void pingPong(EventLoop::Backend backend, int spinUs)
+    {
+        int client = -1;
+        int server = -1;
+
+        if (!connectPair(client, server))
+        {
+            std::perror("loopback connect");
+            return;
+        }
+
+        std::vector< double > samples;
+        {
+            LoopThread runner(backend, spinUs);
+            auto&      loop    = runner.loop;
+            auto       viaRing = loop.backend() == EventLoop::Backend::IO_URING;
+
+            auto echo = [&loop, server, viaRing]() {
+                uint8_t buf[256];
+
+                for (;;)
+                {
+                    auto count = loop.recv(server, buf, sizeof(buf));
+                    if (count == 0) return EVENT_LOOP_SIGNALS::SIG_CLOSE;
+                    if (count < 0) return EVENT_LOOP_SIGNALS::SIG_NONE;
+
+                    if (viaRing)
+                    {
+                        loop.send(server, std::vector< uint8_t >(buf, buf + count));
+                    }
+                    else
+                    {
+                        std::ignore = ::send(server, buf, count, MSG_NOSIGNAL);
+                    }
+                }
+            };
+
+            loop.post([&loop, server, viaRing, echo]() {
+                loop.addFd(server, EPOLLIN, {}, viaRing);
+                loop.bindSlot(server, EPOLLIN, echo);
+            });
+
+            std::vector< uint8_t > out(message_, 0x5A);
+            std::vector< uint8_t > in(message_);
+            samples.reserve(roundTrips_);
+
+            // Первые обмены - прогрев, в выборку не попадают
+            for (size_t i = 0; i < roundTrips_ + roundTrips_ / 10; i++)
+            {
+                auto start  = bench::Clock::now();
+                std::ignore = ::send(client, out.data(), out.size(), MSG_NOSIGNAL);
+
+                for (size_t got = 0; got < in.size();)
+                {
+                    auto count = ::recv(client, in.data() + got, in.size() - got, 0);
+                    if (count <= 0) return;
+                    got += count;
+                }
+
+                if (i >= roundTrips_ / 10) samples.push_back(bench::elapsedNs(start));
+            }
+        }
+
+        ::close(client);
+        ::close(server);
+
+        auto name = std::string(backend == EventLoop::Backend::IO_URING ? "io_uring" : "epoll") + ", busy-poll " +
+                    std::to_string(spinUs) + " us";
+        bench::report(name + ", p50", bench::percentile(samples, 0.5), "ns");
+        bench::report(name + ", p99", bench::percentile(samples, 0.99), "ns");
+    }
+}  // namespace
+
+void bench::pingPongLatency()
+{
+    for (auto backend : { EventLoop::Backend::EPOLL, EventLoop::Backend::IO_URING })
+    {
+        for (int spinUs : { 0, 50 })
+        {
+            pingPong(backend, spinUs);
+        }
+    }
+}
+
+void bench::postLatency()
+{
+    postWakeUp();
+    report("post burst, 1 producer", postBurst(), "ns/task");
+}
+
+void bench::eventDispatch()
+{
+    report("heap per fd, 16384 fds", heapPerFd(16384), "bytes");
+
+    for (size_t fdCount : { 16, 256, 4096, 16384 })
+    {
+        report("slot via function ptr, " + std::to_string(fdCount) + " fds", dispatchAll(fdCount, false), "ns/event");
+        report("slot via std::function, " + std::to_string(fdCount) + " fds", dispatchAll(fdCount, true), "ns/event");
+    }
+}
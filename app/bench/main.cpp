@@ -0,0 +1,41 @@
+#include "bench.h"
+
+#include <cstring>
+
+namespace
+{
+    struct Entry
+    {
+        const char* name;
+        void (*run)();
+    };
+
+    const Entry benches[] = {
+        { "pool-dispatch", bench::poolDispatch },
+        { "pool-scaling", bench::poolScaling },
+        { "event-dispatch", bench::eventDispatch },
+        { "post-latency", bench::postLatency },
+        { "ping-pong", bench::pingPongLatency },
+    };
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    // Без аргументов запускаются все бенчмарки, иначе - перечисленные по имени
+    for (const auto& entry : benches)
+    {
+        bool wanted = argc == 1;
+
+        for (int i = 1; i < argc; i++)
+        {
+            wanted = wanted || std::strcmp(argv[i], entry.name) == 0;
+        }
+
+        if (!wanted) continue;
+
+        std::printf("== %s\n", entry.name);
+        entry.run();
+    }
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+#ifndef MUTEXPOOL_H
+#define MUTEXPOOL_H
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace bench
+{
+    /**
+     * @brief Пул потоков в том виде, в каком он был до ThreadPool с Task и воровством задач: общая очередь std::function
+     * под одним mutex, задача - packaged_task в shared_ptr. Точка отсчёта для сравнения
+     */
+    class MutexPool
+    {
+      public:
+        explicit MutexPool(size_t threads)
+        {
+            for (size_t i = 0; i < threads; ++i)
+            {
+                workers_.emplace_back(
+                    [this]
+                    {
+                        for (;;)
+                        {
+                            std::function< void() > task;
+
+                            {
+                                std::unique_lock< std::mutex > lock(mutex_);
+                                condition_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+
+                                if (stop_ && tasks_.empty()) return;
+
+                                task = std::move(tasks_.front());
+                                tasks_.pop();
+                            }
+
+                            task();
+                        }
+                    });
+            }
+        }
+
+        ~MutexPool()
+        {
+            {
+                std::unique_lock< std::mutex > lock(mutex_);
+                stop_ = true;
+            }
+
+            condition_.notify_all();
+
+            for (auto& worker : workers_)
+            {
+                worker.join();
+            }
+        }
+
+        template< class F >
+        std::future< void > enqueue(F&& f)
+        {
+            auto task = std::make_shared< std::packaged_task< void() > >(std::forward< F >(f));
+            auto res  = task->get_future();
+
+            {
+                std::unique_lock< std::mutex > lock(mutex_);
+                tasks_.emplace([task]() { (*task)(); });
+            }
+
+            condition_.notify_one();
+            return res;
+        }
+
+      private:
+        std::vector< std::thread >            workers_;
+        std::queue< std::function< void() > > tasks_;
+        std::mutex                            mutex_;
+        std::condition_variable               condition_;
+        bool                                  stop_ { false };
+    };
+}  // namespace bench
+
+#endif  // MUTEXPOOL_H
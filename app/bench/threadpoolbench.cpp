@@ -0,0 +1,186 @@
+#include "../sources/thread_pool/threadpool.h"
+#include "bench.h"
+#include "mutexpool.h"
+
+#include <atomic>
+#include <functional>
+#include <type_traits>
+#include <thread>
+
+namespace
+{
+    const size_t tasks_ { 1000000 };
+
+    /**
+     * @brief Ставит tasks_ пустых задач из стороннего потока и ждёт, пока все выполнятся
+     * @return нс на задачу
+     */
+    template< class Submit >
+    double submitAll(Submit&& submit, std::atomic< size_t >& done)
+    {
+        done       = 0;
+        auto start = bench::Clock::now();
+
+        for (size_t i = 0; i < tasks_; i++)
+        {
+            submit();
+        }
+
+        while (done.load(std::memory_order_acquire) < tasks_)
+        {
+            std::this_thread::yield();
+        }
+
+        return bench::elapsedNs(start) / tasks_;
+    }
+
+    /**
+     * @brief Около микросекунды вычислений, чтобы задача не была пустой
+     */
+    uint32_t work(uint32_t seed)
+    {
+        for (int i = 0; i < 200; i++)
+        {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+        }
+
+        return seed;
+    }
+
+    std::atomic< uint32_t > sink_ { 0 };
+
+    /**
+     * @brief Задача дерева: ставит двух потомков в тот же пул, пока не дойдёт до листьев.
+     * Так задачи появляются в воркерах, и пулу с воровством приходится их распределять
+     */
+    template< class Pool >
+    void spawn(Pool& pool, int depth, std::atomic< size_t >& done)
+    {
+        sink_.fetch_add(work(depth), std::memory_order_relaxed);
+        done.fetch_add(1, std::memory_order_release);
+
+        if (depth == 0) return;
+
+        for (int i = 0; i < 2; i++)
+        {
+            if constexpr (std::is_same_v< Pool, ThreadPool >)
+            {
+                pool.post([&pool, depth, &done] { spawn(pool, depth - 1, done); });
+            }
+            else
+            {
+                std::ignore = pool.enqueue([&pool, depth, &done] { spawn(pool, depth - 1, done); });
+            }
+        }
+    }
+
+    /**
+     * @return нс на задачу: сначала tasks задач из стороннего потока, затем дерево задач из воркеров
+     */
+    template< class Pool >
+    std::pair< double, double > scaling(size_t threads)
+    {
+        const size_t          flat  = 200000;
+        const int             depth = 17;  // 2^18 - 1 задач
+        std::atomic< size_t > done { 0 };
+        Pool                  pool(threads);
+
+        auto start = bench::Clock::now();
+
+        for (size_t i = 0; i < flat; i++)
+        {
+            auto job = [i, &done] {
+                sink_.fetch_add(work(i), std::memory_order_relaxed);
+                done.fetch_add(1, std::memory_order_release);
+            };
+
+            if constexpr (std::is_same_v< Pool, ThreadPool >)
+            {
+                pool.post(job);
+            }
+            else
+            {
+                std::ignore = pool.enqueue(job);
+            }
+        }
+
+        while (done.load(std::memory_order_acquire) < flat) std::this_thread::yield();
+
+        auto flatNs = bench::elapsedNs(start) / flat;
+        auto total  = (size_t(1) << (depth + 1)) - 1;
+
+        done  = 0;
+        start = bench::Clock::now();
+
+        spawn(pool, depth, done);
+        while (done.load(std::memory_order_acquire) < total) std::this_thread::yield();
+
+        return { flatNs, bench::elapsedNs(start) / total };
+    }
+}  // namespace
+
+void bench::poolDispatch()
+{
+    // Захват размером с типичную задачу сервера: пара указателей и число
+    void*                 a = &a;
+    void*                 b = &b;
+    size_t                n = 0;
+    std::atomic< size_t > done { 0 };
+    auto                  job = [&done, a, b, n]() {
+        if (a != b || n != 0) done.fetch_add(1, std::memory_order_release);
+    };
+
+    // Стоимость самой обёртки: создать, переместить, вызвать
+    {
+        auto start = Clock::now();
+        for (size_t i = 0; i < tasks_; i++)
+        {
+            std::function< void() > fn(job);
+            auto                    moved = std::move(fn);
+            moved();
+        }
+        report("std::function create+move+call", elapsedNs(start) / tasks_, "ns");
+
+        start = Clock::now();
+        for (size_t i = 0; i < tasks_; i++)
+        {
+            Task task(job);
+            auto moved = std::move(task);
+            moved();
+        }
+        report("Task create+move+call", elapsedNs(start) / tasks_, "ns");
+    }
+
+    for (size_t threads : { 1, 4 })
+    {
+        auto suffix = " (" + std::to_string(threads) + " threads)";
+
+        {
+            MutexPool pool(threads);
+            report("MutexPool::enqueue" + suffix, submitAll([&] { std::ignore = pool.enqueue(job); }, done), "ns/task");
+        }
+
+        {
+            ThreadPool pool(threads);
+            report("ThreadPool::enqueue" + suffix, submitAll([&] { std::ignore = pool.enqueue(job); }, done), "ns/task");
+            report("ThreadPool::post" + suffix, submitAll([&] { pool.post(job); }, done), "ns/task");
+        }
+    }
+}
+
+void bench::poolScaling()
+{
+    for (size_t threads : { 1, 2, 4, 8, 16, 32, 64 })
+    {
+        auto suffix = " (" + std::to_string(threads) + " threads)";
+        auto mutex  = scaling< MutexPool >(threads);
+        auto steal  = scaling< ThreadPool >(threads);
+
+        report("MutexPool outside tasks" + suffix, mutex.first, "ns/task");
+        report("ThreadPool outside tasks" + suffix, steal.first, "ns/task");
+        report("MutexPool spawned tasks" + suffix, mutex.second, "ns/task");
+        report("ThreadPool spawned tasks" + suffix, steal.second, "ns/task");
+    }
+}
@@ -1,14 +1,22 @@
 #include "client.h"
+#include "filereader.h"
 #include "../data_package/datatpackage.h"
 #include "../helpers/helpers.h"
 #include "../logger/logger.h"
-#include <cstdio>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
 #include <fstream>
 
 #define LOG_TAG "client"
 
-Client::Client(const std::string &address, int port) :
+Client::Client(const std::string &address, int port, bool zeroCopy, bool raw) :
     port_ { port },
+    zeroCopy_ { zeroCopy },
+    raw_ { raw },
     address_ { address },
     sock_ { address, port }
 {
@@ -23,6 +31,8 @@ int Client::sendFile(const std::string &filePath)
         return 1;
     }
 
+    sock_.setReceiveTimeout(replyTimeoutMs_);
+
     LOG_INFO("Client prepare send file: ", filePath);
     LOG_INFO("File size: ", fileSize);
 
@@ -40,11 +50,194 @@ int Client::sendFile(const std::string &filePath)
     auto packagesSended = readAndSendFile(filePath, packAwait);
     LOG_INFO("Total packages uploaded:", packagesSended);
 
-    // Подтверждаем что всё хорошо
-    std::ignore = confirmExit();
+    // Подтверждаем что всё хорошо и ждём, пока сервер сохранит файл
+    if (!confirmExit())
+    {
+        LOG_ERROR("Server didn't confirm that the file is saved");
+        return 1;
+    }
+
+    return 0;
+}
+
+int Client::receiveFile(const std::string &name, std::string outPath, uint64_t offset, uint64_t length)
+{
+    if (!sock_.connect())
+    {
+        return 1;
+    }
+
+    sock_.setReceiveTimeout(replyTimeoutMs_);
+
+    // Имена файлов сервер строит из даты, так что одни цифры - это номер объекта
+    uint64_t objectId = 0;
+    auto     end      = name.data() + name.size();
+    auto [parsed, ec] = std::from_chars(name.data(), end, objectId);
+    bool object       = ec == std::errc() && parsed == end;
+    if (outPath.empty()) outPath = object ? "object_" + name : name;
+
+    LOG_INFO("Client request", object ? "object" : "file", name);
+
+    // Начало и длина участка, вид (0 - файл, 1 - объект), затем имя файла или номер объекта
+    auto pkgData = toBytes< std::vector< uint8_t > >(offset);
+    auto lenData = toBytes< std::vector< uint8_t > >(length);
+    pkgData.insert(pkgData.end(), lenData.begin(), lenData.end());
+    pkgData.push_back(object ? 0x01 : 0x00);
+
+    if (object)
+    {
+        auto id = toBytes< std::vector< uint8_t > >(objectId);
+        pkgData.insert(pkgData.end(), id.begin(), id.end());
+    }
+    else
+    {
+        pkgData.insert(pkgData.end(), name.begin(), name.end());
+    }
+
+    DatatPackage request;
+    request.setCommand(COMMAND::REQUEST_TO_RECEIVE);
+    request.setData(pkgData);
+    request.calcChecksum();
+
+    // Сервер начинает слать данные сразу после ответа, поэтому запрос не повторяем: повтор пришёл бы посреди передачи
+    DatatPackage reply;
+    std::vector< uint8_t > sizes;
+
+    if (sock_.write(request) <= 0 || !readPackage(reply))
+    {
+        LOG_ERROR("No valid reply on receive request");
+        return 1;
+    }
+
+    if (reply.getCommand() != COMMAND::REQUEST_TO_RECEIVE_APPROVED || reply.getData(sizes) != 2 * sizeof(uint64_t))
+    {
+        LOG_ERROR("Server can't send", name, static_cast< int >(reply.getCommand()));
+        return 1;
+    }
+
+    // Первые 8 байт - размер участка, вторые 8 - размер блока
+    auto size      = fromBytes< uint64_t >(std::vector< uint8_t >(sizes.begin(), sizes.begin() + sizeof(uint64_t)));
+    auto blockSize = fromBytes< uint64_t >(std::vector< uint8_t >(sizes.begin() + sizeof(uint64_t), sizes.end()));
+
+    if (blockSize == 0)
+    {
+        LOG_ERROR("Server sent wrong block size");
+        return 1;
+    }
+
+    int fd = ::open(outPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd < 0)
+    {
+        LOG_ERROR("Can't open file", outPath, std::strerror(errno));
+        return 1;
+    }
+
+    // Место выделяется сразу под весь участок одним куском, как и на сервере при приёме
+    if (size > 0 && ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, size) < 0 && errno != EOPNOTSUPP)
+    {
+        LOG_ERROR("Can't allocate", size, "bytes for file", outPath, std::strerror(errno));
+        ::close(fd);
+        helpers::removeFile(outPath);
+        return 1;
+    }
+
+    LOG_INFO("Receive", size, "bytes to", outPath);
+
+    bool ok = receiveBlocks(fd, size, blockSize);
+    ::close(fd);
+
+    if (!ok)
+    {
+        helpers::removeFile(outPath);
+        return 1;
+    }
+
+    LOG_INFO("File received");
     return 0;
 }
 
+bool Client::receiveBlocks(int fd, uint64_t size, uint64_t blockSize)
+{
+    std::vector< uint8_t > block(std::min(size, blockSize));
+    std::vector< uint8_t > crc;
+    DatatPackage           digest;
+
+    for (uint64_t received = 0; received < size;)
+    {
+        auto blockBytes = std::min(blockSize, size - received);
+
+        if (!readExact(block.data(), blockBytes))
+        {
+            LOG_ERROR("Can't read block from server");
+            return false;
+        }
+
+        if (!readPackage(digest) || digest.getCommand() != COMMAND::BLOCK_DIGEST || digest.getData(crc) != sizeof(uint32_t))
+        {
+            LOG_ERROR("No valid block digest from server");
+            return false;
+        }
+
+        if (DatatPackage::checksum(block.data(), blockBytes) != fromBytes< uint32_t >(crc))
+        {
+            LOG_ERROR("Block digest mismatch at offset", received);
+            return false;
+        }
+
+        for (uint64_t written = 0; written < blockBytes;)
+        {
+            auto res = ::pwrite(fd, block.data() + written, blockBytes - written, received + written);
+
+            if (res < 0 && errno == EINTR) continue;
+
+            if (res <= 0)
+            {
+                LOG_ERROR("Can't write to file", std::strerror(errno));
+                return false;
+            }
+
+            written += res;
+        }
+
+        received += blockBytes;
+        LOG_INFO("Received", received, "/", size);
+    }
+
+    return true;
+}
+
+bool Client::readExact(uint8_t *data, size_t size)
+{
+    while (size > 0)
+    {
+        auto res = sock_.read(data, size);
+
+        if (res < 0 && errno == EINTR) continue;
+        if (res <= 0) return false;
+
+        data += res;
+        size -= res;
+    }
+
+    return true;
+}
+
+bool Client::readPackage(DatatPackage &pkg)
+{
+    // Заголовок: маркер, команда и размер данных, за ним данные и 4 байта контрольной суммы
+    std::vector< uint8_t > frame(4);
+    if (!readExact(frame.data(), frame.size()) || frame[0] != 0xAA) return false;
+
+    size_t dataSize = (frame[2] << 8) | frame[3];
+    frame.resize(DatatPackage::minSize() + dataSize);
+
+    if (!readExact(frame.data() + 4, frame.size() - 4)) return false;
+
+    pkg.replacePackage(frame);
+    return pkg.verifyCheckSum();
+}
+
 int Client::getfileSize(const std::string &file) const
 {
     std::ifstream in(file, std::ifstream::ate | std::ifstream::binary);
@@ -56,6 +249,7 @@ std::pair< uint64_t, uint64_t > Client::requestSendData(int fileSizeInBytes)
     DatatPackage dp;
     dp.setCommand(COMMAND::REQUEST_TO_SEND);
     auto pkgData = toBytes< std::vector< uint8_t > >(( uint64_t )fileSizeInBytes);
+    if (raw_) pkgData.push_back(0x01);  // Флаг: передать данные блоками через splice
     dp.setData(pkgData);
     dp.calcChecksum();
 
@@ -63,19 +257,12 @@ std::pair< uint64_t, uint64_t > Client::requestSendData(int fileSizeInBytes)
     std::ignore    = dp.generatePackage(pack);
     std::ignore    = sock_.write(dp);
 
-    pack.clear();
-    pack.resize(buffSize_);
-    std::ignore = sock_.read(pack, buffSize_);
     DatatPackage recivePackage;
-    DatatPackage sendPackage;
-    recivePackage.replacePackage(pack);
 
-    if (!recivePackage.verifyCheckSum())
+    if (!awaitReply(recivePackage))
     {
-        LOG_ERROR("Checksum verification failed");
-        sendPackage.setCommand(COMMAND::CHECKSUM_ERROR);
-        auto res = retryPackage(sendPackage, recivePackage, 10);
-        if (res <= 0) return { -1, -1 };
+        LOG_ERROR("No valid reply on transfer request");
+        return { -1, -1 };
     }
 
     if (recivePackage.getCommand() != COMMAND::REQUEST_TO_SEND_APPROVED)
@@ -84,71 +271,71 @@ std::pair< uint64_t, uint64_t > Client::requestSendData(int fileSizeInBytes)
     }
     std::vector< uint8_t > totalPackArr;
     recivePackage.getData(totalPackArr);
-    std::vector< uint8_t > total_packages(totalPackArr.begin(), totalPackArr.begin() + (totalPackArr.size() * 0.5) - 1);
-    std::vector< uint8_t > one_package_size(totalPackArr.begin() + (totalPackArr.size() * 0.5), totalPackArr.end());
+    if (totalPackArr.size() < 2 * sizeof(uint64_t)) return { -1, -1 };
+
+    // Первые 8 байт - сколько пакетов ожидается, вторые 8 - размер пакета, дальше - флаг согласия на передачу блоками
+    std::vector< uint8_t > total_packages(totalPackArr.begin(), totalPackArr.begin() + sizeof(uint64_t));
+    std::vector< uint8_t > one_package_size(totalPackArr.begin() + sizeof(uint64_t), totalPackArr.begin() + 2 * sizeof(uint64_t));
+    rawApproved_ = raw_ && totalPackArr.size() > 2 * sizeof(uint64_t) && (totalPackArr[2 * sizeof(uint64_t)] & 0x01);
+
+    if (raw_ && !rawApproved_) LOG_WARN("Server declined block transfer, fallback to packages");
 
     return { fromBytes< uint64_t >(total_packages), fromBytes< uint64_t >(one_package_size) };
 }
 
 int Client::readAndSendFile(const std::string &file, std::pair< uint64_t, uint64_t > send_info)
 {
-    FILE      *fp             = std::fopen(file.c_str(), "r");
+    if (rawApproved_) return sendRawBlocks(file, send_info.second);
+
     const auto fileSize       = static_cast<uint64_t>(getfileSize(file));
     uint64_t   uploadedBytes  = 0;
     int        retryCount     = 0;
     int        packagesSended = 0;
     buffSize_                 = send_info.second;
-    std::vector< uint8_t > fileReadBuffer(buffSize_);
-    std::vector< uint8_t > packagesBuffer(buffSize_);
-    DatatPackage           request;
-    DatatPackage           responce;
+    DatatPackage request;
+    DatatPackage responce;
+
+    // Файл читается заранее в отдельном потоке, пока ждём ответа сервера, или отображается в память
+    FileReader reader(buffSize_);
+
+    if (!reader.open(file, zeroCopy_))
+    {
+        return -1;
+    }
 
     for (; uploadedBytes < fileSize && retryCount < maxRetry_;)
     {
-        if (std::fseek(fp, static_cast< long int >(uploadedBytes), SEEK_SET) != 0)
+        size_t readRes = buffSize_;
+        auto   data    = reader.chunk(uploadedBytes, readRes);
+
+        if (!data)
         {
-            LOG_CRITICAL("fseek() failed in file ", file);
-            std::fclose(fp);
+            LOG_CRITICAL("Can't read file ", file);
             return -1;
         }
 
-        auto readRes = std::fread(fileReadBuffer.data(), sizeof(uint8_t), buffSize_, fp);
         LOG_INFO("Readed from file:", readRes);
 
-        request.setCommand(COMMAND::DATA_PACKAGE);
-        request.setData(fileReadBuffer, readRes);
-        request.calcChecksum();
-
-        auto writeRes = sock_.write(request);
-        LOG_INFO("Written to server:", writeRes, "bytes");
-
-        auto responceSize = sock_.read(packagesBuffer, buffSize_);
+        int writeRes = 0;
 
-        if (responceSize < DatatPackage::minSize())
+        if (zeroCopy_)
         {
-            LOG_ERROR("Error on reading from server data");
-            return -1;
+            writeRes = sendMapped(data, readRes);
         }
-
-        responce.replacePackage(packagesBuffer);
-
-        if (!responce.verifyCheckSum())  // Если на нашей стороне не сошлась чексумма
+        else
         {
-            LOG_INFO("Checksum error when check recive package");
+            request.setCommand(COMMAND::DATA_PACKAGE);
+            request.setData(data, readRes);
+            request.calcChecksum();
+            writeRes = sock_.write(request);
+        }
 
-            DatatPackage checksumerr;
-            checksumerr.setCommand(COMMAND::CHECKSUM_ERROR);
+        LOG_INFO("Written to server:", writeRes, "bytes");
 
-            if (!retryPackage(checksumerr, responce, maxRetry_))
-            {
-                LOG_CRITICAL("Too many checksum errors/errors, abort");
-                std::fclose(fp);
-                return -1;
-            }
-            else
-            {
-                retryCount = 0;
-            }
+        if (!awaitReply(responce))
+        {
+            LOG_CRITICAL("No valid reply from server, abort");
+            return -1;
         }
 
         if (responce.getCommand() == COMMAND::CHECKSUM_ERROR)
@@ -178,8 +365,6 @@ int Client::readAndSendFile(const std::string &file, std::pair< uint64_t, uint64
         }
     }
 
-    std::fclose(fp);
-
     if (retryCount == maxRetry_)
     {
         return -1;
@@ -190,40 +375,213 @@ int Client::readAndSendFile(const std::string &file, std::pair< uint64_t, uint64
     }
 }
 
+int Client::sendRawBlocks(const std::string &file, uint64_t blockSize)
+{
+    const auto fileSize       = static_cast< uint64_t >(getfileSize(file));
+    uint64_t   uploadedBytes  = 0;
+    int        blocksSended   = 0;
+    buffSize_                 = DatatPackage::maxSize();
+    DatatPackage digest;
+    DatatPackage responce;
+
+    FileReader reader(blockSize);
+
+    if (!reader.open(file, zeroCopy_))
+    {
+        return -1;
+    }
+
+    while (uploadedBytes < fileSize)
+    {
+        auto     blockBytes = std::min(blockSize, fileSize - uploadedBytes);
+        uint32_t crc        = 0;
+
+        // Сам блок идёт без заголовков, сервер знает его размер
+        for (uint64_t sent = 0; sent < blockBytes;)
+        {
+            size_t size = blockBytes - sent;
+            auto   data = reader.chunk(uploadedBytes + sent, size);
+
+            if (!data)
+            {
+                LOG_CRITICAL("Can't read file ", file);
+                return -1;
+            }
+
+            crc = DatatPackage::checksum(data, size, crc);
+
+            for (size_t written = 0; written < size;)
+            {
+                auto res = sock_.write(data + written, size - written);
+
+                if (res < 0 && errno == EINTR) continue;
+
+                if (res <= 0)
+                {
+                    LOG_ERROR("Can't write block to server");
+                    return -1;
+                }
+
+                written += res;
+            }
+
+            sent += size;
+        }
+
+        digest.setCommand(COMMAND::BLOCK_DIGEST);
+        digest.setData(toBytes< std::vector< uint8_t > >(crc));
+        digest.calcChecksum();
+
+        if (sock_.write(digest) <= 0)
+        {
+            LOG_ERROR("Can't write block digest to server");
+            return -1;
+        }
+
+        if (!awaitReply(responce))
+        {
+            LOG_CRITICAL("No valid reply from server, abort");
+            return -1;
+        }
+
+        if (responce.getCommand() != COMMAND::PACKAGE_ACCPTED)
+        {
+            LOG_WARN("Server doesn't accept block", static_cast< int >(responce.getCommand()));
+            return -1;
+        }
+
+        uploadedBytes += blockBytes;
+        blocksSended++;
+        LOG_INFO("Sended", uploadedBytes, "/", fileSize);
+    }
+
+    return blocksSended;
+}
+
 bool Client::confirmExit()
 {
     DatatPackage request;
     request.setCommand(COMMAND::ALL_DATA_SENDED);
-    std::vector< uint8_t > pack;
     request.calcChecksum();
-    request.generatePackage(pack);
-    auto writeRes = sock_.write(pack, pack.size());
 
-    LOG_INFO("Written to server:", writeRes, "bytes");
-    pack.clear();
+    if (sock_.write(request) <= 0)
+    {
+        LOG_ERROR("Can't write transfer confirmation to server");
+        return false;
+    }
+
+    // Сервер может отвечать не сразу: прежде чем ответить, он сбрасывает файл на диск
+    DatatPackage reply;
+    if (!awaitReply(reply)) return false;
+
+    if (reply.getCommand() != COMMAND::FILE_SAVED)
+    {
+        LOG_ERROR("On transfer confirmation", static_cast< int >(reply.getCommand()));
+        return false;
+    }
+
+    // По номеру объекта или имени файла его можно получить обратно (-g)
+    std::vector< uint8_t > saved;
+    auto                   size = reply.getData(saved);
+
+    if (size == sizeof(uint64_t))
+    {
+        LOG_INFO("Server saved the file as object", fromBytes< uint64_t >(saved));
+        return true;
+    }
+
+    if (size > 0)
+    {
+        LOG_INFO("Server saved the file as", std::string(saved.begin(), saved.end()));
+        return true;
+    }
+
+    LOG_INFO("Server saved the file");
     return true;
 }
 
-bool Client::retryPackage(const DatatPackage &pkg, DatatPackage &reply, int times)
+int Client::sendMapped(const uint8_t *data, size_t size)
 {
-    std::vector< uint8_t > pack(buffSize_);
+    std::array< uint8_t, 4 > header;
+    std::array< uint8_t, 4 > crc;
+    DatatPackage::frameParts(COMMAND::DATA_PACKAGE, data, size, header, crc);
 
-    for (int i = 0; i < times; i++)
+    struct iovec iov[3] = {
+        { header.data(), header.size() },
+        { const_cast< uint8_t * >(data), size },
+        { crc.data(), crc.size() },
+    };
+
+    const size_t total   = header.size() + size + crc.size();
+    size_t       written = 0;
+    int          first   = 0;
+
+    while (written < total)
     {
-        auto writeRes = sock_.write(pack, pack.size());
-        if (writeRes <= 0)
+        auto res = sock_.write(iov + first, 3 - first);
+
+        if (res < 0 && errno == EINTR) continue;
+        if (res <= 0) return -1;
+
+        written += res;
+
+        // Пропускаем записанное: целиком ушедшие куски и начало частично записанного
+        for (size_t left = res; left > 0;)
         {
-            return false;
+            auto step = std::min(left, iov[first].iov_len);
+            iov[first].iov_base = static_cast< uint8_t * >(iov[first].iov_base) + step;
+            iov[first].iov_len -= step;
+            left -= step;
+            if (iov[first].iov_len == 0) first++;
         }
+    }
 
-        std::ignore = sock_.read(pack, buffSize_);
-        reply.replacePackage(pack);
+    return written;
+}
+
+bool Client::awaitReply(DatatPackage &reply)
+{
+    std::vector< uint8_t > pack;
+    int                    waits   = 0;
+    int                    repeats = 0;
+
+    while (waits < maxRetry_ && repeats < maxRetry_)
+    {
+        pack.resize(buffSize_);
+        auto readRes = sock_.read(pack, buffSize_);
 
-        if (reply.getCommand() != COMMAND::UNKNOWN || reply.getCommand() != COMMAND::CHECKSUM_ERROR)
+        // Ответ не потерялся, сервер занят: пишет на диск или сбрасывает файл. Переспрашивать нельзя - повтор пришёл бы
+        // вслед за настоящим ответом, и следующий пакет получил бы подтверждение этого
+        if (readRes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
         {
-            return true;
+            waits++;
+            LOG_WARN("No reply from server in", replyTimeoutMs_, "ms, keep waiting:", waits);
+            continue;
+        }
+
+        if (readRes < DatatPackage::minSize())
+        {
+            LOG_ERROR("Error on reading from server data");
+            return false;
         }
+
+        waits = 0;
+        reply.replacePackage(pack);
+
+        if (reply.verifyCheckSum()) return true;
+
+        // Сервер уже ответил и ждёт следующий пакет, так что повтор будет ответом на тот же пакет
+        repeats++;
+        LOG_INFO("Checksum error when check recive package, ask to repeat it");
+
+        DatatPackage repeat;
+        repeat.setCommand(COMMAND::CHECKSUM_ERROR);
+        repeat.clearData();
+        repeat.calcChecksum();
+
+        if (sock_.write(repeat) <= 0) return false;
     }
 
+    LOG_ERROR("Server didn't send a valid reply, giving up");
     return false;
 }
@@ -7,23 +7,81 @@
 class Client
 {
   public:
-    explicit Client(const std::string& address, int port);
+    /**
+     * @param Адрес сервера
+     * @param Порт сервера
+     * @param Отправлять данные файла прямо из отображения в память, без копирования в пакеты
+     * @param Просить сервер принимать данные блоками без пакетов (splice)
+     */
+    explicit Client(const std::string& address, int port, bool zeroCopy = false, bool raw = false);
 
     int sendFile(const std::string& filePath);
 
+    /**
+     * @brief Получает с сервера сохранённый файл или объект, целиком или участком
+     * @param Имя файла или номер объекта из ответа сервера на загрузку (FILE_SAVED)
+     * @param Куда сохранить, пусто - в текущий каталог под тем же именем
+     * @param Начало участка
+     * @param Длина участка, 0 - до конца файла
+     */
+    int receiveFile(const std::string& name, std::string outPath, uint64_t offset = 0, uint64_t length = 0);
+
   private:
     int getfileSize(const std::string& file) const;
 
     std::pair< uint64_t, uint64_t > requestSendData(int fileSizeInBytes);
     int                             readAndSendFile(const std::string& file, std::pair< uint64_t, uint64_t >);
+
+    /**
+     * @brief Отправляет файл блоками без пакетов, за каждым блоком - пакет с его контрольной суммой
+     * @return Сколько блоков принял сервер, -1 при ошибке
+     */
+    int sendRawBlocks(const std::string& file, uint64_t blockSize);
+
+    /**
+     * @brief Принимает участок блоками без пакетов, проверяет контрольную сумму каждого и пишет его в файл
+     * @return false при ошибке или несовпадении контрольной суммы
+     */
+    bool receiveBlocks(int fd, uint64_t size, uint64_t blockSize);
+
+    /**
+     * @brief Читает из сокета ровно size байт
+     */
+    bool readExact(uint8_t* data, size_t size);
+
+    /**
+     * @brief Читает из сокета ровно один пакет: за ним без паузы могут идти данные блока, их читать нельзя
+     * @return true если пакет прочитан и его контрольная сумма верна
+     */
+    bool readPackage(DatatPackage& pkg);
+
+    /**
+     * @brief Сообщает серверу, что все данные отправлены, и ждёт подтверждения, что файл сохранён (COMMAND::FILE_SAVED)
+     */
     bool                            confirmExit();
 
-    bool retryPackage(const DatatPackage& pkg, DatatPackage& reply, int times);
+    /**
+     * @brief Отправляет пакет с данными одним sendmsg: заголовок и контрольная сумма собираются на стеке,
+     * а данные берутся прямо из отображённого файла
+     * @return Сколько байт записано, -1 при ошибке
+     */
+    int sendMapped(const uint8_t* data, size_t size);
+
+    /**
+     * @brief Ждёт ответ на последний отправленный пакет. Битый ответ просит повторить (COMMAND::CHECKSUM_ERROR),
+     * а по таймауту просто ждёт дальше: на каждый пакет сервер отвечает ровно один раз
+     * @return false если соединение оборвалось, сервер молчит maxRetry_ таймаутов подряд или ответ раз за разом битый
+     */
+    bool awaitReply(DatatPackage& reply);
 
   private:
     int         port_;
-    int         buffSize_ = 1024;
-    const int   maxRetry_ = 10;
+    bool        zeroCopy_;
+    bool        raw_;                  ///< Просить передачу блоками
+    bool        rawApproved_ = false;  ///< Сервер согласился на передачу блоками
+    int         buffSize_    = 1024;
+    const int   maxRetry_       = 10;
+    const int   replyTimeoutMs_ = 5000;  ///< Сколько ждать ответа за один раз, всего ждём maxRetry_ раз
     std::string address_;
     Socket      sock_;
 };
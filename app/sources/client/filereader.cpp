@@ -0,0 +1,175 @@
+#include "filereader.h"
+#include "../logger/logger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+FileReader::FileReader(size_t chunkSize) :
+    slotSize_ { std::max< size_t >(1, slotTarget_ / std::max< size_t >(1, chunkSize)) * std::max< size_t >(1, chunkSize) },
+    slots_(slotsCount_)
+{
+}
+
+FileReader::~FileReader()
+{
+    stop();
+
+    for (auto &slot : slots_)
+    {
+        if (slot.data) ::operator delete(slot.data, std::align_val_t { alignment_ });
+    }
+
+    if (mapping_) ::munmap(mapping_, fileSize_);
+    if (fd_ >= 0) ::close(fd_);
+}
+
+bool FileReader::open(const std::string &path, bool mapped)
+{
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd_ < 0)
+    {
+        LOG_ERROR("Can't open file", path, std::strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+
+    if (fstat(fd_, &st) < 0)
+    {
+        LOG_ERROR("Can't stat file", path, std::strerror(errno));
+        return false;
+    }
+
+    fileSize_ = st.st_size;
+
+    // Ядро увеличит собственное упреждающее чтение и не будет держать прочитанные страницы в приоритете
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    if (mapped)
+    {
+        // Пустой файл отобразить нельзя, но и отдавать из него нечего
+        if (fileSize_ == 0) return true;
+
+        auto addr = ::mmap(nullptr, fileSize_, PROT_READ, MAP_PRIVATE, fd_, 0);
+
+        if (addr == MAP_FAILED)
+        {
+            LOG_ERROR("Can't map file", path, std::strerror(errno));
+            return false;
+        }
+
+        mapping_ = static_cast< uint8_t * >(addr);
+        ::madvise(mapping_, fileSize_, MADV_SEQUENTIAL);
+        return true;
+    }
+
+    for (auto &slot : slots_)
+    {
+        slot.data = static_cast< uint8_t * >(::operator new(slotSize_, std::align_val_t { alignment_ }));
+    }
+
+    thread_ = std::thread(&FileReader::readLoop, this);
+    return true;
+}
+
+const uint8_t *FileReader::chunk(uint64_t offset, size_t &size)
+{
+    if (mapping_)
+    {
+        if (offset >= fileSize_) return nullptr;
+
+        size = std::min< uint64_t >(size, fileSize_ - offset);
+        return mapping_ + offset;
+    }
+
+    std::unique_lock< std::mutex > lock(mutex_);
+
+    for (;;)
+    {
+        // Буферы, которые отправитель уже прошёл, отдаём потоку чтения
+        while (filled_ > 0 && slots_[head_].offset + slots_[head_].size <= offset)
+        {
+            head_ = (head_ + 1) % slots_.size();
+            filled_--;
+            slotFreed_.notify_one();
+        }
+
+        if (filled_ > 0)
+        {
+            auto &slot = slots_[head_];
+
+            if (offset < slot.offset) return nullptr;
+
+            size = std::min< size_t >(size, slot.offset + slot.size - offset);
+            return slot.data + (offset - slot.offset);
+        }
+
+        if (failed_ || offset >= fileSize_) return nullptr;
+
+        dataReady_.wait(lock);
+    }
+}
+
+void FileReader::readLoop()
+{
+    uint64_t offset = 0;
+    size_t   tail   = 0;
+
+    while (offset < fileSize_)
+    {
+        {
+            std::unique_lock< std::mutex > lock(mutex_);
+            slotFreed_.wait(lock, [this]() { return stopping_ || filled_ < slots_.size(); });
+
+            if (stopping_) return;
+            tail = (head_ + filled_) % slots_.size();
+        }
+
+        // Буфер свободен и отправитель его не трогает, читаем без блокировки
+        auto  &slot = slots_[tail];
+        size_t want = std::min< uint64_t >(slotSize_, fileSize_ - offset);
+        size_t got  = 0;
+
+        while (got < want)
+        {
+            auto res = ::pread(fd_, slot.data + got, want - got, offset + got);
+
+            if (res < 0 && errno == EINTR) continue;
+
+            if (res <= 0)
+            {
+                LOG_ERROR("Can't read file:", res < 0 ? std::strerror(errno) : "unexpected end of file");
+                std::lock_guard< std::mutex > lock(mutex_);
+                failed_ = true;
+                dataReady_.notify_one();
+                return;
+            }
+
+            got += res;
+        }
+
+        std::lock_guard< std::mutex > lock(mutex_);
+        slot.offset = offset;
+        slot.size   = got;
+        filled_++;
+        offset += got;
+        dataReady_.notify_one();
+    }
+}
+
+void FileReader::stop()
+{
+    {
+        std::lock_guard< std::mutex > lock(mutex_);
+        stopping_ = true;
+    }
+
+    slotFreed_.notify_one();
+    if (thread_.joinable()) thread_.join();
+}
@@ -0,0 +1,77 @@
+#ifndef FILEREADER_H
+#define FILEREADER_H
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Упреждающее чтение файла для клиента. Отдельный поток последовательно читает файл в кольцо
+ * больших выровненных буферов, пока отправитель ждёт ответа сервера, так что диск и сеть работают одновременно.
+ * Буфер освобождается, только когда отправитель запросил данные за его концом,
+ * поэтому повторная отправка пакета берёт данные из памяти, а не перечитывает файл.
+ * В режиме отображения файл целиком отображается в память (mmap), поток не нужен, а данные отдаются прямо из страничного кэша
+ */
+class FileReader
+{
+  public:
+    /**
+     * @param Размер пакета: буферы кратны ему, чтобы пакет не разрывался между двумя буферами
+     */
+    explicit FileReader(size_t chunkSize);
+    ~FileReader();
+
+    FileReader(const FileReader&)            = delete;
+    FileReader& operator=(const FileReader&) = delete;
+
+    /**
+     * @brief Открывает файл и запускает поток чтения или отображает файл в память
+     * @param Путь к файлу
+     * @param Отобразить файл в память вместо чтения в буферы
+     */
+    bool open(const std::string& path, bool mapped = false);
+
+    /**
+     * @brief Возвращает данные файла начиная с offset, при необходимости ждёт, пока поток их прочитает.
+     * Указатель действителен до запроса данных за концом буфера, в котором он лежит.
+     * Смещения должны идти по возрастанию, назад можно вернуться только в пределах текущего буфера
+     * @param Смещение от начала файла
+     * @param Сколько байт нужно, на выходе - сколько доступно (меньше только в конце файла)
+     * @return nullptr при ошибке чтения или если offset за концом файла
+     */
+    const uint8_t* chunk(uint64_t offset, size_t& size);
+
+  private:
+    struct Slot
+    {
+        uint8_t* data { nullptr };
+        uint64_t offset { 0 };
+        size_t   size { 0 };
+    };
+
+    void readLoop();
+    void stop();
+
+  private:
+    inline static const size_t slotsCount_ { 4 };
+    inline static const size_t alignment_ { 4096 };
+    inline static const size_t slotTarget_ { 1024 * 1024 };  ///< К какому размеру буфера стремиться
+
+    const size_t            slotSize_;
+    int                     fd_ { -1 };
+    uint8_t*                mapping_ { nullptr };  ///< Отображённый файл в режиме mmap
+    uint64_t                fileSize_ { 0 };
+    std::vector< Slot >     slots_;
+    size_t                  head_ { 0 };    ///< Самый старый заполненный буфер, из него читает отправитель
+    size_t                  filled_ { 0 };  ///< Сколько буферов заполнено подряд начиная с head_
+    bool                    failed_ { false };
+    bool                    stopping_ { false };
+    std::mutex              mutex_;
+    std::condition_variable dataReady_;   ///< Поток заполнил буфер
+    std::condition_variable slotFreed_;   ///< Отправитель освободил буфер
+    std::thread             thread_;
+};
+
+#endif  // FILEREADER_H
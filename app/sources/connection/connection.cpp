@@ -0,0 +1,845 @@
+#include "connection.h"
+#include "../logger/logger.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+Connection::Connection(SocketPtr pSock, const ServerConfig &config, FileStorage &storage, StorageRoots &roots, GroupCommit *commit,
+                       SegmentStore *segments) :
+    pSock_ { std::move(pSock) },
+    edgeTriggered_ { config.edgeTriggered },
+    ioBudget_ { std::max(1, config.ioBudget) },
+    idleTimeoutMs_ { config.idleTimeoutMs },
+    handshakeTimeoutMs_ { config.handshakeTimeoutMs },
+    spliceAllowed_ { config.splice },
+    roots_ { roots },
+    commit_ { commit },
+    segments_ { segments },
+    inBuf_(2 * DatatPackage::maxSize())
+{
+    ss_.setStorage(storage);
+    ss_.setRoots(roots);
+    if (segments) ss_.setSegments(*segments);
+
+    // Отложенная запись пишет файл через O_DIRECT, мимо кэша, и к моменту подтверждения данных в файле ещё нет
+    ss_.setCachePolicy(config.writeBehind ? CachePolicy::KEEP : config.cachePolicy, config.dirtyLimit);
+}
+
+Connection::~Connection()
+{
+    if (loop_)
+    {
+        loop_->cancelTimer(idleTimer_);
+        loop_->cancelTimer(handshakeTimer_);
+    }
+
+    if (syncTicket_) commit_->cancel(syncTicket_);
+    if (pipeRead_ >= 0) ::close(pipeRead_);
+    if (pipeWrite_ >= 0) ::close(pipeWrite_);
+}
+
+int Connection::fd() const
+{
+    return pSock_->getFd();
+}
+
+bool Connection::attach(EventLoop &loop, std::function< void() > onClose)
+{
+    // В режиме по уровню EPOLLOUT взводится только пока в очереди на отправку есть данные, иначе сокет почти всегда
+    // готов к записи и epoll_wait просыпался бы впустую. В режиме по фронту EPOLLOUT приходит лишь когда
+    // в переполненном буфере сокета освобождается место, поэтому он зарегистрирован сразу
+    // С io_uring данные читаются и пишутся кольцом event loop'а, маска событий не нужна
+    viaRing_ = loop.backend() == EventLoop::Backend::IO_URING;
+
+    if (!loop.addFd(fd(), edgeTriggered_ ? edgeEvents_ : readEvents_, std::move(onClose), viaRing_))
+    {
+        return false;
+    }
+
+    loop_ = &loop;
+    loop.bindSlot< &Connection::onReadable >(fd(), EPOLLIN, this);
+    loop.bindSlot< &Connection::onWritable >(fd(), EPOLLOUT, this);
+    loop.bindSlot< &Connection::onHangup >(fd(), EPOLLRDHUP, this);
+    loop.bindSlot< &Connection::onHangup >(fd(), EPOLLERR, this);
+    loop.bindSlot< &Connection::onHangup >(fd(), EPOLLHUP, this);
+
+    lastActivityMs_ = EventLoop::nowMs();
+
+    // Корутина дойдёт до ожидания запроса на передачу и вернёт управление
+    protocol_ = protocol();
+    protocol_.start();
+
+    if (handshakeTimeoutMs_ > 0)
+    {
+        handshakeTimer_ = loop.scheduleTimer(handshakeTimeoutMs_, [this]() { onHandshakeTimeout(); });
+    }
+
+    if (idleTimeoutMs_ > 0)
+    {
+        idleTimer_ = loop.scheduleTimer(idleTimeoutMs_, [this]() { onIdleTimeout(); });
+    }
+
+    return true;
+}
+
+EVENT_LOOP_SIGNALS Connection::onReadable()
+{
+    int frames = 0;
+
+    for (;;)
+    {
+        // Пока корутина отвечает клиенту, новые данные не читаем: сокет заполнится и клиент притормозит сам.
+        // Маску epoll меняем только здесь, когда данные действительно пришли, а не на каждой отправке
+        if (!wantsInput())
+        {
+            pauseRead(true);
+            return EVENT_LOOP_SIGNALS::SIG_NONE;
+        }
+
+        // Блок без пакетов забираем из сокета сами, в inBuf_ он не попадает
+        if (waitFor_ == WaitFor::SPLICE)
+        {
+            if (!spliceSome()) return EVENT_LOOP_SIGNALS::SIG_NONE;
+
+            frames++;
+            resume();
+            if (protocol_.done()) return EVENT_LOOP_SIGNALS::SIG_CLOSE;
+            continue;
+        }
+
+        auto recivedDataSize = viaRing_ ? loop_->recv(fd(), inBuf_.data() + inLen_, inBuf_.size() - inLen_)
+                                        : pSock_->read(inBuf_.data() + inLen_, inBuf_.size() - inLen_);
+
+        if (recivedDataSize < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))  // Всё прочитано
+        {
+            return EVENT_LOOP_SIGNALS::SIG_NONE;
+        }
+
+        if (recivedDataSize < 0)  // Ошибка, отвалился клиент (т.к. принятые данные -1)
+        {
+            LOG_ERROR("Less than zero data readed, error");
+            ss_.reset();
+            return EVENT_LOOP_SIGNALS::SIG_CLOSE;
+        }
+
+        if (recivedDataSize == 0)  // Ошибка, ничего не прочитали от клиента, получается тоже отвалился
+        {
+            LOG_ERROR("0 bytes from client socket read, close socket");
+            ss_.reset();
+            return EVENT_LOOP_SIGNALS::SIG_CLOSE;
+        }
+
+        LOG_INFO("Recived from client:", recivedDataSize, "bytes");
+        inLen_ += recivedDataSize;
+        lastActivityMs_ = EventLoop::nowMs();
+
+        auto signal = processFrames(frames);
+        if (signal != EVENT_LOOP_SIGNALS::SIG_NONE) return signal;
+
+        // По уровню epoll сам разбудит ещё раз, если в сокете что-то осталось
+        if (!edgeTriggered_ && !viaRing_) return EVENT_LOOP_SIGNALS::SIG_NONE;
+
+        // По фронту (как и после завершения multishot recv) нового события не будет, поэтому при исчерпании бюджета просим event loop вернуться к сокету
+        if (frames >= ioBudget_) return EVENT_LOOP_SIGNALS::SIG_AGAIN;
+    }
+}
+
+EVENT_LOOP_SIGNALS Connection::processFrames(int &frames)
+{
+    size_t pos = 0;
+
+    while (waitFor_ == WaitFor::FRAME)
+    {
+        // Пропускаем мусор до начала пакета
+        while (pos < inLen_ && inBuf_[pos] != 0xAA) pos++;
+
+        if (inLen_ - pos < DatatPackage::minSize()) break;
+
+        size_t frameSize = DatatPackage::minSize() + ((inBuf_[pos + 2] << 8) | inBuf_[pos + 3]);
+        if (inLen_ - pos < frameSize) break;
+
+        ss_.recivedPackageRef().replacePackage(data_buffer(inBuf_.begin() + pos, inBuf_.begin() + pos + frameSize));
+        pos += frameSize;
+        frames++;
+
+        // Повторные отправки не касаются протокола, их обрабатываем не будя корутину
+        if (!ss_.recivedPackageRef().verifyCheckSum())  // Ошибка контрольной суммы пакета, нужно уведомить клиента
+        {
+            LOG_INFO("Checksum error");
+            DatatPackage checksumError;
+            checksumError.setCommand(COMMAND::CHECKSUM_ERROR);
+            checksumError.calcChecksum();
+
+            if (!queuePackage(checksumError))
+            {
+                ss_.reset();
+                return EVENT_LOOP_SIGNALS::SIG_CLOSE;
+            }
+
+            // Это тоже ответ на пакет: если он дойдёт битым, клиент попросит повторить именно его
+            ss_.lastSendedPackageRef().replacePackage(std::move(checksumError));
+            continue;
+        }
+
+        if (ss_.recivedPackageRef().getCommand() == COMMAND::CHECKSUM_ERROR)  // Клиенту пришел битый пакет, нужно отправить заново
+        {
+            LOG_WARN("Client recive broken package, resend");
+            if (!queuePackage(ss_.lastSendedPackageRef())) return EVENT_LOOP_SIGNALS::SIG_CLOSE;
+            continue;
+        }
+
+        resume();
+        if (protocol_.done()) return EVENT_LOOP_SIGNALS::SIG_CLOSE;
+    }
+
+    // Неполный пакет переносим в начало буфера
+    std::move(inBuf_.begin() + pos, inBuf_.begin() + inLen_, inBuf_.begin());
+    inLen_ -= pos;
+    return EVENT_LOOP_SIGNALS::SIG_NONE;
+}
+
+EVENT_LOOP_SIGNALS Connection::onWritable()
+{
+    return flush();
+}
+
+EVENT_LOOP_SIGNALS Connection::onHangup()
+{
+    return EVENT_LOOP_SIGNALS::SIG_CLOSE;
+}
+
+void Connection::onHandshakeTimeout()
+{
+    handshakeTimer_ = 0;
+    LOG_WARN("Client didn't request transfer in", handshakeTimeoutMs_, "ms, close connection");
+    close();
+}
+
+void Connection::onIdleTimeout()
+{
+    idleTimer_ = 0;
+    auto idle  = EventLoop::nowMs() - lastActivityMs_;
+
+    if (idle < static_cast< uint64_t >(idleTimeoutMs_))
+    {
+        idleTimer_ = loop_->scheduleTimer(idleTimeoutMs_ - idle, [this]() { onIdleTimeout(); });
+        return;
+    }
+
+    LOG_WARN("Client is idle for", idle, "ms, close connection");
+    close();
+}
+
+void Connection::close()
+{
+    ss_.reset();
+    loop_->removeFd(fd());
+}
+
+Coroutine Connection::protocol()
+{
+    // Первый пакет - запрос на передачу с размером файла или запрос на получение сохранённого файла
+    co_await nextPackage();
+
+    if (ss_.recivedPackageRef().getCommand() == COMMAND::REQUEST_TO_RECEIVE)
+    {
+        DownloadSource source;
+
+        if (!openDownload(source))
+        {
+            co_await send(response(COMMAND::REQUEST_TO_SEND_REJECT));
+            co_return;
+        }
+
+        // Первые 8 байт - размер участка, вторые 8 - размер блока
+        auto &approve = response(COMMAND::REQUEST_TO_RECEIVE_APPROVED);
+        auto  sizes   = toBytes< std::vector< uint8_t > >(source.size());
+        auto  block   = toBytes< std::vector< uint8_t > >(( uint64_t )rawBlockSize_);
+        sizes.insert(sizes.end(), block.begin(), block.end());
+        approve.setData(std::move(sizes));
+        approve.calcChecksum();
+
+        if (!co_await send(approve)) co_return;
+
+        loop_->cancelTimer(handshakeTimer_);
+        handshakeTimer_ = 0;
+        LOG_INFO("Send", source.size(), "bytes to client");
+
+        // Блоки идут так же, как при приёме через splice: блок без заголовков, за ним пакет с его контрольной суммой.
+        // Подтверждений клиент не шлёт, скорость держит TCP
+        for (uint64_t sent = 0; sent < source.size();)
+        {
+            auto     size = std::min< uint64_t >(rawBlockSize_, source.size() - sent);
+            uint32_t crc  = 0;
+
+            if (!source.digest(sent, size, crc) || !co_await sendBlock(source.fd(), source.position(sent), size))
+            {
+                LOG_ERROR("Can't send block to client, abort");
+                co_return;
+            }
+
+            auto &digest = response(COMMAND::BLOCK_DIGEST);
+            digest.setData(toBytes< std::vector< uint8_t > >(crc));
+            digest.calcChecksum();
+
+            if (!co_await send(digest)) co_return;
+
+            sent += size;
+        }
+
+        LOG_INFO("File sent to client, close connection");
+        co_return;
+    }
+
+    std::vector< uint8_t > fSizeArray(8);
+    ss_.recivedPackageRef().getData(fSizeArray);
+
+    // За размером файла может идти байт флагов: клиент просит передавать данные блоками через splice.
+    // С io_uring сокет читает кольцо, забрать из него данные мимо кольца нельзя
+    bool raw = fSizeArray.size() > 8 && (fSizeArray[8] & 0x01) && spliceAllowed_ && !viaRing_;
+    fSizeArray.resize(8);
+    ss_.transmittedDataRef().maxBytes = fromBytes< uint64_t >(fSizeArray);
+
+    // Резервируем место и сразу выделяем его под файл, если не вышло - прервыаем передачу
+    if (!ss_.canSaveFile() || !ss_.openFile())
+    {
+        LOG_ERROR("Can't save file, reject transfer");
+        ss_.reset();
+        co_await send(response(COMMAND::REQUEST_TO_SEND_REJECT));
+        co_return;
+    }
+
+    if (ss_.storesObject())
+    {
+        // Объект копится в памяти и пишется в сегмент одним куском, блоки через splice ему не нужны
+        raw = false;
+        LOG_INFO("Upload will be stored as an object in the segment store");
+    }
+    else
+    {
+        LOG_INFO("Generated file name", ss_.fileName());
+    }
+
+    if (raw)
+    {
+        ss_.transmittedDataRef().packageSizeInBytes = rawBlockSize_;
+        ss_.transmittedDataRef().maxPackages        = (ss_.transmittedDataRef().maxBytes + rawBlockSize_ - 1) / rawBlockSize_;
+        LOG_INFO("Client data will be spliced to file in blocks");
+    }
+    else
+    {
+        ss_.transmittedDataRef().convertBytesToPackages(ss_.transmittedDataRef().maxBytes);
+    }
+
+    LOG_INFO("Server await", ss_.transmittedDataRef().maxPackages, "packages");
+    LOG_INFO("Package size", ss_.transmittedDataRef().packageSizeInBytes, "packages");
+    std::vector< uint8_t > total_packages = toBytes< std::vector< uint8_t > >(( uint64_t )ss_.transmittedDataRef().maxPackages);
+    std::vector< uint8_t > onePackageSize =  // Размер одного пакета
+        toBytes< std::vector< uint8_t > >(( uint64_t )ss_.transmittedDataRef().packageSizeInBytes);
+
+    // Сливаем два блока данных в один
+    //  первые 64 байта - сколько пакетов ожидается
+    //  вторые 64 байта - размер одного пакета
+    ss_.bufferRef().clear();
+    ss_.bufferRef().insert(ss_.bufferRef().begin(), total_packages.begin(), total_packages.end());
+    ss_.bufferRef().insert(ss_.bufferRef().begin() + total_packages.size(), onePackageSize.begin(), onePackageSize.end());
+    if (raw) ss_.bufferRef().push_back(0x01);  // Согласие на передачу блоками
+    auto &approve = response(COMMAND::REQUEST_TO_SEND_APPROVED);
+    approve.setData(ss_.bufferRef());
+    approve.calcChecksum();
+
+    if (!co_await send(approve))
+    {
+        ss_.reset();
+        co_return;
+    }
+
+    loop_->cancelTimer(handshakeTimer_);
+    handshakeTimer_ = 0;
+
+    while (ss_.transmittedDataRef().packagesRecived < ss_.transmittedDataRef().maxPackages)
+    {
+        if (raw)
+        {
+            auto offset = ss_.writeOffset();
+            auto size   = std::min< uint64_t >(rawBlockSize_, ss_.transmittedDataRef().maxBytes - offset);
+
+            if (!co_await spliceBlock(size))
+            {
+                LOG_ERROR("Can't receive block");
+                break;
+            }
+
+            co_await nextPackage();
+
+            if (ss_.recivedPackageRef().getCommand() != COMMAND::BLOCK_DIGEST ||
+                ss_.recivedPackageRef().getData(ss_.bufferRef()) != sizeof(uint32_t))
+            {
+                LOG_ERROR("Unexpected command from client");
+                break;
+            }
+
+            if (!ss_.verifyWritten(offset, size, fromBytes< uint32_t >(ss_.bufferRef())))
+            {
+                LOG_ERROR("Block digest mismatch");
+                break;
+            }
+
+            acceptPackage(size);
+
+            if (!co_await send(ss_.packageToSendRef()))
+            {
+                LOG_ERROR("Send responce to client error, abort");
+                ss_.reset();
+                co_return;
+            }
+            continue;
+        }
+
+        co_await nextPackage();
+
+        if (ss_.recivedPackageRef().getCommand() != COMMAND::DATA_PACKAGE)
+        {
+            LOG_ERROR("Unexpected command from client");
+            break;
+        }
+
+        ss_.bufferRef().clear();
+        size_t bytesToWrite = ss_.recivedPackageRef().getData(ss_.bufferRef());
+
+        // Подтверждение уйдёт клиенту только когда данные будут записаны
+        if (!co_await writeFile(ss_.bufferRef(), bytesToWrite))
+        {
+            LOG_ERROR("Can't write to file");
+            break;
+        }
+
+        // Хранилище может подтвердить запись раньше, чем данные попадут в файл. Подтверждение последнего пакета
+        // клиент считает подтверждением всего файла, поэтому перед ним дожидаемся отложенных записей
+        bool last = ss_.transmittedDataRef().packagesRecived + 1 == ss_.transmittedDataRef().maxPackages;
+
+        if (last && !co_await flushFile())
+        {
+            LOG_ERROR("Can't write to file");
+            break;
+        }
+
+        acceptPackage(bytesToWrite);
+
+        if (!co_await send(ss_.packageToSendRef()))
+        {
+            LOG_ERROR("Send responce to client error, abort");
+            ss_.reset();
+            co_return;
+        }
+    }
+
+    if (ss_.transmittedDataRef().packagesRecived < ss_.transmittedDataRef().maxPackages)
+    {
+        LOG_WARN("Abort connection with client");
+        ss_.reset();
+
+        // Закрываем соединение только после того, как клиент получит пакет с отказом
+        co_await send(response(COMMAND::ABORT));
+        co_return;
+    }
+
+    co_await nextPackage();
+
+    if (ss_.recivedPackageRef().getCommand() == COMMAND::ALL_DATA_SENDED)
+    {
+        LOG_INFO("The client confirmed successful data transfer");
+
+        // Ответ клиент считает подтверждением того, что файл сохранён, поэтому сначала дожидаемся сброса на диск
+        if (!co_await syncFile())
+        {
+            LOG_ERROR("Can't sync file, abort");
+            ss_.reset();
+            co_await send(response(COMMAND::ABORT));
+            co_return;
+        }
+
+        // В ответе номер объекта или имя файла, по ним клиент может потом получить его обратно
+        auto &saved = response(COMMAND::FILE_SAVED);
+        auto  name  = ss_.fileName();
+
+        if (ss_.objectId())
+        {
+            saved.setData(toBytes< std::vector< uint8_t > >(ss_.objectId()));
+        }
+        else
+        {
+            saved.setData(data_buffer(name.begin(), name.end()));
+        }
+
+        saved.calcChecksum();
+
+        co_await send(saved);
+        ss_.commitUpload();
+        LOG_INFO("Close connection");
+        ss_.printInfo();
+    }
+}
+
+DatatPackage &Connection::response(COMMAND cmd)
+{
+    ss_.packageToSendRef().setCommand(cmd);
+    ss_.packageToSendRef().clearData();
+    ss_.packageToSendRef().calcChecksum();
+    return ss_.packageToSendRef();
+}
+
+void Connection::suspend(std::coroutine_handle<> handle, WaitFor waitFor)
+{
+    waiter_  = handle;
+    waitFor_ = waitFor;
+}
+
+void Connection::resume()
+{
+    waitFor_ = WaitFor::NONE;
+    std::exchange(waiter_, {}).resume();
+}
+
+EVENT_LOOP_SIGNALS Connection::continueProtocol()
+{
+    resume();
+    if (protocol_.done()) return EVENT_LOOP_SIGNALS::SIG_CLOSE;
+
+    if (!wantsInput()) return EVENT_LOOP_SIGNALS::SIG_NONE;
+
+    // Сначала разбираем то, что уже лежит во входном буфере, а чтение сокета - на следующей итерации
+    int  frames = 0;
+    auto signal = waitFor_ == WaitFor::FRAME ? processFrames(frames) : EVENT_LOOP_SIGNALS::SIG_NONE;
+
+    if (signal == EVENT_LOOP_SIGNALS::SIG_NONE && readPaused_ && wantsInput())
+    {
+        pauseRead(false);
+        loop_->requeue(fd(), EPOLLIN);
+    }
+
+    return signal;
+}
+
+bool Connection::SendAwaiter::await_ready()
+{
+    ok = conn.queuePackage(pkg);
+
+    // Повторять клиенту, если тот получит пакет битым, будем этот пакет
+    conn.ss_.lastSendedPackageRef().replacePackage(std::move(pkg));
+    conn.ss_.packageToSendRef().setCommand(COMMAND::EMPTY_CMD);
+
+    return !ok || conn.outQueue_.empty();
+}
+
+bool Connection::openDownload(DownloadSource &source)
+{
+    // Сокет io_uring пишет кольцо: sendfile мимо него мог бы обогнать ещё не отправленные кольцом пакеты
+    if (viaRing_)
+    {
+        LOG_ERROR("Downloads are not served through io_uring");
+        return false;
+    }
+
+    // Первые 8 байт - начало участка, вторые 8 - его длина (0 - до конца), затем байт вида: 0 - дальше имя файла,
+    // 1 - дальше 8 байт номера объекта
+    ss_.recivedPackageRef().getData(ss_.bufferRef());
+    auto &request = ss_.bufferRef();
+
+    if (request.size() < 2 * sizeof(uint64_t) + 1)
+    {
+        LOG_ERROR("Malformed download request");
+        return false;
+    }
+
+    auto offset = fromBytes< uint64_t >(data_buffer(request.begin(), request.begin() + sizeof(uint64_t)));
+    auto length = fromBytes< uint64_t >(data_buffer(request.begin() + sizeof(uint64_t), request.begin() + 2 * sizeof(uint64_t)));
+    auto kind   = request[2 * sizeof(uint64_t)];
+    auto name   = data_buffer(request.begin() + 2 * sizeof(uint64_t) + 1, request.end());
+
+    bool opened = false;
+
+    if (kind == 0)
+    {
+        opened = source.openFile(roots_, std::string(name.begin(), name.end()));
+    }
+    else if (kind == 1 && segments_ && name.size() == sizeof(uint64_t))
+    {
+        opened = source.openObject(*segments_, fromBytes< uint64_t >(name));
+    }
+
+    if (!opened)
+    {
+        LOG_ERROR("Requested file is not found");
+        return false;
+    }
+
+    if (!source.select(offset, length))
+    {
+        LOG_ERROR("Requested range", offset, "+", length, "is out of file");
+        return false;
+    }
+
+    return true;
+}
+
+bool Connection::SendFileAwaiter::await_ready()
+{
+    conn.sendFd_     = fd;
+    conn.sendOffset_ = offset;
+    conn.sendLeft_   = bytes;
+
+    ok = conn.flush() != EVENT_LOOP_SIGNALS::SIG_CLOSE;
+    return !ok || conn.sendLeft_ == 0;
+}
+
+void Connection::SpliceAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    conn.spliceLeft_ = bytes;
+    conn.suspend(handle, WaitFor::SPLICE);
+
+    // Блок мог прийти, пока отправлялось подтверждение: по фронту нового события не будет, так что заходим в слот сами.
+    // Заодно к тому времени processFrames уберёт из inBuf_ разобранные пакеты
+    conn.pauseRead(false);
+    conn.loop_->requeue(conn.fd(), EPOLLIN);
+}
+
+bool Connection::spliceSome()
+{
+    // Клиент шлёт блок только после подтверждения, так что лишних байт во входном буфере быть не должно
+    if (inLen_ > 0 || (pipeRead_ < 0 && !openPipe()))
+    {
+        if (inLen_ > 0) LOG_ERROR("Client sent data before the block was requested");
+        spliceOk_ = false;
+        return true;
+    }
+
+    while (spliceLeft_ > 0)
+    {
+        auto res = ::splice(fd(), nullptr, pipeWrite_, nullptr, std::min(spliceLeft_, pipeSize_), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+        if (res < 0 && errno == EINTR) continue;
+        if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return false;  // Канал пуст, значит пуст сокет
+
+        if (res <= 0)
+        {
+            LOG_ERROR("Can't splice from client socket:", res < 0 ? std::strerror(errno) : "connection closed");
+            spliceOk_ = false;
+            return true;
+        }
+
+        lastActivityMs_ = EventLoop::nowMs();
+
+        if (!ss_.spliceToFile(pipeRead_, res))
+        {
+            spliceOk_ = false;
+            return true;
+        }
+
+        spliceLeft_ -= res;
+    }
+
+    spliceOk_ = true;
+    return true;
+}
+
+bool Connection::openPipe()
+{
+    int fds[2];
+
+    if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        LOG_ERROR("Can't create pipe:", std::strerror(errno));
+        return false;
+    }
+
+    pipeRead_  = fds[0];
+    pipeWrite_ = fds[1];
+
+    // Больше канал - меньше вызовов splice на блок. Размер ограничен /proc/sys/fs/pipe-max-size, тогда остаётся какой есть
+    auto size = ::fcntl(pipeWrite_, F_SETPIPE_SZ, rawBlockSize_);
+    if (size < 0) size = ::fcntl(pipeWrite_, F_GETPIPE_SZ);
+    pipeSize_ = size > 0 ? size : 64 * 1024;
+    return true;
+}
+
+bool Connection::WriteAwaiter::await_ready()
+{
+    result = conn.ss_.writeToFile(data, bytes, [&conn = conn](bool ok) { conn.onWriteDone(ok); });
+    return result != FileStorage::Result::PENDING;
+}
+
+bool Connection::WriteAwaiter::await_resume() const noexcept
+{
+    return result == FileStorage::Result::DONE || (result == FileStorage::Result::PENDING && conn.writeOk_);
+}
+
+bool Connection::FlushAwaiter::await_ready()
+{
+    result = conn.ss_.flushFile([&conn = conn](bool ok) { conn.onWriteDone(ok); });
+    return result != FileStorage::Result::PENDING;
+}
+
+bool Connection::FlushAwaiter::await_resume() const noexcept
+{
+    return result == FileStorage::Result::DONE || (result == FileStorage::Result::PENDING && conn.writeOk_);
+}
+
+bool Connection::SyncAwaiter::await_ready()
+{
+    if (!conn.commit_)
+    {
+        conn.writeOk_ = true;
+        return true;
+    }
+
+    conn.syncTicket_ = conn.ss_.syncFile(*conn.commit_, *conn.loop_, [&conn = conn](bool ok) {
+        conn.syncTicket_ = 0;
+        conn.onWriteDone(ok);
+    });
+
+    conn.writeOk_ = false;
+    return conn.syncTicket_ == 0;
+}
+
+void Connection::acceptPackage(size_t bytes)
+{
+    ss_.transmittedDataRef().packageRecived(bytes);
+    ss_.manageCache();
+    ss_.printInfo();
+    ss_.packageToSendRef().clearData();
+    ss_.packageToSendRef().setCommand(COMMAND::PACKAGE_ACCPTED);
+    ss_.packageToSendRef().setData(static_cast< uint16_t >(ss_.transmittedDataRef().packagesRecived));
+    ss_.packageToSendRef().calcChecksum();
+}
+
+void Connection::onWriteDone(bool ok)
+{
+    writeOk_    = ok;
+    auto signal = continueProtocol();
+
+    // Вызваны из слота хранилища, а не из своего, так что убираем сокет из event loop сами.
+    // Сессию не сбрасываем: после успешной передачи файл должен остаться
+    if (signal == EVENT_LOOP_SIGNALS::SIG_CLOSE || signal == EVENT_LOOP_SIGNALS::SIG_EXIT) loop_->removeFd(fd());
+}
+
+bool Connection::queuePackage(const DatatPackage &pkg)
+{
+    auto &frame = outQueue_.emplace_back();
+    pkg.generatePackage(frame);
+
+    // Если очередь была пуста - пробуем отправить сразу, не дожидаясь EPOLLOUT
+    if (outQueue_.size() == 1)
+    {
+        return flush() != EVENT_LOOP_SIGNALS::SIG_CLOSE;
+    }
+
+    return true;
+}
+
+EVENT_LOOP_SIGNALS Connection::flush()
+{
+    if (viaRing_)
+    {
+        // Кадры уходят цепочкой send в порядке постановки, сокет закроется только после их отправки
+        for (auto &frame : outQueue_)
+        {
+            if (!loop_->send(fd(), std::move(frame)))
+            {
+                LOG_ERROR("Write to client failed, close connection");
+                outQueue_.clear();
+                return EVENT_LOOP_SIGNALS::SIG_CLOSE;
+            }
+        }
+
+        outQueue_.clear();
+        return EVENT_LOOP_SIGNALS::SIG_NONE;
+    }
+
+    while (!outQueue_.empty())
+    {
+        auto &frame = outQueue_.front();
+        auto  res   = pSock_->write(frame.data() + outOffset_, frame.size() - outOffset_);
+
+        if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            // Сокет заполнен, дописываем остаток когда epoll сообщит о готовности к записи
+            armWrite(true);
+            return EVENT_LOOP_SIGNALS::SIG_NONE;
+        }
+
+        if (res <= 0)
+        {
+            LOG_ERROR("Write to client failed, close connection");
+            return EVENT_LOOP_SIGNALS::SIG_CLOSE;
+        }
+
+        outOffset_ += res;
+
+        if (outOffset_ == frame.size())
+        {
+            outQueue_.pop_front();
+            outOffset_ = 0;
+        }
+    }
+
+    // Участок файла идёт из страничного кэша прямо в сокет, в память процесса байты не копируются
+    while (sendLeft_ > 0)
+    {
+        auto res = ::sendfile(fd(), sendFd_, &sendOffset_, sendLeft_);
+
+        if (res < 0 && errno == EINTR) continue;
+
+        if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            armWrite(true);
+            return EVENT_LOOP_SIGNALS::SIG_NONE;
+        }
+
+        if (res <= 0)
+        {
+            LOG_ERROR("Can't send file to client:", res < 0 ? std::strerror(errno) : "unexpected end of file");
+            sendLeft_ = 0;
+            return EVENT_LOOP_SIGNALS::SIG_CLOSE;
+        }
+
+        sendLeft_ -= res;
+        lastActivityMs_ = EventLoop::nowMs();
+    }
+
+    armWrite(false);
+
+    // Корутина ждала, пока ответ уйдёт клиенту
+    return waitFor_ == WaitFor::SEND ? continueProtocol() : EVENT_LOOP_SIGNALS::SIG_NONE;
+}
+
+void Connection::armWrite(bool enable)
+{
+    if (writeArmed_ == enable) return;
+
+    writeArmed_ = enable;
+    updateEvents();
+}
+
+void Connection::pauseRead(bool enable)
+{
+    if (readPaused_ == enable) return;
+
+    readPaused_ = enable;
+    updateEvents();
+}
+
+void Connection::updateEvents()
+{
+    // По фронту и через io_uring новых событий и так не будет, пока не вычитаем сокет
+    if (edgeTriggered_ || viaRing_) return;
+
+    auto events = readEvents_;
+    if (readPaused_) events &= ~EPOLLIN;
+    if (writeArmed_) events |= EPOLLOUT;
+
+    loop_->modifyFd(fd(), events);
+}
@@ -0,0 +1,317 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+#include "../coroutine/coroutine.h"
+#include "../event_loop/eventloop.h"
+#include "../server/serverconfig.h"
+#include "../session/session.h"
+#include "../socket/socket.h"
+#include "../storage/downloadsource.h"
+#include "../storage/filestorage.h"
+#include "../storage/groupcommit.h"
+
+#include <coroutine>
+#include <deque>
+#include <functional>
+#include <sys/epoll.h>
+
+/**
+ * @brief Соединение с одним клиентом на стороне сервера: сокет, сессия и корутина протокола.
+ * Обработчики событий вызываются event loop'ом реактора, которому принадлежит соединение, и возобновляют корутину,
+ * когда случилось то, чего она ждёт
+ */
+class Connection
+{
+  public:
+    /**
+     * @param Сокет клиента
+     * @param Настройки сервера
+     * @param Хранилище реактора, через которое пишутся принятые файлы
+     * @param Каталоги, из которых выбирается место для файла
+     * @param Сброс файлов на диск перед подтверждением, nullptr - подтверждать сразу
+     * @param Хранилище мелких загрузок, nullptr - каждая загрузка в свой файл
+     */
+    Connection(SocketPtr pSock, const ServerConfig& config, FileStorage& storage, StorageRoots& roots, GroupCommit* commit = nullptr,
+               SegmentStore* segments = nullptr);
+    ~Connection();
+
+    Connection(const Connection&)            = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    /**
+     * @brief Регистрирует сокет соединения в event loop и назначает слоты на его события
+     * @param Event loop реактора
+     * @param Вызывается когда соединение убрано из event loop, после этого объект можно удалять
+     */
+    bool attach(EventLoop& loop, std::function< void() > onClose);
+
+    int fd() const;
+
+  private:
+    /**
+     * @brief Чего ждёт корутина протокола
+     */
+    enum class WaitFor
+    {
+        NONE,    ///< Выполняется или завершена
+        FRAME,   ///< Следующего пакета от клиента
+        SEND,    ///< Пока исходящая очередь и участок файла за ней не уйдут в сокет
+        WRITE,   ///< Завершения записи в файл
+        SPLICE,  ///< Пока блок без пакетов не будет перенесён из сокета в файл
+    };
+
+    /**
+     * @brief co_await nextPackage(): ждёт следующий пакет, после возобновления он лежит в Session::recivedPackageRef
+     */
+    struct FrameAwaiter
+    {
+        Connection& conn;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { conn.suspend(handle, WaitFor::FRAME); }
+        void await_resume() const noexcept {}
+    };
+
+    /**
+     * @brief co_await send(pkg): ставит пакет в очередь и ждёт, пока очередь не будет записана в сокет
+     */
+    struct SendAwaiter
+    {
+        Connection&   conn;
+        DatatPackage& pkg;
+        bool          ok { true };
+
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> handle) { conn.suspend(handle, WaitFor::SEND); }
+        bool await_resume() const noexcept { return ok; }
+    };
+
+    /**
+     * @brief co_await writeFile(buf, bytes): пишет данные в файл сессии и ждёт завершения записи
+     */
+    struct WriteAwaiter
+    {
+        Connection&                   conn;
+        const std::vector< uint8_t >& data;
+        size_t                        bytes;
+        FileStorage::Result           result { FileStorage::Result::FAILED };
+
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> handle) { conn.suspend(handle, WaitFor::WRITE); }
+        bool await_resume() const noexcept;
+    };
+
+    /**
+     * @brief co_await flushFile(): ждёт, пока хранилище не допишет в файл отложенные записи сессии
+     */
+    struct FlushAwaiter
+    {
+        Connection&         conn;
+        FileStorage::Result result { FileStorage::Result::FAILED };
+
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> handle) { conn.suspend(handle, WaitFor::WRITE); }
+        bool await_resume() const noexcept;
+    };
+
+    /**
+     * @brief co_await syncFile(): ждёт, пока файл не будет сброшен на диск, без GroupCommit завершается сразу
+     */
+    struct SyncAwaiter
+    {
+        Connection& conn;
+
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> handle) { conn.suspend(handle, WaitFor::WRITE); }
+        bool await_resume() const noexcept { return conn.writeOk_; }
+    };
+
+    /**
+     * @brief co_await spliceBlock(bytes): переносит bytes байт из сокета в файл через канал, не копируя их в память процесса
+     */
+    struct SpliceAwaiter
+    {
+        Connection& conn;
+        size_t      bytes;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        bool await_resume() const noexcept { return conn.spliceOk_; }
+    };
+
+    /**
+     * @brief co_await sendBlock(fd, offset, bytes): отправляет участок файла через sendfile и ждёт, пока он не уйдёт в сокет
+     */
+    struct SendFileAwaiter
+    {
+        Connection& conn;
+        int         fd;
+        uint64_t    offset;
+        size_t      bytes;
+        bool        ok { true };
+
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> handle) { conn.suspend(handle, WaitFor::SEND); }
+        bool await_resume() const noexcept { return ok; }
+    };
+
+    /**
+     * @brief Протокол приёма файла: запрос на передачу, пакеты с данными, завершающее сообщение.
+     * Если клиент попросил и сервер разрешает, данные идут блоками без пакетов, за каждым блоком - его контрольная сумма.
+     * Если первым пришёл запрос на получение, сервер вместо приёма отдаёт файл блоками через sendfile.
+     * Когда корутина завершается, соединение закрывается
+     */
+    Coroutine protocol();
+
+    FrameAwaiter  nextPackage() { return FrameAwaiter { *this }; }
+    SendAwaiter   send(DatatPackage& pkg) { return SendAwaiter { *this, pkg }; }
+    WriteAwaiter  writeFile(const std::vector< uint8_t >& data, size_t bytes) { return WriteAwaiter { *this, data, bytes }; }
+    FlushAwaiter  flushFile() { return FlushAwaiter { *this }; }
+    SyncAwaiter   syncFile() { return SyncAwaiter { *this }; }
+    SpliceAwaiter spliceBlock(size_t bytes) { return SpliceAwaiter { *this, bytes }; }
+
+    SendFileAwaiter sendBlock(int fd, uint64_t offset, size_t bytes) { return SendFileAwaiter { *this, fd, offset, bytes }; }
+
+    /**
+     * @brief Находит файл или объект и участок, которые просит клиент в REQUEST_TO_RECEIVE
+     */
+    bool openDownload(DownloadSource& source);
+
+    /**
+     * @brief Корутина ждёт данных из сокета: пакет или блок для splice
+     */
+    bool wantsInput() const { return waitFor_ == WaitFor::FRAME || waitFor_ == WaitFor::SPLICE; }
+
+    /**
+     * @brief Переносит в файл то, что уже пришло из текущего блока
+     * @return false если блок ещё не пришёл целиком, иначе результат в spliceOk_
+     */
+    bool spliceSome();
+
+    /**
+     * @brief Создаёт канал для splice, по возможности размером с блок
+     */
+    bool openPipe();
+
+    /**
+     * @brief Готовит в Session::packageToSendRef ответ без данных
+     */
+    DatatPackage& response(COMMAND cmd);
+
+    void suspend(std::coroutine_handle<> handle, WaitFor waitFor);
+
+    /**
+     * @brief Возобновляет корутину с места, где она ждала
+     */
+    void resume();
+
+    /**
+     * @brief Возобновляет корутину вне слота чтения, затем разбирает уже принятые пакеты и возобновляет чтение сокета
+     * @return SIG_CLOSE если корутина завершилась
+     */
+    EVENT_LOOP_SIGNALS continueProtocol();
+
+    EVENT_LOOP_SIGNALS onReadable();
+    EVENT_LOOP_SIGNALS onWritable();
+    EVENT_LOOP_SIGNALS onHangup();
+
+    /**
+     * @brief Клиент не прислал запрос на передачу вовремя, соединение закрывается
+     */
+    void onHandshakeTimeout();
+
+    /**
+     * @brief Проверяет, сколько соединение простаивает: закрывает его или переставляет таймер на оставшееся время.
+     * Так таймер не нужно переставлять на каждый принятый пакет
+     */
+    void onIdleTimeout();
+
+    /**
+     * @brief Убирает соединение из event loop, после вызова объект уже удалён
+     */
+    void close();
+
+    /**
+     * @brief Выделяет из входного буфера целые пакеты и передаёт их корутине, пока она ждёт пакет.
+     * Неполный пакет и пакеты, пришедшие пока корутина занята, остаются до следующего вызова
+     * @param Счётчик обработанных за текущее пробуждение пакетов
+     */
+    EVENT_LOOP_SIGNALS processFrames(int& frames);
+
+    /**
+     * @brief Учитывает записанный пакет и готовит подтверждение для клиента
+     */
+    void acceptPackage(size_t bytes);
+
+    /**
+     * @brief Асинхронная запись пакета завершилась, продолжает корутину
+     */
+    void onWriteDone(bool ok);
+
+    /**
+     * @brief Кладёт пакет в исходящую очередь, если очередь была пуста - сразу пытается его отправить
+     * @return false если запись в сокет завершилась ошибкой
+     */
+    bool queuePackage(const DatatPackage& pkg);
+
+    /**
+     * @brief Пишет в сокет исходящую очередь, а за ней участок файла, пока они не уйдут или сокет не заполнится
+     */
+    EVENT_LOOP_SIGNALS flush();
+
+    /**
+     * @brief Включает/выключает интерес к EPOLLOUT через EPOLL_CTL_MOD, в режиме EPOLLET и io_uring ничего не делает
+     */
+    void armWrite(bool enable);
+
+    /**
+     * @brief Приостанавливает/возобновляет чтение сокета, пока корутина занята отправкой или записью
+     */
+    void pauseRead(bool enable);
+
+    /**
+     * @brief Пересчитывает маску событий epoll по writeArmed_ и readPaused_
+     */
+    void updateEvents();
+
+  private:
+    inline static const uint32_t readEvents_ = EPOLLIN | EPOLLHUP | EPOLLERR;
+    inline static const uint32_t edgeEvents_ = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLHUP | EPOLLERR | EPOLLET;
+    inline static const size_t   rawBlockSize_ { 1024 * 1024 };  ///< Размер блока в режиме splice
+
+    SocketPtr                 pSock_;
+    const bool                edgeTriggered_;
+    const int                 ioBudget_;
+    const int                 idleTimeoutMs_;
+    const int                 handshakeTimeoutMs_;
+    const bool                spliceAllowed_;
+    StorageRoots&             roots_;
+    GroupCommit*              commit_;
+    SegmentStore*             segments_;
+    uint64_t                  syncTicket_ { 0 };      ///< Запрос на сброс файла, который ещё не завершился
+    TimerWheel::TimerId       idleTimer_ { 0 };
+    TimerWheel::TimerId       handshakeTimer_ { 0 };
+    uint64_t                  lastActivityMs_ { 0 };  ///< Когда от клиента последний раз приходили данные или уходил ему файл
+    data_buffer               inBuf_;                 ///< Принятые, но ещё не разобранные байты
+    size_t                    inLen_ { 0 };           ///< Сколько байт в inBuf_ занято
+    Session                   ss_;
+    EventLoop*                loop_ { nullptr };
+    std::deque< data_buffer > outQueue_;              ///< Исходящие кадры, ещё не записанные в сокет
+    size_t                    outOffset_ { 0 };       ///< Сколько байт первого кадра уже записано
+    int                       sendFd_ { -1 };         ///< Файл, участок которого уходит в сокет вслед за очередью
+    off_t                     sendOffset_ { 0 };
+    size_t                    sendLeft_ { 0 };        ///< Сколько байт участка ещё не отправлено
+    bool                      writeArmed_ { false };  ///< Взведён ли EPOLLOUT
+    bool                      viaRing_ { false };     ///< Сокет обслуживается через io_uring
+    bool                      readPaused_ { false };  ///< Чтение сокета ждёт, пока корутина не попросит следующий пакет
+    bool                      writeOk_ { false };     ///< Чем завершилась асинхронная запись
+    int                       pipeRead_ { -1 };       ///< Канал, через который блок идёт из сокета в файл
+    int                       pipeWrite_ { -1 };
+    size_t                    pipeSize_ { 0 };
+    size_t                    spliceLeft_ { 0 };      ///< Сколько байт текущего блока ещё не перенесено
+    bool                      spliceOk_ { false };    ///< Чем завершился перенос блока
+    std::coroutine_handle<>   waiter_;                ///< Где приостановлена корутина
+    WaitFor                   waitFor_ { WaitFor::NONE };
+    Coroutine                 protocol_;  ///< Объявлена последней: кадр уничтожается раньше, чем то, на что он ссылается
+};
+
+#endif  // CONNECTION_H
@@ -0,0 +1,74 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+#include "framepool.h"
+
+/**
+ * @brief Корутина, которой владеет вызывающий: создаётся приостановленной, запускается start(),
+ * при уничтожении объекта уничтожается и кадр, даже если корутина ещё ждёт на co_await.
+ * Кадры выделяются из FramePool. Возобновляют корутину её awaiter'ы, обычно из слотов event loop
+ */
+class Coroutine
+{
+  public:
+    struct promise_type
+    {
+        Coroutine get_return_object() { return Coroutine { std::coroutine_handle< promise_type >::from_promise(*this) }; }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        // Кадр остаётся после завершения, чтобы владелец мог проверить done() и уничтожить его сам
+        std::suspend_always final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+
+        static void* operator new(size_t size) { return FramePool::allocate(size); }
+        static void  operator delete(void* frame, size_t size) { FramePool::deallocate(frame, size); }
+    };
+
+    Coroutine() = default;
+
+    explicit Coroutine(std::coroutine_handle< promise_type > handle) :
+        handle_ { handle }
+    {
+    }
+
+    Coroutine(Coroutine&& other) noexcept :
+        handle_ { std::exchange(other.handle_, {}) }
+    {
+    }
+
+    Coroutine& operator=(Coroutine&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (handle_) handle_.destroy();
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+
+    Coroutine(const Coroutine&)            = delete;
+    Coroutine& operator=(const Coroutine&) = delete;
+
+    ~Coroutine()
+    {
+        if (handle_) handle_.destroy();
+    }
+
+    /**
+     * @brief Выполняет корутину до первого co_await
+     */
+    void start() { handle_.resume(); }
+
+    bool done() const { return !handle_ || handle_.done(); }
+
+  private:
+    std::coroutine_handle< promise_type > handle_;
+};
+
+#endif  // COROUTINE_H
@@ -0,0 +1,63 @@
+#include "framepool.h"
+
+#include <array>
+#include <new>
+
+/**
+ * @brief Свободные кадры потока, при завершении потока возвращаются в кучу
+ */
+struct FramePool::FreeLists
+{
+    std::array< FreeBlock*, classes_ > heads {};
+
+    ~FreeLists()
+    {
+        for (auto head : heads)
+        {
+            while (head)
+            {
+                auto next = head->next;
+                ::operator delete(head);
+                head = next;
+            }
+        }
+    }
+};
+
+FramePool::FreeLists& FramePool::freeLists()
+{
+    thread_local FreeLists lists;
+    return lists;
+}
+
+void* FramePool::allocate(size_t size)
+{
+    if (size > maxSize_) return ::operator new(size);
+
+    auto& head = freeLists().heads[classOf(size)];
+
+    if (head)
+    {
+        auto block = head;
+        head       = block->next;
+        return block;
+    }
+
+    // Выделяем сразу под верхнюю границу класса, чтобы блок подошёл любому кадру этого класса
+    return ::operator new((classOf(size) + 1) * step_);
+}
+
+void FramePool::deallocate(void* frame, size_t size)
+{
+    if (size > maxSize_)
+    {
+        ::operator delete(frame);
+        return;
+    }
+
+    auto& head  = freeLists().heads[classOf(size)];
+    auto  block = static_cast< FreeBlock* >(frame);
+
+    block->next = head;
+    head        = block;
+}
@@ -0,0 +1,33 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+#include <cstddef>
+
+/**
+ * @brief Аллокатор кадров корутин. Кадры раскладываются по классам размера с шагом 64 байта,
+ * освобождённый кадр кладётся в список свободных своего класса и достаётся следующей корутине того же размера.
+ * Списки у каждого потока свои, так что после прогрева создание корутины не обращается к куче и не берёт блокировок.
+ * Кадры крупнее maxSize_ выделяются обычным operator new
+ */
+class FramePool
+{
+  public:
+    static void* allocate(size_t size);
+    static void  deallocate(void* frame, size_t size);
+
+  private:
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    struct FreeLists;
+
+    static constexpr size_t step_    = 64;
+    static constexpr size_t maxSize_ = 4096;
+    static constexpr size_t classes_ = maxSize_ / step_;
+
+    static size_t     classOf(size_t size) { return (size + step_ - 1) / step_ - 1; }
+    static FreeLists& freeLists();
+};
+
+#endif  // FRAMEPOOL_H
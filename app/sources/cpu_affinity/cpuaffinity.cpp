@@ -0,0 +1,111 @@
+#include "cpuaffinity.h"
+#include "../logger/logger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+std::vector< int > cpu_affinity::parseCpuList(const std::string &list)
+{
+    std::vector< int > cpus;
+    size_t             pos = 0;
+
+    while (pos < list.size())
+    {
+        auto comma = list.find(',', pos);
+        auto item  = list.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        pos        = (comma == std::string::npos) ? list.size() : comma + 1;
+
+        if (item.empty() || item.find_first_not_of("0123456789-") != std::string::npos) return {};
+
+        auto dash = item.find('-');
+
+        try
+        {
+            int first = std::stoi(item.substr(0, dash));
+            int last  = (dash == std::string::npos) ? first : std::stoi(item.substr(dash + 1));
+
+            // cpu_set_t не вмещает больше CPU_SETSIZE ядер, а диапазон без границы раздул бы список до миллиардов
+            if (last < first || last >= CPU_SETSIZE) return {};
+
+            for (int cpu = first; cpu <= last; ++cpu)
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        catch (const std::exception &)
+        {
+            return {};
+        }
+    }
+
+    return cpus;
+}
+
+bool cpu_affinity::pinCurrentThread(int cpu)
+{
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+        LOG_ERROR("Can't pin thread to cpu", cpu, "out of range");
+        return false;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    auto res = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    if (res != 0)
+    {
+        LOG_ERROR("Can't pin thread to cpu", cpu, std::strerror(res));
+        return false;
+    }
+
+    return true;
+}
+
+int cpu_affinity::nodeOfCpu(int cpu)
+{
+    auto path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR *dir  = opendir(path.c_str());
+
+    if (!dir) return 0;
+
+    int node = 0;
+
+    while (auto entry = readdir(dir))
+    {
+        if (std::strncmp(entry->d_name, "node", 4) == 0)
+        {
+            node = std::atoi(entry->d_name + 4);
+            break;
+        }
+    }
+
+    closedir(dir);
+    return node;
+}
+
+bool cpu_affinity::preferLocalMemory(int node)
+{
+    constexpr size_t bitsPerWord = sizeof(unsigned long) * 8;
+    unsigned long    mask[4] {};
+
+    if (node < 0 || static_cast< size_t >(node) >= sizeof(mask) * 8) return false;
+
+    mask[node / bitsPerWord] |= 1UL << (node % bitsPerWord);
+
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, sizeof(mask) * 8) != 0)
+    {
+        LOG_WARN("Can't set memory policy for node", node, std::strerror(errno));
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,35 @@
+#ifndef CPUAFFINITY_H
+#define CPUAFFINITY_H
+#include <string>
+#include <vector>
+
+/**
+ * @brief Привязка потоков к ядрам и узлам NUMA
+ */
+namespace cpu_affinity
+{
+    /**
+     * @brief Разбирает список ядер в формате "0-3,8,10-11"
+     * @return Пустой вектор если строка некорректна или номер ядра не меньше CPU_SETSIZE
+     */
+    std::vector< int > parseCpuList(const std::string& list);
+
+    /**
+     * @brief Привязывает текущий поток к указанному ядру
+     */
+    bool pinCurrentThread(int cpu);
+
+    /**
+     * @brief Возвращает номер узла NUMA которому принадлежит ядро, 0 если узлы не обнаружены
+     */
+    int nodeOfCpu(int cpu);
+
+    /**
+     * @brief Заставляет ядро выделять страницы для текущего потока на указанном узле NUMA,
+     * буферы которые поток затронет первым окажутся в локальной памяти
+     */
+    bool preferLocalMemory(int node);
+
+};  // namespace cpu_affinity
+
+#endif  // CPUAFFINITY_H
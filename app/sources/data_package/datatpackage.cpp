@@ -122,6 +122,12 @@ void DatatPackage::setData(const std::vector< uint8_t > &data, int size)
     }
 }
 
+void DatatPackage::setData(const uint8_t *data, size_t size)
+{
+    data_.assign(data, data + size);
+    dataSize_ = toBytes< std::array< uint8_t, 2 > >(( uint16_t )size);
+}
+
 void DatatPackage::replacePackage(DatatPackage &&pkg)
 {
     packageCommand_ = std::move(pkg.packageCommand_);
@@ -141,7 +147,7 @@ void DatatPackage::replacePackage(const std::vector< uint8_t > &data)
 
     auto offset = startPos + 4;
     auto size   = dataSizeFromHeader();
-    data_.insert(data_.begin(), data.begin() + offset, data.begin() + offset + size);
+    data_.assign(data.begin() + offset, data.begin() + offset + size);
 
     crc_.at(0) = *(data.begin() + size + offset);
     crc_.at(1) = *(data.begin() + size + offset + 1);
@@ -247,6 +253,25 @@ int DatatPackage::fillHeader(const std::vector< uint8_t > &data)
     return startPos;
 }
 
+void DatatPackage::frameParts(COMMAND cmd, const uint8_t *data, uint16_t size, std::array< uint8_t, 4 > &header,
+                              std::array< uint8_t, 4 > &crc)
+{
+    header = { 0xAA, static_cast< uint8_t >(cmd), static_cast< uint8_t >(size >> 8), static_cast< uint8_t >(size & 0xFF) };
+
+    uint32_t sum = crc32::update(table_.data(), 0, header.data(), header.size());
+    sum          = crc32::update(table_.data(), sum, data, size);
+
+    crc.at(0) = (sum >> 24) & 0xFF;
+    crc.at(1) = (sum >> 16) & 0xFF;
+    crc.at(2) = (sum >> 8) & 0xFF;
+    crc.at(3) = sum & 0xFF;
+}
+
+uint32_t DatatPackage::checksum(const uint8_t *data, size_t size, uint32_t initial)
+{
+    return crc32::update(table_.data(), initial, data, size);
+}
+
 void DatatPackage::calcCrc32(std::array< uint8_t, 4 > &result)
 {
     // BE
@@ -70,14 +70,18 @@ T fromBytes(Container value)
 enum class COMMAND
 {
     EMPTY_CMD       = 0,
-    REQUEST_TO_SEND = 1,       ///< Запрос на отправку данных (Клиент -> Сервер)
-    REQUEST_TO_SEND_APPROVED,  ///< Сервер готов к приёму данных (Сервер -> Клиент)
-    REQUEST_TO_SEND_REJECT,    ///< Cервер не может принять данные  (Сервер -> Клиент)
-    MUST_BE_TRANSMMITTED,      ///< Cколько пакетов будет передано (Клиент-Сервер)
-    PACKAGE_ACCPTED,           ///< Пакет принят и обработан  (Сервер -> Клиент)
-    ALL_DATA_SENDED,           ///< Все пакеты переданы, можно завершать общение (Клиент-Сервер)
-    DATA_PACKAGE,              ///< Пакет с данными
-    CHECKSUM_ERROR,            ///< Ошибка контрольной суммы пакета, необходимо переслать пакет
+    REQUEST_TO_SEND = 1,          ///< Запрос на отправку данных (Клиент -> Сервер)
+    REQUEST_TO_SEND_APPROVED,     ///< Сервер готов к приёму данных (Сервер -> Клиент)
+    REQUEST_TO_SEND_REJECT,       ///< Cервер не может принять данные или отдать файл (Сервер -> Клиент)
+    MUST_BE_TRANSMMITTED,         ///< Cколько пакетов будет передано (Клиент-Сервер)
+    PACKAGE_ACCPTED,              ///< Пакет принят и обработан  (Сервер -> Клиент)
+    ALL_DATA_SENDED,              ///< Все пакеты переданы, можно завершать общение (Клиент-Сервер)
+    DATA_PACKAGE,                 ///< Пакет с данными
+    CHECKSUM_ERROR,               ///< Ошибка контрольной суммы пакета, необходимо переслать пакет
+    BLOCK_DIGEST,                 ///< Контрольная сумма блока, переданного без пакетов (в обе стороны)
+    FILE_SAVED,                   ///< Ответ на ALL_DATA_SENDED: файл сохранён, в данных его имя или номер объекта (Сервер -> Клиент)
+    REQUEST_TO_RECEIVE,           ///< Запрос на получение сохранённого файла или объекта, целиком или участком (Клиент -> Сервер)
+    REQUEST_TO_RECEIVE_APPROVED,  ///< Сервер отдаёт участок: его размер и размер блока (Сервер -> Клиент)
 
     ABORT   = 244,
     UNKNOWN = 255,
@@ -133,6 +137,11 @@ class DatatPackage
      */
     void setData(const std::vector< uint8_t >& data, int size = -1);
 
+    /**
+     * @brief Копирует size байт из data в массив данных, для последующей отправки
+     */
+    void setData(const uint8_t* data, size_t size);
+
     /**
      * @brief Перемещает вектор байт "как есть" в массив данных, для последующей отправки
      * @param std::vector< uint8_t >&& data массив  байт
@@ -200,6 +209,23 @@ class DatatPackage
      */
     static uint16_t minSize();
 
+    /**
+     * @brief Готовит заголовок и контрольную сумму пакета с данными, лежащими вне пакета.
+     * Так данные можно отправить прямо из отображённого в память файла, не копируя их в data_
+     * @param Команда пакета
+     * @param Данные пакета
+     * @param Размер данных
+     * @param Заголовок: header_, packageCommand_, dataSize_
+     * @param Контрольная сумма (BigEndian)
+     */
+    static void frameParts(COMMAND cmd, const uint8_t* data, uint16_t size, std::array< uint8_t, 4 >& header,
+                           std::array< uint8_t, 4 >& crc);
+
+    /**
+     * @brief Считает crc32 произвольных данных, можно продолжать по частям, передавая предыдущий результат
+     */
+    static uint32_t checksum(const uint8_t* data, size_t size, uint32_t initial = 0);
+
     /**
      * @brief Генерирует обзорную таблицу
      */
@@ -1,23 +1,31 @@
 #include "eventloop.h"
 #include "../logger/logger.h"
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <tuple>
 #include <unistd.h>
 
-EventLoop::EventLoop(uint32_t events, int fd) :
-    fd_ { fd },
-    eventsMask_ { events }
-{
-}
-
 EventLoop::~EventLoop()
 {
-    epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd_, NULL);
-    ::close(epollFd_);
-}
+    for (size_t fd = 0; fd < fds_.size(); fd++)
+    {
+        if (fds_[fd].generation != 0) epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, NULL);
+    }
 
-std::array< uint32_t, 15 > EventLoop::eventsArray_ { EPOLLIN,  EPOLLPRI, EPOLLOUT,   EPOLLRDNORM,    EPOLLRDBAND, EPOLLWRNORM,  EPOLLWRBAND, EPOLLMSG,
-                                                     EPOLLERR, EPOLLHUP, EPOLLRDHUP, EPOLLEXCLUSIVE, EPOLLWAKEUP, EPOLLONESHOT, EPOLLET };
+    if (epollFd_ >= 0)
+    {
+        ::close(epollFd_);
+    }
+
+    if (eventFd_ >= 0)
+    {
+        ::close(eventFd_);
+    }
+}
 
 void EventLoop::start()
 {
@@ -34,9 +42,9 @@ void EventLoop::start()
     running_ = false;
 }
 
-bool EventLoop::initEventPoll()
+bool EventLoop::initEventPoll(Backend backend)
 {
-    epollFd_ = epoll_create(maxEvents_);
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
 
     if (epollFd_ < 0)
     {
@@ -44,49 +52,140 @@ bool EventLoop::initEventPoll()
         return false;
     }
 
-    if (!register_fd())
+    eventFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (eventFd_ < 0)
     {
+        LOG_ERROR("Can't create eventfd", std::strerror(errno));
         return false;
     }
 
+    if (!addFd(eventFd_, EPOLLIN))
+    {
+        return false;
+    }
+
+    bindSlot< &EventLoop::runPosted >(eventFd_, EPOLLIN, this);
+
+    if (backend == Backend::IO_URING)
+    {
+        auto supported = [this]() {
+            for (auto op : { IORING_OP_POLL_ADD, IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_ASYNC_CANCEL, IORING_OP_PROVIDE_BUFFERS })
+            {
+                if (!ring_.supports(op))
+                {
+                    LOG_WARN("io_uring doesn't support opcode", static_cast< int >(op));
+                    return false;
+                }
+            }
+
+            return true;
+        };
+
+        if (ring_.init(ringEntries_) && supported() && ring_.provideBuffers(bufferGroup_, ringBuffers_, ringBufferSize_))
+        {
+            backend_ = Backend::IO_URING;
+
+            // Дескрипторы, оставшиеся в epoll (eventfd и т.п.), будят event loop через multishot poll самого epoll
+            armRing(OP_POLL, epollFd_, 0);
+        }
+        else
+        {
+            LOG_WARN("io_uring is not available, fallback to epoll");
+        }
+    }
+
     return true;
 }
 
-bool EventLoop::bindSlot(uint32_t sig, std::function< EVENT_LOOP_SIGNALS() > func)
+void EventLoop::setMaxEvents(int maxEvents)
 {
-    auto find = slots_.find(sig);
-    if (find == slots_.end())
-    {
-        slots_.insert({ sig, func });
-        return true;
-    }
+    events_.resize(std::max(1, maxEvents));
+}
 
-    return false;
+void EventLoop::setBusyPoll(int spinUs)
+{
+    spinUs_ = std::max(0, spinUs);
 }
 
-bool EventLoop::reBindSlot(uint32_t sig, std::function< EVENT_LOOP_SIGNALS() > func)
+int EventLoop::waitEpoll(int timeout)
 {
-    auto find = slots_.find(sig);
-    if (find != slots_.end())
+    if (spinUs_ == 0 || timeout == 0) return epoll_wait(epollFd_, events_.data(), events_.size(), timeout);
+
+    using namespace std::chrono;
+    auto start    = steady_clock::now();
+    auto deadline = start + microseconds(spinUs_);
+
+    // Ближайший таймер не должен сработать позже из-за опроса
+    if (timeout > 0) deadline = std::min(deadline, start + milliseconds(timeout));
+
+    do
     {
-        slots_[sig] = func;
-        return true;
-    }
+        auto count = epoll_wait(epollFd_, events_.data(), events_.size(), 0);
+        if (count != 0) return count;
+    } while (steady_clock::now() < deadline);
 
-    return false;
+    if (timeout < 0) return epoll_wait(epollFd_, events_.data(), events_.size(), -1);
+
+    auto spent = duration_cast< milliseconds >(steady_clock::now() - start).count();
+    return epoll_wait(epollFd_, events_.data(), events_.size(), std::max< int >(0, timeout - spent));
 }
 
-void EventLoop::breakEventLoop()
+EventLoop::FdEntry* EventLoop::entryOf(int fd)
 {
-    stop_ = true;
+    if (fd < 0 || static_cast< size_t >(fd) >= fds_.size() || fds_[fd].generation == 0) return nullptr;
+    return &fds_[fd];
 }
 
-bool EventLoop::register_fd()
+EventLoop::FdEntry* EventLoop::entryOf(int fd, uint32_t generation)
 {
+    auto entry = entryOf(fd);
+    return (entry && entry->generation == generation) ? entry : nullptr;
+}
+
+bool EventLoop::addFd(int fd, uint32_t events, std::function< void() > onClose, bool viaRing)
+{
+    if (fd < 0)
+    {
+        LOG_ERROR("Invalid file descriptor", fd);
+        return false;
+    }
+
+    if (entryOf(fd))
+    {
+        LOG_ERROR("File descriptor", fd, "already added to event loop");
+        return false;
+    }
+
+    // Поколение 0 означает свободный номер
+    if (++generation_ == 0) ++generation_;
+
+    auto generation = generation_;
+
+    if (static_cast< size_t >(fd) >= fds_.size()) fds_.resize(fd + 1);
+
+    if (viaRing && backend_ == Backend::IO_URING)
+    {
+        int       listening = 0;
+        socklen_t len       = sizeof(listening);
+        getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len);
+
+        auto& entry      = fds_[fd];
+        entry.generation = generation;
+        entry.events     = events;
+        entry.onClose    = std::move(onClose);
+        entry.viaRing    = true;
+        entry.listening  = listening != 0;
+        entry.armed      = !entry.listening || (events & EPOLLIN);
+
+        if (entry.armed) armRing(entry.listening ? OP_ACCEPT : OP_RECV, fd, generation);
+        return true;
+    }
+
     struct epoll_event ev;
-    ev.events  = eventsMask_;
-    ev.data.fd = fd_;
-    auto res   = epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd_, &ev);
+    ev.events   = events;
+    ev.data.u64 = (static_cast< uint64_t >(generation) << 32) | static_cast< uint32_t >(fd);
+    auto res    = epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev);
 
     if (res == -1)
     {
@@ -94,64 +193,744 @@ bool EventLoop::register_fd()
         return false;
     }
 
+    auto& entry      = fds_[fd];
+    entry.generation = generation;
+    entry.events     = events;
+    entry.onClose    = std::move(onClose);
     return true;
 }
 
-bool EventLoop::unregister_fd()
+bool EventLoop::modifyFd(int fd, uint32_t events)
 {
-    auto res = epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd_, NULL);
+    auto entry = entryOf(fd);
+    if (!entry) return false;
 
-    if (res == -1)
+    if (entry->viaRing)
     {
-        LOG_ERROR("Can't remove file descriptor from epoll", std::strerror(errno));
+        if (!entry->listening) return true;
+
+        entry->events = events;
+
+        // Если отмена ещё не завершилась, accept взведётся заново по её завершении
+        if ((events & EPOLLIN) && !entry->armed)
+        {
+            entry->armed = true;
+            armRing(OP_ACCEPT, fd, entry->generation);
+        }
+        else if (!(events & EPOLLIN) && entry->armed)
+        {
+            cancelRing(OP_ACCEPT, fd, entry->generation);
+        }
+
+        return true;
+    }
+
+    if (entry->events == events) return true;
+
+    struct epoll_event ev;
+    ev.events   = events;
+    ev.data.u64 = (static_cast< uint64_t >(entry->generation) << 32) | static_cast< uint32_t >(fd);
+
+    if (epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &ev) == -1)
+    {
+        LOG_ERROR("Can't modify file descriptor events", std::strerror(errno));
         return false;
     }
 
+    entry->events = events;
     return true;
 }
 
-bool EventLoop::processEventLoop()
+void EventLoop::removeFd(int fd)
 {
-    EPOLLIN;
-    struct epoll_event events[maxEvents_];
-    auto               newEventsCount = epoll_wait(epollFd_, events, maxEvents_, timeout_);
-    auto               errmask        = EPOLLERR | EPOLLHUP;
+    auto find = entryOf(fd);
+    if (!find) return;
 
-    if (newEventsCount < 0 && errno == EINTR) return false;
+    auto& entry      = *find;
+    auto  generation = entry.generation;
+    auto  viaRing    = entry.viaRing;
 
-    if (newEventsCount == 0)
+    if (viaRing)
     {
-        // LOG_INFO("Timeout for event loop reached", timeout_, "msec");
-        return true;
+        cancelRing(entry.listening ? OP_ACCEPT : OP_RECV, fd, generation);
+
+        for (auto i = entry.acceptedOffset; i < entry.accepted.size(); i++)
+        {
+            ::close(entry.accepted[i]);
+        }
+    }
+    else if (epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, NULL) == -1)
+    {
+        LOG_ERROR("Can't remove file descriptor from epoll", std::strerror(errno));
+    }
+
+    auto onClose = std::move(entry.onClose);
+    entry        = FdEntry {};
+
+    if (viaRing)
+    {
+        // Пока ядро отправляет данные, сокет закрывать нельзя - обработчик закрытия вызовется по завершении send
+        auto chain = sends_.find((static_cast< uint64_t >(generation) << 32) | static_cast< uint32_t >(fd));
+
+        if (chain != sends_.end() && !chain->second.inFlight.empty())
+        {
+            chain->second.onClose = std::move(onClose);
+            return;
+        }
     }
 
-    for (int i = 0; i < newEventsCount; i++)
+    if (onClose) onClose();
+}
+
+void EventLoop::requeue(int fd, uint32_t events)
+{
+    auto entry = entryOf(fd);
+    if (!entry) return;
+
+    pending_.push_back({ fd, entry->generation, events });
+}
+
+int EventLoop::recv(int fd, uint8_t* data, size_t size)
+{
+    if (backend_ != Backend::IO_URING) return ::recv(fd, data, size, 0);
+
+    auto find = entryOf(fd);
+
+    if (!find || !find->viaRing)
+    {
+        return ::recv(fd, data, size, 0);
+    }
+
+    auto& entry = *find;
+
+    if (entry.rxOffset < entry.rx.size())
+    {
+        auto count = std::min(size, entry.rx.size() - entry.rxOffset);
+        std::copy_n(entry.rx.data() + entry.rxOffset, count, data);
+        entry.rxOffset += count;
+
+        if (entry.rxOffset == entry.rx.size())
+        {
+            entry.rx.clear();
+            entry.rxOffset = 0;
+        }
+
+        // Слот разобрал накопленное - возобновляем приём. Прочитанное начало буфера выбрасываем, чтобы он не рос
+        if (entry.rxPaused && entry.rx.size() - entry.rxOffset <= ringBufferSize_)
+        {
+            entry.rx.erase(entry.rx.begin(), entry.rx.begin() + entry.rxOffset);
+            entry.rxOffset = 0;
+            entry.rxPaused = false;
+
+            // Если отмена ещё не дошла до ядра, recv взведётся заново по её завершении
+            if (!entry.armed && !entry.rxEof && entry.rxError == 0)
+            {
+                entry.armed = true;
+                armRing(OP_RECV, fd, entry.generation);
+            }
+        }
+
+        return static_cast< int >(count);
+    }
+
+    if (entry.rxError != 0)
+    {
+        errno = entry.rxError;
+        return -1;
+    }
+
+    if (entry.rxEof) return 0;
+
+    errno = EAGAIN;
+    return -1;
+}
+
+int EventLoop::accept(int listenFd)
+{
+    auto entry = entryOf(listenFd);
+
+    if (backend_ != Backend::IO_URING || !entry || !entry->viaRing)
+    {
+        return ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    }
+
+    if (entry->acceptedOffset == entry->accepted.size())
+    {
+        errno              = entry->acceptError != 0 ? entry->acceptError : EAGAIN;
+        entry->acceptError = 0;
+        return -1;
+    }
+
+    auto fd = entry->accepted[entry->acceptedOffset++];
+
+    if (entry->acceptedOffset == entry->accepted.size())
+    {
+        entry->accepted.clear();
+        entry->acceptedOffset = 0;
+    }
+
+    return fd;
+}
+
+bool EventLoop::send(int fd, std::vector< uint8_t >&& frame)
+{
+    auto entry = entryOf(fd);
+    if (backend_ != Backend::IO_URING || !entry || !entry->viaRing) return false;
+
+    auto  key   = (static_cast< uint64_t >(entry->generation) << 32) | static_cast< uint32_t >(fd);
+    auto& chain = sends_[key];
+
+    if (chain.failed) return false;
+
+    chain.waiting.push_back(std::move(frame));
+
+    if (chain.inFlight.empty())
+    {
+        startSendChain(key, chain);
+    }
+
+    return !chain.failed;
+}
+
+uint64_t EventLoop::ringTag(RingOp op, uint32_t generation, int fd)
+{
+    return (static_cast< uint64_t >(generation) << 32) | (static_cast< uint64_t >(op) << 24) | (static_cast< uint32_t >(fd) & 0xFFFFFF);
+}
+
+void EventLoop::armRing(RingOp op, int fd, uint32_t generation)
+{
+    auto sqe = ring_.getSqe();
+
+    if (!sqe)
+    {
+        LOG_ERROR("io_uring submission queue is full");
+        return;
+    }
+
+    sqe->fd        = fd;
+    sqe->user_data = ringTag(op, generation, fd);
+
+    switch (op)
+    {
+        case OP_POLL:
+            sqe->opcode        = IORING_OP_POLL_ADD;
+            sqe->poll32_events = EPOLLIN;
+            sqe->len           = IORING_POLL_ADD_MULTI;
+            break;
+
+        case OP_ACCEPT:
+            sqe->opcode       = IORING_OP_ACCEPT;
+            sqe->ioprio       = IORING_ACCEPT_MULTISHOT;
+            sqe->accept_flags = SOCK_CLOEXEC;
+            break;
+
+        case OP_RECV:
+            // Буфер выбирает ядро из группы bufferGroup_ в момент прихода данных
+            sqe->opcode    = IORING_OP_RECV;
+            sqe->ioprio    = IORING_RECV_MULTISHOT;
+            sqe->flags     = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = bufferGroup_;
+            break;
+
+        default:
+            break;
+    }
+}
+
+void EventLoop::cancelRing(RingOp op, int fd, uint32_t generation)
+{
+    // Отменяем по user_data, а не по номеру дескриптора: номер может быть выдан новому сокету раньше,
+    // чем отмена дойдёт до ядра
+    if (auto sqe = ring_.getSqe())
+    {
+        sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+        sqe->addr      = ringTag(op, generation, fd);
+        sqe->user_data = ringTag(OP_CANCEL, generation, fd);
+    }
+}
+
+void EventLoop::startSendChain(uint64_t key, SendChain& chain)
+{
+    auto fd         = static_cast< int >(key & 0xFFFFFFFF);
+    auto generation = static_cast< uint32_t >(key >> 32);
+    auto count      = std::min(chain.waiting.size(), maxChain_);
+
+    // Цепочка не должна разорваться автоматической отправкой очереди посередине
+    if (ring_.sqSpace() < count) ring_.submit();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        chain.inFlight.push_back(std::move(chain.waiting.front()));
+        chain.waiting.pop_front();
+
+        auto& frame = chain.inFlight.back();
+        auto  sqe   = ring_.getSqe();
+
+        if (!sqe)
+        {
+            // Ядро не принимает заявки: уже отправленная часть цепочки завершится, после чего сокет закроется
+            LOG_ERROR("io_uring submission queue is full, drop connection", fd);
+            chain.inFlight.pop_back();
+            chain.failed = true;
+            break;
+        }
+
+        sqe->opcode    = IORING_OP_SEND;
+        sqe->fd        = fd;
+        sqe->addr      = reinterpret_cast< uint64_t >(frame.data());
+        sqe->len       = frame.size();
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        sqe->user_data = ringTag(OP_SEND, generation, fd);
+
+        // Связанные send выполняются строго по очереди, следующий - только после успешного предыдущего
+        if (i + 1 < count) sqe->flags = IOSQE_IO_LINK;
+    }
+}
+
+void EventLoop::markReady(int fd, FdEntry& entry)
+{
+    if (entry.ready) return;
+
+    entry.ready = true;
+    ready_.push_back({ fd, entry.generation });
+}
+
+bool EventLoop::handleCqe(const io_uring_cqe& cqe)
+{
+    auto fd         = static_cast< int >(cqe.user_data & 0xFFFFFF);
+    auto op         = static_cast< RingOp >((cqe.user_data >> 24) & 0xFF);
+    auto generation = static_cast< uint32_t >(cqe.user_data >> 32);
+    auto more       = static_cast< bool >(cqe.flags & IORING_CQE_F_MORE);
+    auto entry      = entryOf(fd, generation);
+
+    switch (op)
     {
-        auto event { events[i] };
+        case OP_POLL:
+        {
+            if (!more) armRing(OP_POLL, epollFd_, 0);
 
-        if (event.events & errmask)
+            auto count = epoll_wait(epollFd_, events_.data(), events_.size(), 0);
+            if (count < 0) return errno == EINTR;
+            return dispatchEpoll(count);
+        }
+
+        case OP_RECV:
         {
-            LOG_ERROR("Detected error, exit");
-            return false;
+            auto hasBuffer = static_cast< bool >(cqe.flags & IORING_CQE_F_BUFFER);
+            auto bufferId  = static_cast< uint16_t >(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+
+            if (entry && hasBuffer && cqe.res > 0)
+            {
+                auto data = ring_.buffer(bufferId);
+                entry->rx.insert(entry->rx.end(), data, data + cqe.res);
+            }
+
+            // Данные скопированы, буфер сразу возвращаем ядру
+            if (hasBuffer) ring_.recycleBuffer(bufferId);
+
+            if (!entry) return true;
+
+            if (cqe.res == 0)
+            {
+                entry->rxEof = true;
+            }
+            else if (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED)
+            {
+                entry->rxError = -cqe.res;
+            }
+
+            if (!more) entry->armed = false;
+
+            // Слот не успевает забирать данные: останавливаем приём, иначе rx растёт без ограничений,
+            // а окно TCP остаётся открытым. recv() взведёт его снова, когда данные будут разобраны
+            if (!entry->rxPaused && entry->rx.size() - entry->rxOffset > rxLimit_)
+            {
+                entry->rxPaused = true;
+                if (entry->armed) cancelRing(OP_RECV, fd, generation);
+            }
+
+            // Multishot recv завершается при нехватке буферов, его нужно взвести заново
+            if (!entry->armed && !entry->rxPaused && !entry->rxEof && entry->rxError == 0)
+            {
+                entry->armed = true;
+                armRing(OP_RECV, fd, generation);
+            }
+
+            if (cqe.res != -ENOBUFS && cqe.res != -ECANCELED) markReady(fd, *entry);
+            return true;
         }
 
-        for (const auto& eventVal : eventsArray_)
+        case OP_ACCEPT:
         {
-            if (!static_cast< bool >(eventVal & event.events)) continue;
+            if (!entry)
+            {
+                if (cqe.res >= 0) ::close(cqe.res);
+                return true;
+            }
 
-            auto findSlot = slots_.find(eventVal);
+            if (cqe.res >= 0)
+            {
+                entry->accepted.push_back(cqe.res);
+                markReady(fd, *entry);
+            }
+            else if (cqe.res == -EMFILE || cqe.res == -ENFILE)
+            {
+                // Повторять accept бесполезно, пока не освободятся дескрипторы: ошибку отдаём слоту, а он решает,
+                // когда принимать снова
+                entry->acceptError = -cqe.res;
+                markReady(fd, *entry);
+            }
+            else if (cqe.res != -ECANCELED)
+            {
+                LOG_WARN("Accept failed", std::strerror(-cqe.res));
+            }
+
+            if (!more) entry->armed = false;
+
+            if (!entry->armed && (entry->events & EPOLLIN) && entry->acceptError == 0)
+            {
+                entry->armed = true;
+                armRing(OP_ACCEPT, fd, generation);
+            }
+
+            return true;
+        }
 
-            if (findSlot != slots_.end())
+        case OP_SEND:
+        {
+            auto key   = (static_cast< uint64_t >(generation) << 32) | static_cast< uint32_t >(fd);
+            auto chain = sends_.find(key);
+            if (chain == sends_.end() || chain->second.inFlight.empty()) return true;
+
+            auto& state = chain->second;
+            auto  size  = state.inFlight.front().size();
+            state.inFlight.pop_front();
+
+            if (cqe.res < 0 || static_cast< size_t >(cqe.res) != size)
+            {
+                if (!state.failed && cqe.res != -ECANCELED) LOG_ERROR("Send failed on fd", fd, std::strerror(-cqe.res));
+                state.failed = true;
+            }
+
+            if (!state.inFlight.empty()) return true;
+
+            if (!state.failed && !state.waiting.empty())
+            {
+                startSendChain(key, state);
+                return true;
+            }
+
+            auto onClose = std::move(state.onClose);
+            auto failed  = state.failed;
+            sends_.erase(chain);
+
+            if (onClose)
             {
-                auto returnSatus = findSlot->second();
-                if (returnSatus == EVENT_LOOP_SIGNALS::SIG_EXIT) return false;
+                onClose();
             }
-            else
+            else if (failed && entry)
             {
-                // LOG_WARN("Recived signal", eventVal, "but slot not found");
+                return dispatch(fd, generation, EPOLLERR);
             }
+
+            return true;
         }
+
+        default:
+            return true;
+    }
+}
+
+bool EventLoop::processRing()
+{
+    auto timeout = (pending_.empty() && !epollBacklog_) ? timers_.nextTimeoutMs(timeout_) : 0;
+
+    if (spinUs_ > 0 && timeout != 0)
+    {
+        // Завершения появляются в кольце без системного вызова, так что опрос - это просто чтение хвоста очереди
+        using namespace std::chrono;
+        auto start = steady_clock::now();
+        auto until = std::min(start + microseconds(spinUs_), start + milliseconds(timeout));
+
+        ring_.submit();
+        while (!ring_.hasCompletions() && steady_clock::now() < until) {}
+
+        auto spent = duration_cast< milliseconds >(steady_clock::now() - start).count();
+        timeout    = ring_.hasCompletions() ? 0 : std::max< int >(0, timeout - spent);
+    }
+
+    auto res = ring_.submitAndWait(timeout);
+
+    timers_.advance(nowMs());
+
+    if (res < 0)
+    {
+        LOG_ERROR("io_uring_enter failed", std::strerror(-res));
+        return false;
+    }
+
+    again_.swap(pending_);
+
+    if (epollBacklog_)
+    {
+        epollBacklog_ = false;
+        auto count    = epoll_wait(epollFd_, events_.data(), events_.size(), 0);
+        if (count > 0 && !dispatchEpoll(count)) return false;
+    }
+
+    ring_.reapCqes(cqes_);
+
+    for (const auto& cqe : cqes_)
+    {
+        if (!handleCqe(cqe)) return false;
+    }
+
+    // Слоты чтения вызываются один раз на пачку завершений, сколько бы кусков данных ни пришло
+    readyNow_.swap(ready_);
+
+    for (const auto& [fd, generation] : readyNow_)
+    {
+        auto entry = entryOf(fd, generation);
+        if (!entry) continue;
+
+        entry->ready = false;
+        if (!dispatch(fd, generation, EPOLLIN)) return false;
+    }
+
+    readyNow_.clear();
+
+    for (const auto& pending : again_)
+    {
+        if (!dispatch(pending.fd, pending.generation, pending.events)) return false;
+    }
+
+    again_.clear();
+    return true;
+}
+
+namespace
+{
+    EVENT_LOOP_SIGNALS callSlot(void* ctx)
+    {
+        return (*static_cast< EventLoop::Slot* >(ctx))();
     }
+}  // namespace
+
+bool EventLoop::bindSlot(int fd, uint32_t sig, Slot func)
+{
+    auto slot = std::make_unique< Slot >(std::move(func));
+    auto ctx  = slot.get();
+    return bindHandler(fd, sig, { callSlot, ctx, std::move(slot) }, false);
+}
+
+bool EventLoop::reBindSlot(int fd, uint32_t sig, Slot func)
+{
+    auto slot = std::make_unique< Slot >(std::move(func));
+    auto ctx  = slot.get();
+    return bindHandler(fd, sig, { callSlot, ctx, std::move(slot) }, true);
+}
+
+bool EventLoop::bindHandler(int fd, uint32_t sig, Handler handler, bool replace)
+{
+    auto entry = entryOf(fd);
+    if (!entry) return false;
+
+    // Слот назначается на одно событие
+    if (sig == 0 || (sig & (sig - 1)) != 0) return false;
+
+    auto isBound = static_cast< bool >(entry->bound & sig);
+    if (isBound != replace) return false;
+
+    auto index = __builtin_popcount(entry->bound & (sig - 1));
+
+    if (replace)
+    {
+        entry->handlers[index] = std::move(handler);
+    }
+    else
+    {
+        entry->handlers.insert(entry->handlers.begin() + index, std::move(handler));
+    }
+
+    entry->bound |= sig;
+    return true;
+}
+
+void EventLoop::breakEventLoop()
+{
+    stop_ = true;
+    wakeUp();
+}
+
+void EventLoop::post(Task task)
+{
+    if (hasOverflow_ || !inbox_.tryPush(task))
+    {
+        std::lock_guard< std::mutex > lock(overflowMutex_);
+        overflow_.push_back(std::move(task));
+        hasOverflow_ = true;
+    }
+
+    wakeUp();
+}
+
+void EventLoop::wakeUp()
+{
+    // Пока event loop не разобрал предыдущее пробуждение, писать в eventfd повторно незачем
+    if (wakePending_.exchange(true)) return;
+
+    uint64_t one = 1;
+    std::ignore  = ::write(eventFd_, &one, sizeof(one));
+}
+
+EVENT_LOOP_SIGNALS EventLoop::runPosted()
+{
+    uint64_t counter;
+    std::ignore = ::read(eventFd_, &counter, sizeof(counter));
+
+    // Сбрасываем флаг до разбора очереди: задача, поставленная после этого, разбудит event loop заново
+    wakePending_ = false;
+
+    Task task;
+    for (int i = 0; i < postedBudget_ && inbox_.tryPop(task); i++)
+    {
+        task();
+    }
+
+    if (hasOverflow_ && inbox_.sizeApprox() == 0)
+    {
+        std::deque< Task > overflow;
+        {
+            std::lock_guard< std::mutex > lock(overflowMutex_);
+            overflow.swap(overflow_);
+            hasOverflow_ = false;
+        }
+
+        for (auto& posted : overflow)
+        {
+            posted();
+        }
+    }
+
+    // Остаток разберём на следующей итерации, чтобы не задерживать события сокетов
+    if (inbox_.sizeApprox() > 0 || hasOverflow_) return EVENT_LOOP_SIGNALS::SIG_AGAIN;
+
+    return EVENT_LOOP_SIGNALS::SIG_NONE;
+}
+
+TimerWheel::TimerId EventLoop::scheduleTimer(uint64_t delayMs, Task callback)
+{
+    // Колесо продвигается сразу после epoll_wait, так что его время отстаёт от текущего
+    // не больше чем на время обработки одной пачки событий
+    return timers_.schedule(delayMs, std::move(callback));
+}
+
+bool EventLoop::cancelTimer(TimerWheel::TimerId id)
+{
+    return timers_.cancel(id);
+}
+
+uint64_t EventLoop::nowMs()
+{
+    using namespace std::chrono;
+    return duration_cast< milliseconds >(steady_clock::now().time_since_epoch()).count();
+}
+
+bool EventLoop::processEventLoop()
+{
+    if (backend_ == Backend::IO_URING) return processRing();
+
+    // Пока есть недообработанные слоты, epoll только опрашивается, чтобы не уснуть с непрочитанными данными.
+    // Иначе спим до ближайшего таймера
+    auto timeout        = pending_.empty() ? timers_.nextTimeoutMs(timeout_) : 0;
+    auto newEventsCount = waitEpoll(timeout);
+
+    // Таймеры обрабатываются до событий: так время колеса отстаёт от текущего только на время работы слотов
+    timers_.advance(nowMs());
+
+    if (newEventsCount < 0 && errno == EINTR) return true;
+
+    if (newEventsCount < 0)
+    {
+        LOG_ERROR("epoll_wait failed", std::strerror(errno));
+        return false;
+    }
+
+    // Слоты, отложенные на прошлой итерации, вызываются после новых событий, так что одно загруженное соединение
+    // не может занять весь event loop
+    again_.swap(pending_);
+
+    if (!dispatchEpoll(newEventsCount)) return false;
+
+    for (const auto& pending : again_)
+    {
+        if (!dispatch(pending.fd, pending.generation, pending.events)) return false;
+    }
+
+    again_.clear();
+    return true;
+}
+
+bool EventLoop::dispatchEpoll(int count)
+{
+    // Буфер заполнен целиком - в epoll могли остаться события, в режиме io_uring их нужно забрать без ожидания
+    if (count == static_cast< int >(events_.size())) epollBacklog_ = true;
+
+    for (int i = 0; i < count; i++)
+    {
+        auto event { events_[i] };
+        int  fd         = static_cast< int >(event.data.u64 & 0xFFFFFFFF);
+        auto generation = static_cast< uint32_t >(event.data.u64 >> 32);
+
+        if (!dispatch(fd, generation, event.events)) return false;
+    }
+
+    return true;
+}
+
+bool EventLoop::dispatch(int fd, uint32_t generation, uint32_t events)
+{
+    auto errmask = EPOLLERR | EPOLLHUP;
+    auto entry   = entryOf(fd, generation);
+
+    // Дескриптор уже убран (или номер выдан новому соединению) обработчиком предыдущего события из этой пачки
+    if (!entry) return true;
+
+    auto signal = EVENT_LOOP_SIGNALS::SIG_NONE;
+
+    // Обходим только взведённые биты, на которые есть слот, плюс ошибки; порядок - по возрастанию номера бита,
+    // так что EPOLLIN и EPOLLOUT обрабатываются раньше EPOLLERR и EPOLLHUP
+    for (auto mask = events & (entry->bound | errmask); mask != 0; mask &= mask - 1)
+    {
+        auto bit      = __builtin_ctz(mask);
+        auto eventVal = 1u << bit;
+
+        // Слот мог убрать дескриптор или добавить новые, так что массив перестроился: ищем состояние заново
+        entry = entryOf(fd, generation);
+        if (!entry) return true;
+
+        if (entry->bound & eventVal)
+        {
+            signal = entry->handlers[__builtin_popcount(entry->bound & (eventVal - 1))]();
+        }
+        else
+        {
+            LOG_ERROR("Detected error on fd", fd, ", close it");
+            signal = EVENT_LOOP_SIGNALS::SIG_CLOSE;
+        }
+
+        if (signal == EVENT_LOOP_SIGNALS::SIG_AGAIN)
+        {
+            pending_.push_back({ fd, generation, eventVal });
+            signal = EVENT_LOOP_SIGNALS::SIG_NONE;
+        }
+
+        if (signal != EVENT_LOOP_SIGNALS::SIG_NONE) break;
+    }
+
+    if (signal == EVENT_LOOP_SIGNALS::SIG_EXIT) return false;
 
+    // Слот мог сам убрать дескриптор, а его номер - достаться новому
+    if (signal == EVENT_LOOP_SIGNALS::SIG_CLOSE && entryOf(fd, generation)) removeFd(fd);
     return true;
 }
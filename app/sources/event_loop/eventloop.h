@@ -1,44 +1,332 @@
 #ifndef EVENTLOOP_H
 #define EVENTLOOP_H
 #include <atomic>
+#include <cstdint>
+#include <deque>
 #include <functional>
-#include <map>
+#include <memory>
+#include <mutex>
+#include <sys/epoll.h>
+#include <unordered_map>
+#include <vector>
+
+#include "../io_uring/iouring.h"
+#include "../thread_pool/taskqueue.h"
+#include "../timer_wheel/timerwheel.h"
 
 enum EVENT_LOOP_SIGNALS
 {
     SIG_NONE = 0,
-    SIG_EXIT,
+    SIG_EXIT,   ///< Остановить event loop
+    SIG_CLOSE,  ///< Убрать файловый дескриптор из event loop и вызвать его обработчик закрытия
+    SIG_AGAIN,  ///< Обработчик исчерпал свой бюджет, вызвать его снова на следующей итерации не дожидаясь нового события
 };
 
+/**
+ * @brief Обёртка над epoll, обслуживает произвольное количество файловых дескрипторов.
+ * На каждый дескриптор и каждый флаг события можно назначить свой слот.
+ * Состояние дескрипторов лежит в массиве, индекс в котором - номер дескриптора: ядро выдаёт наименьшие свободные номера,
+ * так что массив плотный. Слоты дескриптора хранятся только для назначенных событий, по возрастанию номера бита.
+ *
+ * Вместо epoll можно выбрать io_uring: тогда сокеты, добавленные с viaRing, читаются multishot recv
+ * (или multishot accept для слушающих сокетов) в предоставленные ядру буферы, а запись идёт через send().
+ * Слот EPOLLIN вызывается, когда данные уже приняты, и забирает их через recv()/accept() event loop'а.
+ * Остальные дескрипторы по-прежнему живут в epoll, а сам epoll опрашивается через io_uring
+ */
 class EventLoop
 {
   public:
-    EventLoop(uint32_t events, int fd);
+    using Slot = std::function< EVENT_LOOP_SIGNALS() >;
+
+    enum class Backend
+    {
+        EPOLL,
+        IO_URING,
+    };
+
+    EventLoop() = default;
     ~EventLoop();
 
+    EventLoop(const EventLoop&)            = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
     void start();
-    bool initEventPoll();
 
-    bool bindSlot(uint32_t sig, std::function< EVENT_LOOP_SIGNALS() > func);
-    bool reBindSlot(uint32_t sig, std::function< EVENT_LOOP_SIGNALS() > func);
+    /**
+     * @brief Создаёт epoll и eventfd, через который другие потоки будят event loop
+     * @param Желаемый backend, если io_uring недоступен - используется epoll
+     */
+    bool initEventPoll(Backend backend = Backend::EPOLL);
+
+    Backend backend() const { return backend_; }
+
+    /**
+     * @brief Сколько событий забирать за один вызов epoll_wait
+     */
+    void setMaxEvents(int maxEvents);
+
+    /**
+     * @brief Режим низкой задержки: прежде чем заснуть в epoll_wait (или io_uring_enter), event loop
+     * столько мкс опрашивает готовые события без ожидания. Экономит пробуждение потока ценой загрузки ядра
+     * @param Интервал опроса в мкс, 0 - не опрашивать
+     */
+    void setBusyPoll(int spinUs);
+
+    /**
+     * @brief Добавляет дескриптор в epoll
+     * @param Файловый дескриптор
+     * @param Маска событий epoll
+     * @param Вызывается после того, как дескриптор убран из event loop (по SIG_CLOSE, ошибке или removeFd)
+     * @param Для backend'а io_uring: читать сокет через кольцо. Маска событий при этом используется только для
+     * слушающего сокета: multishot accept взведён, пока в ней есть EPOLLIN
+     */
+    bool addFd(int fd, uint32_t events, std::function< void() > onClose = {}, bool viaRing = false);
+
+    /**
+     * @brief Меняет маску событий уже добавленного дескриптора (EPOLL_CTL_MOD).
+     * Для слушающего сокета в io_uring снимает или заново взводит multishot accept
+     */
+    bool modifyFd(int fd, uint32_t events);
+
+    /**
+     * @brief Убирает дескриптор из epoll, удаляет его слоты и вызывает обработчик закрытия.
+     * Если через io_uring ещё отправляются данные дескриптора, обработчик закрытия вызывается после их отправки
+     */
+    void removeFd(int fd);
+
+    /**
+     * @brief Читает из сокета: для epoll - recv, для io_uring - уже принятые кольцом данные
+     * @return Количество байт, 0 если соединение закрыто, -1 с errno (EAGAIN - данных пока нет)
+     */
+    int recv(int fd, uint8_t* data, size_t size);
+
+    /**
+     * @brief Принимает подключение: для epoll - accept4 (сокет сразу неблокирующий), для io_uring - из уже принятых multishot accept.
+     * В io_uring после EMFILE/ENFILE multishot accept не взводится, пока modifyFd не вернёт слушающему сокету EPOLLIN
+     * @return Дескриптор нового сокета или -1 с errno (EAGAIN - подключений пока нет)
+     */
+    int accept(int listenFd);
+
+    /**
+     * @brief Отправляет кадр через io_uring. Кадры одного сокета уходят по порядку цепочками связанных send
+     * @return false если дескриптор не добавлен с viaRing или backend не io_uring
+     */
+    bool send(int fd, std::vector< uint8_t >&& frame);
+
+    bool bindSlot(int fd, uint32_t sig, Slot func);
+    bool reBindSlot(int fd, uint32_t sig, Slot func);
+
+    /**
+     * @brief Вызывает слоты дескриптора на следующей итерации, как если бы слот вернул SIG_AGAIN.
+     * Нужно, когда обработку приостановили и новых событий от ядра может уже не быть
+     */
+    void requeue(int fd, uint32_t events);
+
+    /**
+     * @brief Ставит таймер, обработчик будет вызван в потоке event loop. Вызывать только из потока event loop
+     * @param Задержка в мс
+     * @param Обработчик
+     * @return Идентификатор для cancelTimer
+     */
+    TimerWheel::TimerId scheduleTimer(uint64_t delayMs, Task callback);
+
+    /**
+     * @brief Отменяет таймер, вызывать только из потока event loop
+     */
+    bool cancelTimer(TimerWheel::TimerId id);
+
+    /**
+     * @brief Монотонное время в мс, по которому отсчитываются таймеры
+     */
+    static uint64_t nowMs();
+
+    /**
+     * @brief Назначает слотом метод объекта. В отличие от std::function вызов идёт через обычный указатель на функцию,
+     * внутри которой вызов метода известен на этапе компиляции и может быть встроен
+     * @param Файловый дескриптор
+     * @param Флаг события (ровно один бит)
+     * @param Объект, метод которого будет вызываться, должен жить пока дескриптор в event loop
+     */
+    template< auto Method, typename T >
+    bool bindSlot(int fd, uint32_t sig, T* obj)
+    {
+        return bindHandler(fd, sig, { [](void* ctx) { return (static_cast< T* >(ctx)->*Method)(); }, obj, {} }, false);
+    }
+
+    /**
+     * @brief Останавливает event loop, можно вызывать из любого потока: спящий epoll_wait будится сразу
+     */
     void breakEventLoop();
 
+    /**
+     * @brief Передаёт задачу на выполнение в поток event loop, можно вызывать из любого потока.
+     * Задачи, поставленные одним потоком, выполняются в порядке постановки
+     */
+    void post(Task task);
+
   private:
-    bool register_fd();
-    bool unregister_fd();
+    /**
+     * @brief Обработчик одного события: указатель на функцию с контекстом.
+     * Слот std::function лежит в куче и вызывается через тот же указатель, так что его адрес не меняется,
+     * пока массивы слотов и дескрипторов перестраиваются во время его вызова
+     */
+    struct Handler
+    {
+        EVENT_LOOP_SIGNALS (*call)(void*) { nullptr };
+        void*                   ctx { nullptr };
+        std::unique_ptr< Slot > func;  ///< Владеет слотом std::function, ctx указывает на него
+
+        EVENT_LOOP_SIGNALS operator()() const { return call(ctx); }
+    };
+
+    struct FdEntry
+    {
+        uint32_t                generation { 0 };  ///< Отличает повторно выданный ядром номер дескриптора от старого, 0 - номер свободен
+        uint32_t                events { 0 };      ///< Текущая маска событий
+        uint32_t                bound { 0 };       ///< Маска событий, на которые назначены слоты
+        std::vector< Handler >  handlers;          ///< Слот события (1 << i) лежит под номером popcount(bound & ((1 << i) - 1))
+        std::function< void() > onClose;
+
+        // Состояние дескриптора, который обслуживается через io_uring
+        bool                   viaRing { false };
+        bool                   listening { false };  ///< Слушающий сокет: multishot accept вместо recv
+        bool                   ready { false };      ///< Уже стоит в очереди на вызов слота EPOLLIN
+        bool                   rxEof { false };
+        bool                   armed { false };     ///< В ядре есть живой multishot recv или accept
+        bool                   rxPaused { false };  ///< Приём остановлен: слот не успевает забирать данные
+        int                    rxError { 0 };
+        size_t                 rxOffset { 0 };
+        std::vector< uint8_t > rx;  ///< Принятые кольцом, но ещё не прочитанные слотом данные
+        int                    acceptError { 0 };  ///< EMFILE/ENFILE от multishot accept, ещё не отданная слоту
+        size_t                 acceptedOffset { 0 };
+        std::vector< int >     accepted;
+    };
+
+    /**
+     * @brief Кадры одного сокета, отправляемые через io_uring.
+     * Живёт отдельно от FdEntry: буферы нужны ядру до завершения send, даже если дескриптор уже убран
+     */
+    struct SendChain
+    {
+        std::deque< std::vector< uint8_t > > inFlight;  ///< Отправлены ядру одной цепочкой
+        std::deque< std::vector< uint8_t > > waiting;   ///< Ждут завершения текущей цепочки
+        bool                                 failed { false };
+        std::function< void() >              onClose;   ///< Отложенный обработчик закрытия
+    };
+
+    /**
+     * @brief Тип операции io_uring, хранится в user_data вместе с дескриптором и его поколением
+     */
+    enum RingOp : uint8_t
+    {
+        OP_POLL = 1,
+        OP_RECV,
+        OP_ACCEPT,
+        OP_SEND,
+        OP_CANCEL,
+    };
+
+    /**
+     * @brief Слот, вернувший SIG_AGAIN и ожидающий повторного вызова
+     */
+    struct Pending
+    {
+        int      fd;
+        uint32_t generation;
+        uint32_t events;
+    };
+
     bool processEventLoop();
 
+    /**
+     * @brief Состояние дескриптора или nullptr, если он не добавлен.
+     * Указатель действителен до вызова следующего слота: слот может добавить дескриптор, и массив перестроится
+     */
+    FdEntry* entryOf(int fd);
+
+    /**
+     * @brief То же, но только если номер не выдан с тех пор новому дескриптору
+     */
+    FdEntry* entryOf(int fd, uint32_t generation);
+
+    /**
+     * @brief Итерация event loop для backend'а io_uring
+     */
+    bool processRing();
+
+    /**
+     * @brief epoll_wait, которому предшествует опрос без ожидания в течение spinUs_
+     */
+    int waitEpoll(int timeout);
+
+    /**
+     * @brief Вызывает слоты для первых count событий из events_
+     */
+    bool dispatchEpoll(int count);
+
+    static uint64_t ringTag(RingOp op, uint32_t generation, int fd);
+    void            armRing(RingOp op, int fd, uint32_t generation);
+    void            cancelRing(RingOp op, int fd, uint32_t generation);
+    bool            handleCqe(const io_uring_cqe& cqe);
+    void            startSendChain(uint64_t key, SendChain& chain);
+    void            markReady(int fd, FdEntry& entry);
+
+    /**
+     * @brief Вызывает слоты дескриптора для каждого флага из маски событий
+     * @return false если слот запросил остановку event loop
+     */
+    bool dispatch(int fd, uint32_t generation, uint32_t events);
+
+    /**
+     * @brief Сохраняет обработчик события
+     * @param Заменить существующий обработчик (true) или назначить новый (false)
+     */
+    bool bindHandler(int fd, uint32_t sig, Handler handler, bool replace);
+
+    /**
+     * @brief Будит event loop записью в eventfd, если он ещё не разбужен
+     */
+    void wakeUp();
+
+    /**
+     * @brief Слот eventfd: выполняет задачи, переданные через post
+     */
+    EVENT_LOOP_SIGNALS runPosted();
+
   private:
-    int                                           fd_ { -1 };
-    int                                           epollFd_ { -1 };
-    uint32_t                                      eventsMask_ { 0 };
-    std::atomic_bool                              stop_ { false };
-    std::atomic_bool                              running_ { false };
-    std::map< uint32_t, std::function< EVENT_LOOP_SIGNALS() > > slots_;
-    inline static int                             maxEvents_ { 10 };
-    inline static int                             timeout_ { 5000 };
-
-    static std::array< uint32_t, 15 > eventsArray_;
+    int                                epollFd_ { -1 };
+    uint32_t                           generation_ { 0 };
+    std::atomic_bool                   stop_ { false };
+    std::atomic_bool                   running_ { false };
+    std::vector< FdEntry >             fds_;  ///< Индекс - номер дескриптора
+    std::vector< epoll_event >         events_ = std::vector< epoll_event >(64);  ///< Буфер для epoll_wait
+    std::vector< Pending >             pending_;  ///< Слоты, вернувшие SIG_AGAIN на текущей итерации
+    std::vector< Pending >             again_;    ///< Слоты, отложенные на прошлой итерации
+    TimerWheel                         timers_ { nowMs() };
+    int                                eventFd_ { -1 };
+    std::atomic_bool                   wakePending_ { false };  ///< В eventfd уже записано, повторная запись не нужна
+    TaskQueue                          inbox_ { 4096 };         ///< Задачи от других потоков
+    std::mutex                         overflowMutex_;
+    std::deque< Task >                 overflow_;               ///< Задачи, не поместившиеся в inbox_
+    std::atomic_bool                   hasOverflow_ { false };  ///< Пока overflow_ не пуст, новые задачи идут туда же
+    inline static const int            postedBudget_ { 256 };   ///< Сколько задач выполняется за одно пробуждение
+    inline static int                  timeout_ { 5000 };
+    int                                spinUs_ { 0 };  ///< Сколько мкс опрашивать события перед сном
+
+    Backend                                   backend_ { Backend::EPOLL };
+    bool                                      epollBacklog_ { false };  ///< В epoll могли остаться события сверх events_
+    std::vector< io_uring_cqe >               cqes_;
+    std::vector< std::pair< int, uint32_t > > ready_;   ///< Дескрипторы с принятыми кольцом данными и их поколения
+    std::vector< std::pair< int, uint32_t > > readyNow_;
+    std::unordered_map< uint64_t, SendChain > sends_;   ///< Ключ - поколение << 32 | дескриптор
+    IoUring                                   ring_;    ///< Объявлен последним: закрывается раньше, чем освобождаются буферы send
+
+    inline static const unsigned ringEntries_ { 256 };
+    inline static const uint16_t bufferGroup_ { 0 };
+    inline static const uint16_t ringBuffers_ { 512 };              ///< Количество буферов для multishot recv
+    inline static const uint32_t ringBufferSize_ { 16384 };         ///< Размер одного буфера
+    inline static const size_t   maxChain_ { 16 };                  ///< Сколько send связывается в одну цепочку
+    inline static const size_t   rxLimit_ { 4 * ringBufferSize_ };  ///< Сколько непрочитанных данных держать до остановки recv
 };
 
 #endif  // EVENTLOOP_H
@@ -30,7 +30,7 @@ uint64_t helpers::getFreeDiskSpace(const std::string &path)
     struct statvfs buf;
     if (-1 != statvfs(path.c_str(), &buf))
     {
-        return (( int )((buf.f_bsize * ( double )buf.f_bavail)));
+        return static_cast< uint64_t >(buf.f_frsize) * buf.f_bavail;
     }
 
     return 0;
@@ -46,9 +46,10 @@ std::string helpers::pathToExec()
 {
     std::array< char, 256 > buff;
     ssize_t                 len = ::readlink("/proc/self/exe", buff.data(), buff.max_size());
+    // readlink не дописывает завершающий ноль
     if (len != -1)
     {
-        return std::string(buff.data());
+        return std::string(buff.data(), len);
     }
 
     return "";
@@ -0,0 +1,338 @@
+#include "iouring.h"
+#include "../logger/logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+namespace
+{
+    int sysSetup(unsigned entries, io_uring_params* p)
+    {
+        return static_cast< int >(syscall(__NR_io_uring_setup, entries, p));
+    }
+
+    int sysEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argSize)
+    {
+        return static_cast< int >(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+    }
+
+    int sysRegister(int fd, unsigned opcode, void* arg, unsigned nrArgs)
+    {
+        return static_cast< int >(syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+    }
+
+    template< typename T >
+    T loadAcquire(const T* p)
+    {
+        return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+    }
+
+    template< typename T >
+    void storeRelease(T* p, T value)
+    {
+        __atomic_store_n(p, value, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * @brief Multishot recv появился в 6.0, проверить его наличие через probe нельзя
+     */
+    bool kernelAtLeast(int major, int minor)
+    {
+        struct utsname name;
+        if (uname(&name) != 0) return false;
+
+        int kMajor = 0, kMinor = 0;
+        if (std::sscanf(name.release, "%d.%d", &kMajor, &kMinor) != 2) return false;
+        return kMajor > major || (kMajor == major && kMinor >= minor);
+    }
+}  // namespace
+
+IoUring::~IoUring()
+{
+    close();
+}
+
+bool IoUring::init(unsigned entries)
+{
+    if (!kernelAtLeast(6, 0))
+    {
+        LOG_WARN("io_uring multishot recv requires linux 6.0+");
+        return false;
+    }
+
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    // Multishot операции порождают много завершений на одну заявку, поэтому очередь завершений берём с запасом
+    params.flags      = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    params.cq_entries = entries * 8;
+
+    ringFd_ = sysSetup(entries, &params);
+
+    if (ringFd_ < 0)
+    {
+        LOG_WARN("io_uring_setup failed:", std::strerror(errno));
+        ringFd_ = -1;
+        return false;
+    }
+
+    auto required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+
+    if ((params.features & required) != required)
+    {
+        LOG_WARN("io_uring lacks required features");
+        close();
+        return false;
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    sqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+
+    if (sqRing_ == MAP_FAILED)
+    {
+        sqRing_ = nullptr;
+        close();
+        return false;
+    }
+
+    // С IORING_FEAT_SINGLE_MMAP оба кольца лежат в одном отображении
+    cqRing_     = sqRing_;
+    cqRingSize_ = 0;
+
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    auto sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+
+    if (sqes == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+
+    sqes_ = static_cast< io_uring_sqe* >(sqes);
+
+    auto sq    = static_cast< uint8_t* >(sqRing_);
+    sqHead_    = reinterpret_cast< unsigned* >(sq + params.sq_off.head);
+    sqTail_    = reinterpret_cast< unsigned* >(sq + params.sq_off.tail);
+    sqArray_   = reinterpret_cast< unsigned* >(sq + params.sq_off.array);
+    sqMask_    = *reinterpret_cast< unsigned* >(sq + params.sq_off.ring_mask);
+    sqEntries_ = params.sq_entries;
+
+    auto cq = static_cast< uint8_t* >(cqRing_);
+    cqHead_ = reinterpret_cast< unsigned* >(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast< unsigned* >(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast< unsigned* >(cq + params.cq_off.ring_mask);
+    cqes_   = reinterpret_cast< io_uring_cqe* >(cq + params.cq_off.cqes);
+
+    sqLocalTail_ = *sqTail_;
+
+    // Запоминаем, какие операции знает ядро
+    std::vector< uint8_t > probeMem(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+    auto                   probe = reinterpret_cast< io_uring_probe* >(probeMem.data());
+
+    if (sysRegister(ringFd_, IORING_REGISTER_PROBE, probe, 256) < 0)
+    {
+        LOG_WARN("io_uring probe failed:", std::strerror(errno));
+        close();
+        return false;
+    }
+
+    for (unsigned op = 0; op <= probe->last_op && op < supported_.size(); op++)
+    {
+        supported_[op] = probe->ops[op].flags & IO_URING_OP_SUPPORTED;
+    }
+
+    return true;
+}
+
+unsigned IoUring::sqSpace() const
+{
+    return sqEntries_ - (sqLocalTail_ - loadAcquire(sqHead_));
+}
+
+io_uring_sqe* IoUring::getSqe()
+{
+    if (sqLocalTail_ - loadAcquire(sqHead_) >= sqEntries_)
+    {
+        submit();
+
+        if (sqLocalTail_ - loadAcquire(sqHead_) >= sqEntries_) return nullptr;
+    }
+
+    auto index      = sqLocalTail_ & sqMask_;
+    auto sqe        = &sqes_[index];
+    sqArray_[index] = index;
+    sqLocalTail_++;
+    toSubmit_++;
+
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int IoUring::submit()
+{
+    storeRelease(sqTail_, sqLocalTail_);
+
+    auto count = toSubmit_;
+    toSubmit_  = 0;
+
+    if (count == 0) return 0;
+
+    auto res = sysEnter(ringFd_, count, 0, 0, nullptr, 0);
+    return res < 0 ? -errno : res;
+}
+
+int IoUring::submitAndWait(int timeoutMs)
+{
+    storeRelease(sqTail_, sqLocalTail_);
+
+    auto count = toSubmit_;
+    toSubmit_  = 0;
+
+    // Готовые завершения уже есть - ждать незачем
+    auto wait = timeoutMs != 0 && loadAcquire(cqTail_) == *cqHead_;
+
+    if (!wait && count == 0) return 0;
+
+    __kernel_timespec      ts {};
+    io_uring_getevents_arg arg {};
+    unsigned               flags = 0;
+
+    if (wait)
+    {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+
+        if (timeoutMs > 0)
+        {
+            ts.tv_sec  = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+            arg.ts     = reinterpret_cast< uint64_t >(&ts);
+        }
+    }
+
+    auto res = sysEnter(ringFd_, count, wait ? 1 : 0, flags, wait ? &arg : nullptr, wait ? sizeof(arg) : 0);
+
+    // ETIME - истёк таймаут ожидания, это не ошибка
+    if (res < 0 && (errno == ETIME || errno == EINTR)) return 0;
+    return res < 0 ? -errno : res;
+}
+
+bool IoUring::hasCompletions() const
+{
+    return loadAcquire(cqTail_) != *cqHead_;
+}
+
+unsigned IoUring::reapCqes(std::vector< io_uring_cqe >& out)
+{
+    auto head = *cqHead_;
+    auto tail = loadAcquire(cqTail_);
+
+    out.clear();
+
+    for (; head != tail; head++)
+    {
+        out.push_back(cqes_[head & cqMask_]);
+    }
+
+    storeRelease(cqHead_, head);
+    return out.size();
+}
+
+bool IoUring::provideBuffers(uint16_t groupId, uint16_t count, uint32_t size)
+{
+    groupId_    = groupId;
+    bufferSize_ = size;
+    buffers_.resize(size_t(count) * size);
+
+    auto sqe = getSqe();
+    if (!sqe) return false;
+
+    sqe->opcode    = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd        = count;
+    sqe->addr      = reinterpret_cast< uint64_t >(buffers_.data());
+    sqe->len       = size;
+    sqe->buf_group = groupId;
+    sqe->off       = 0;
+
+    // Дожидаемся результата, чтобы первый recv уже нашёл буферы
+    auto res = submitAndWait(-1);
+    if (res < 0) return false;
+
+    std::vector< io_uring_cqe > cqes;
+    reapCqes(cqes);
+
+    if (cqes.empty() || cqes.front().res < 0)
+    {
+        LOG_WARN("Can't provide buffers to io_uring:", cqes.empty() ? "no completion" : std::strerror(-cqes.front().res));
+        return false;
+    }
+
+    return true;
+}
+
+bool IoUring::registerBuffers(uint8_t* base, unsigned count, size_t size)
+{
+    std::vector< iovec > iovecs(count);
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        iovecs[i].iov_base = base + size_t(i) * size;
+        iovecs[i].iov_len  = size;
+    }
+
+    if (sysRegister(ringFd_, IORING_REGISTER_BUFFERS, iovecs.data(), count) < 0)
+    {
+        LOG_WARN("Can't register io_uring buffers:", std::strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+bool IoUring::registerEventFd(int eventFd)
+{
+    if (sysRegister(ringFd_, IORING_REGISTER_EVENTFD, &eventFd, 1) < 0)
+    {
+        LOG_WARN("Can't register eventfd in io_uring:", std::strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+void IoUring::recycleBuffer(uint16_t bufferId)
+{
+    auto sqe = getSqe();
+    if (!sqe) return;
+
+    sqe->opcode    = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd        = 1;
+    sqe->addr      = reinterpret_cast< uint64_t >(buffers_.data() + size_t(bufferId) * bufferSize_);
+    sqe->len       = bufferSize_;
+    sqe->buf_group = groupId_;
+    sqe->off       = bufferId;
+    sqe->flags     = IOSQE_CQE_SKIP_SUCCESS;
+}
+
+void IoUring::close()
+{
+    if (sqes_) munmap(sqes_, sqesSize_);
+    if (sqRing_) munmap(sqRing_, sqRingSize_);
+    if (ringFd_ >= 0) ::close(ringFd_);
+
+    supported_.fill(false);
+
+    sqes_   = nullptr;
+    sqRing_ = nullptr;
+    cqRing_ = nullptr;
+    ringFd_ = -1;
+}
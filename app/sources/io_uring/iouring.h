@@ -0,0 +1,137 @@
+#ifndef IOURING_H
+#define IOURING_H
+
+#include <cstddef>
+#include <array>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <vector>
+
+/**
+ * @brief Минимальная обёртка над io_uring на системных вызовах (без liburing): кольца SQ/CQ
+ * и одна группа предоставленных ядру буферов (provided buffers) для multishot recv.
+ * Не потокобезопасна, предназначена для одного event loop
+ */
+class IoUring
+{
+  public:
+    IoUring() = default;
+    ~IoUring();
+
+    IoUring(const IoUring&)            = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    /**
+     * @brief Создаёт кольцо и проверяет, что ядро поддерживает multishot операции и ожидание с таймаутом.
+     * Поддержку конкретных операций проверяет вызывающий через supports()
+     * @param Размер очереди отправки
+     * @return false если io_uring недоступен, объект при этом остаётся пустым
+     */
+    bool init(unsigned entries);
+
+    bool isOpen() const { return ringFd_ >= 0; }
+
+    /**
+     * @brief Знает ли ядро операцию IORING_OP_*
+     */
+    bool supports(uint8_t opcode) const { return supported_[opcode]; }
+
+    /**
+     * @brief Возвращает обнулённый SQE, при заполненной очереди сначала отправляет её ядру
+     */
+    io_uring_sqe* getSqe();
+
+    /**
+     * @brief Сколько SQE ещё можно получить, не отправляя очередь ядру
+     */
+    unsigned sqSpace() const;
+
+    /**
+     * @brief Отправляет накопленные SQE и ждёт хотя бы одно завершение, если завершений ещё нет
+     * @param Таймаут ожидания в мс, 0 - не ждать, -1 - ждать бесконечно
+     * @return Количество отправленных SQE или -errno
+     */
+    int submitAndWait(int timeoutMs);
+
+    /**
+     * @brief Отправляет накопленные SQE не дожидаясь завершений
+     */
+    int submit();
+
+    /**
+     * @brief Есть ли в очереди завершения, которые ещё не забраны
+     */
+    bool hasCompletions() const;
+
+    /**
+     * @brief Забирает готовые завершения
+     * @param Куда копировать
+     * @return Количество забранных CQE
+     */
+    unsigned reapCqes(std::vector< io_uring_cqe >& out);
+
+    /**
+     * @brief Отдаёт ядру группу буферов для recv с IOSQE_BUFFER_SELECT (IORING_OP_PROVIDE_BUFFERS).
+     * Кольца буферов (IORING_REGISTER_PBUF_RING) не используются: на части ядер они регистрируются,
+     * но recv из них всегда завершается с ENOBUFS
+     * @param Идентификатор группы
+     * @param Количество буферов
+     * @param Размер одного буфера
+     */
+    bool provideBuffers(uint16_t groupId, uint16_t count, uint32_t size);
+
+    /**
+     * @brief Регистрирует непрерывную область памяти как count буферов по size байт для IORING_OP_WRITE_FIXED,
+     * индекс буфера в SQE (buf_index) - номер куска. Ядро один раз закрепляет страницы и не делает этого на каждую запись
+     */
+    bool registerBuffers(uint8_t* base, unsigned count, size_t size);
+
+    /**
+     * @brief Ядро будет писать в eventfd на каждое завершение, так завершения можно ждать через epoll
+     */
+    bool registerEventFd(int eventFd);
+
+    /**
+     * @brief Адрес буфера, выбранного ядром для завершения
+     */
+    const uint8_t* buffer(uint16_t bufferId) const { return buffers_.data() + size_t(bufferId) * bufferSize_; }
+
+    /**
+     * @brief Возвращает буфер ядру после того, как данные из него забраны.
+     * Ставит SQE без завершения (IOSQE_CQE_SKIP_SUCCESS), уходит ядру со следующей отправкой очереди
+     */
+    void recycleBuffer(uint16_t bufferId);
+
+  private:
+    void close();
+
+  private:
+    int                      ringFd_ { -1 };
+    std::array< bool, 256 >  supported_ {};  ///< Индекс - код операции IORING_OP_*
+
+    void*         sqRing_ { nullptr };
+    void*         cqRing_ { nullptr };
+    size_t        sqRingSize_ { 0 };
+    size_t        cqRingSize_ { 0 };
+    io_uring_sqe* sqes_ { nullptr };
+    size_t        sqesSize_ { 0 };
+
+    unsigned* sqHead_ { nullptr };
+    unsigned* sqTail_ { nullptr };
+    unsigned* sqArray_ { nullptr };
+    unsigned  sqMask_ { 0 };
+    unsigned  sqEntries_ { 0 };
+    unsigned  sqLocalTail_ { 0 };  ///< Хвост с учётом SQE, ещё не опубликованных для ядра
+    unsigned  toSubmit_ { 0 };
+
+    unsigned*     cqHead_ { nullptr };
+    unsigned*     cqTail_ { nullptr };
+    unsigned      cqMask_ { 0 };
+    io_uring_cqe* cqes_ { nullptr };
+
+    uint16_t               groupId_ { 0 };
+    uint32_t               bufferSize_ { 0 };
+    std::vector< uint8_t > buffers_;
+};
+
+#endif  // IOURING_H
@@ -1,10 +1,33 @@
 #include "mainobject.h"
 
 #include "../client/client.h"
+#include "../cpu_affinity/cpuaffinity.h"
 #include "../helpers/helpers.h"
 #include "../server/server.h"
 
+#include <charconv>
+#include <climits>
 #include <iostream>
+#include <optional>
+
+namespace
+{
+    /**
+     * @brief Разбирает десятичное число без знака. std::stoi на слишком длинном числе бросает исключение,
+     * которое здесь некому поймать
+     * @return Пусто если в строке не только цифры, она пустая или число не помещается в T
+     */
+    template< typename T >
+    std::optional< T > parseNumber(const std::string& str)
+    {
+        T    value {};
+        auto end    = str.data() + str.size();
+        auto [p, e] = std::from_chars(str.data(), end, value);
+
+        if (str.empty() || str[0] == '-' || e != std::errc() || p != end) return std::nullopt;
+        return value;
+    }
+}  // namespace
 
 MainObject::MainObject(int argc, char** argv)
 {
@@ -12,9 +35,8 @@ MainObject::MainObject(int argc, char** argv)
 
     for (int i = 0; i < argc; ++i)
     {
-        auto current_arg  = [&argv, &i]() { return std::string(argv[i]); };
-        auto hasNextArg   = [&i, &argc]() -> bool { return ((i + 1) < argc); };
-        auto isOnlyDigits = [](const std::string& str) { return str.find_first_not_of("0123456789") == std::string::npos; };
+        auto current_arg = [&argv, &i]() { return std::string(argv[i]); };
+        auto hasNextArg  = [&i, &argc]() -> bool { return ((i + 1) < argc); };
         if (argc == 1)
         {
             std::cout << "You need to supply one or more argument to this program" << std::endl;
@@ -44,6 +66,51 @@ MainObject::MainObject(int argc, char** argv)
             continue;
         }
 
+        if (current_arg() == "-g")
+        {
+            isClient_ = true;
+            if (hasNextArg())
+            {
+                i++;
+                download_ = current_arg();
+            }
+            else
+            {
+                std::cout << "Client download must be passed with file name or object id" << std::endl;
+                std::cout << usage_ << std::endl;
+            }
+            continue;
+        }
+
+        if (current_arg() == "--out" && hasNextArg())
+        {
+            i++;
+            outPath_ = current_arg();
+            continue;
+        }
+
+        if (current_arg() == "--range" && hasNextArg())
+        {
+            i++;
+            auto range = current_arg();
+            auto colon = range.find(':');
+            auto first = range.substr(0, colon);
+            auto len   = colon == std::string::npos ? std::string("0") : range.substr(colon + 1);
+
+            auto offset = parseNumber< uint64_t >(first);
+            auto length = parseNumber< uint64_t >(len);
+
+            if (!offset || !length)
+            {
+                std::cout << "Range must be offset:length in bytes, fallback to whole file" << std::endl;
+                continue;
+            }
+
+            rangeOffset_ = *offset;
+            rangeLength_ = *length;
+            continue;
+        }
+
         if (current_arg() == "-s")
         {
             isServer_ = true;
@@ -53,13 +120,140 @@ MainObject::MainObject(int argc, char** argv)
         if (current_arg() == "-p" && hasNextArg())
         {
             i++;
-            if (!isOnlyDigits(current_arg()))
+            auto port = parseNumber< uint16_t >(current_arg());
+
+            if (!port)
             {
-                std::cout << "Port must contain only digits, fallback to default port" << std::endl;
+                std::cout << "Port must be a number up to 65535, fallback to default port" << std::endl;
                 continue;
             }
 
-            port_ = std::stoi(current_arg());
+            port_ = *port;
+            continue;
+        }
+
+        if ((current_arg() == "--worker-cpus" || current_arg() == "--loop-cpus") && hasNextArg())
+        {
+            auto& cpus = (current_arg() == "--worker-cpus") ? serverConfig_.workerCpus : serverConfig_.loopCpus;
+            i++;
+            cpus = cpu_affinity::parseCpuList(current_arg());
+
+            if (cpus.empty())
+            {
+                std::cout << "Wrong cpu list " << current_arg() << ", threads will not be pinned" << std::endl;
+            }
+            continue;
+        }
+
+        if (current_arg() == "--storage-root" && hasNextArg())
+        {
+            i++;
+            serverConfig_.storageRoots.push_back(current_arg());
+            continue;
+        }
+
+        if (current_arg() == "--cache-policy" && hasNextArg())
+        {
+            i++;
+
+            if (current_arg() == "keep") serverConfig_.cachePolicy = CachePolicy::KEEP;
+            else if (current_arg() == "writeback") serverConfig_.cachePolicy = CachePolicy::WRITEBACK;
+            else if (current_arg() == "drop") serverConfig_.cachePolicy = CachePolicy::DROP;
+            else std::cout << "Unknown cache policy " << current_arg() << ", fallback to keep" << std::endl;
+            continue;
+        }
+
+        if (current_arg() == "--durability" && hasNextArg())
+        {
+            i++;
+
+            if (current_arg() == "none") serverConfig_.durability = Durability::NONE;
+            else if (current_arg() == "complete") serverConfig_.durability = Durability::ON_COMPLETE;
+            else if (current_arg() == "periodic") serverConfig_.durability = Durability::PERIODIC;
+            else std::cout << "Unknown durability " << current_arg() << ", fallback to none" << std::endl;
+            continue;
+        }
+
+        if ((current_arg() == "--backlog" || current_arg() == "--reactors" || current_arg() == "--max-events" ||
+             current_arg() == "--io-budget" || current_arg() == "--idle-timeout" || current_arg() == "--handshake-timeout" ||
+             current_arg() == "--busy-poll" || current_arg() == "--accept-batch" || current_arg() == "--writers" ||
+             current_arg() == "--sync-interval" || current_arg() == "--dirty-limit" || current_arg() == "--root-depth" ||
+             current_arg() == "--small-object") &&
+            hasNextArg())
+        {
+            auto name = current_arg();
+            i++;
+            auto number = parseNumber< int >(current_arg());
+
+            if (!number)
+            {
+                std::cout << name << " must be a number up to " << INT_MAX << ", fallback to default" << std::endl;
+                continue;
+            }
+
+            auto value = *number;
+            if (name == "--backlog") serverConfig_.backlog = value;
+            if (name == "--reactors") serverConfig_.reactors = std::max(1, value);
+            if (name == "--max-events") serverConfig_.maxEvents = std::max(1, value);
+            if (name == "--io-budget") serverConfig_.ioBudget = std::max(1, value);
+            if (name == "--idle-timeout") serverConfig_.idleTimeoutMs = value;
+            if (name == "--handshake-timeout") serverConfig_.handshakeTimeoutMs = value;
+            if (name == "--busy-poll") serverConfig_.busyPollUs = value;
+            if (name == "--accept-batch") serverConfig_.acceptBatch = std::max(1, value);
+            if (name == "--writers") serverConfig_.writerThreads = std::max(1, value);
+            if (name == "--sync-interval") serverConfig_.syncIntervalMs = std::max(1, value);
+            if (name == "--root-depth") serverConfig_.rootDepth = value;
+            if (name == "--small-object") serverConfig_.smallObjectLimit = value;
+            if (name == "--dirty-limit") serverConfig_.dirtyLimit = uint64_t(std::max(1, value)) * 1024 * 1024;
+            continue;
+        }
+
+        if (current_arg() == "--rx-affinity")
+        {
+            serverConfig_.followRxCpu = true;
+            continue;
+        }
+
+        if (current_arg() == "--edge-triggered")
+        {
+            serverConfig_.edgeTriggered = true;
+            continue;
+        }
+
+        if (current_arg() == "--io-uring")
+        {
+            serverConfig_.ioUring = true;
+            continue;
+        }
+
+        if (current_arg() == "--async-write")
+        {
+            serverConfig_.asyncWrite = true;
+            continue;
+        }
+
+        if (current_arg() == "--write-behind")
+        {
+            serverConfig_.writeBehind = true;
+            continue;
+        }
+
+        if (current_arg() == "--segment-store")
+        {
+            serverConfig_.segmentStore = true;
+            continue;
+        }
+
+        if (current_arg() == "--splice")
+        {
+            serverConfig_.splice = true;
+            splice_              = true;
+            continue;
+        }
+
+        if (current_arg() == "--zero-copy")
+        {
+            zeroCopy_ = true;
             continue;
         }
     }
@@ -76,12 +270,15 @@ int MainObject::start()
 {
     if (isServer_)
     {
-        Server serv(port_);
+        serverConfig_.port = port_;
+        Server serv(serverConfig_);
         return serv.start();
     }
     else if (isClient_)
     {
-        Client client("127.0.0.1", port_);
+        Client client("127.0.0.1", port_, zeroCopy_, splice_);
+
+        if (!download_.empty()) return client.receiveFile(download_, outPath_, rangeOffset_, rangeLength_);
 
 
         // auto th1 = std::thread(
@@ -1,5 +1,6 @@
 #ifndef MAINOBJECT_H
 #define MAINOBJECT_H
+#include "../server/serverconfig.h"
 #include <string>
 
 class MainObject
@@ -18,7 +19,14 @@ class MainObject
     bool              isServer_ = false;
     bool              isClient_ = false;
     int               port_     = 7071;
+    bool              zeroCopy_ = false;
+    bool              splice_   = false;
     std::string       filepath_ {};
+    std::string       download_ {};  ///< Имя файла или номер объекта, который клиент получает с сервера
+    std::string       outPath_ {};
+    uint64_t          rangeOffset_ { 0 };
+    uint64_t          rangeLength_ { 0 };
+    ServerConfig      serverConfig_ {};
     const std::string usage_ =
         R"(
        Usage:
@@ -27,6 +35,8 @@ class MainObject
         type args:
             -s Start server for reciving application, additional_arg ignored
             -c Start client for sending data, additional arg required
+            -g name|id - Start client for receiving a file the server saved,
+                   by the name or object id it reported after the upload
 
         [additional_arg]
             /path/to/file - The path to the file to be sent.
@@ -34,6 +44,59 @@ class MainObject
         [optional_args]
             -p port - The number of the port that the server will open or to
                    which the client will be connected
+            --worker-cpus list - Pin storage writer threads to cpus, e.g. 0-3,8
+            --loop-cpus list - Pin server event loop threads to cpus
+            --backlog n - Length of the queue of pending connections
+            --accept-batch n - Connections accepted per wakeup before the
+                   reactor returns to serving established ones
+            --reactors n - Number of server event loop threads, each one
+                   serves many connections
+            --rx-affinity - Hand a connection to the reactor on the cpu that
+                   receives its packets
+            --edge-triggered - Register connections with EPOLLET and drain
+                   sockets until EAGAIN
+            --max-events n - Number of events taken by one epoll_wait call
+            --io-budget n - Packets a connection may handle per wakeup before
+                   yielding to the others
+            --idle-timeout ms - Close connections that send nothing for ms
+                   milliseconds, 0 disables
+            --handshake-timeout ms - Close connections that don't request a
+                   transfer within ms milliseconds, 0 disables
+            --io-uring - Serve connections through io_uring (linux 6.0+),
+                   falls back to epoll when it is unavailable
+            --async-write - Write received files through io_uring without
+                   blocking the event loop
+            --write-behind - Acknowledge packages once they are buffered and
+                   write files in large O_DIRECT blocks from writer threads
+            --writers n - Writer threads per disk for --write-behind
+            --durability mode - When the server confirms that a file is saved:
+                   none (default), complete (after fdatasync of the file),
+                   periodic (after the next batch sync)
+            --sync-interval ms - Batch sync period for --durability periodic
+            --storage-root dir - Directory for received files, repeat for
+                   several disks. Uploads go to the root with the most free
+                   space per running upload. Default: the binary's directory
+            --root-depth n - Uploads a storage root takes at once, 0 - no limit
+            --segment-store - Append small uploads as objects to large segment
+                   files instead of creating a file per upload
+            --small-object bytes - Largest upload stored as an object, 65536
+                   by default
+            --cache-policy mode - Page cache handling for received files: keep
+                   (default), writeback (start writeback early, bound dirty
+                   bytes per session), drop (writeback and evict written pages)
+            --dirty-limit MiB - Dirty bytes a session may hold with
+                   --cache-policy writeback or drop, 16 by default
+            --busy-poll us - Low latency mode: spin for us microseconds before
+                   sleeping, busy poll sockets and disable Nagle
+            --splice - Transfer file data in raw blocks that the server moves
+                   from the socket to the file with splice (both sides must
+                   pass it, not available with --io-uring)
+            --zero-copy - Client sends file data straight from a memory
+                   mapping without copying it into packages
+            --range offset:length - Receive only length bytes starting at
+                   offset with -g, length 0 - up to the end of the file
+            --out path - Where -g saves the file, by default its name in the
+                   current directory
          )";
 };
 
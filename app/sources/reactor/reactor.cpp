@@ -0,0 +1,214 @@
+#include "reactor.h"
+#include "../cpu_affinity/cpuaffinity.h"
+#include "../logger/logger.h"
+#include "../storage/directstorage.h"
+#include "../storage/syncstorage.h"
+#include "../storage/uringstorage.h"
+
+#include <cstring>
+#include <sys/epoll.h>
+
+Reactor::Reactor(const ServerConfig &config, size_t index, StorageRoots &roots, GroupCommit *commit, SegmentStore *segments) :
+    config_ { config },
+    index_ { index },
+    roots_ { roots },
+    commit_ { commit },
+    segments_ { segments }
+{
+    if (!config_.loopCpus.empty())
+    {
+        cpu_ = config_.loopCpus[index_ % config_.loopCpus.size()];
+    }
+}
+
+bool Reactor::open()
+{
+    listener_ = std::make_shared< Socket >("0.0.0.0", config_.port);
+    listener_->setMaximumConnectionsHandle(config_.backlog);
+
+    if (!listener_->reusePort())
+    {
+        return false;
+    }
+
+    // Ядро будет отдавать этому реактору подключения, чьи пакеты обрабатываются на его же ядре
+    if (config_.followRxCpu && cpu_ >= 0)
+    {
+        listener_->setIncomingCpu(cpu_);
+    }
+
+    if (!listener_->open())
+    {
+        LOG_ERROR("Can't start server at localhost", config_.port);
+        return false;
+    }
+
+    if (!loop_.initEventPoll(config_.ioUring ? EventLoop::Backend::IO_URING : EventLoop::Backend::EPOLL))
+    {
+        return false;
+    }
+
+    ring_ = loop_.backend() == EventLoop::Backend::IO_URING;
+
+    // Multishot accept в io_uring сам ждёт подключений, неблокирующий режим нужен только для epoll:
+    // там подключения забираются accept4 до EAGAIN
+    if (!ring_) listener_->nonBlockingMode();
+
+    loop_.setMaxEvents(config_.maxEvents);
+    loop_.setBusyPoll(config_.busyPollUs);
+
+    if (config_.writeBehind)
+    {
+        storage_ = std::make_unique< DirectStorage >(loop_, roots_);
+    }
+    else if (config_.asyncWrite)
+    {
+        auto storage = std::make_unique< UringStorage >(loop_);
+
+        if (storage->init())
+        {
+            storage_ = std::move(storage);
+        }
+        else
+        {
+            LOG_WARN("Async file writes are not available, fallback to synchronous writes");
+        }
+    }
+
+    if (!storage_) storage_ = std::make_unique< SyncStorage >();
+
+    if (!loop_.addFd(listener_->getFd(), listenEvents_, {}, ring_))
+    {
+        return false;
+    }
+
+    loop_.bindSlot< &Reactor::acceptNewConnection >(listener_->getFd(), EPOLLIN, this);
+    return true;
+}
+
+void Reactor::run()
+{
+    if (cpu_ >= 0 && cpu_affinity::pinCurrentThread(cpu_))
+    {
+        cpu_affinity::preferLocalMemory(cpu_affinity::nodeOfCpu(cpu_));
+    }
+
+    LOG_INFO("Reactor", index_, "listening 0.0.0.0:", config_.port, ring_ ? "(io_uring)" : "(epoll)");
+    loop_.start();
+    LOG_INFO("Reactor", index_, "stopped,", connections_.size(), "connections dropped");
+}
+
+void Reactor::stop()
+{
+    loop_.breakEventLoop();
+}
+
+EVENT_LOOP_SIGNALS Reactor::acceptNewConnection()
+{
+    // Сначала только забираем сокеты из очереди ядра: после массового переподключения клиентов
+    // очередь освобождается быстрее, чем если бы каждое соединение сразу настраивалось
+    accepted_.clear();
+    auto budget = static_cast< size_t >(std::max(1, config_.acceptBatch));
+
+    while (accepted_.size() < budget)
+    {
+        auto fd = loop_.accept(listener_->getFd());
+
+        if (fd >= 0)
+        {
+            accepted_.push_back(fd);
+            continue;
+        }
+
+        if (errno == EINTR || errno == ECONNABORTED) continue;
+
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            logAcceptError(errno);
+
+            // Подключения останутся в очереди ядра до освобождения дескрипторов
+            if (errno == EMFILE || errno == ENFILE) pauseAccept();
+        }
+
+        break;
+    }
+
+    for (auto fd : accepted_)
+    {
+        serveConnection(std::make_shared< Socket >(fd));
+    }
+
+    if (!accepted_.empty())
+    {
+        LOG_INFO("Reactor", index_, "accepted", accepted_.size(), "connections, serves", connections_.size());
+    }
+
+    // Бюджет исчерпан - в очереди могут остаться подключения, возвращаемся к ним на следующей итерации
+    return accepted_.size() == budget ? EVENT_LOOP_SIGNALS::SIG_AGAIN : EVENT_LOOP_SIGNALS::SIG_NONE;
+}
+
+void Reactor::serveConnection(SocketPtr newSock)
+{
+    // В режиме низкой задержки ответ не должен ждать ни ACK от клиента, ни прерывания сетевой карты
+    if (config_.busyPollUs > 0)
+    {
+        newSock->setNoDelay();
+        newSock->setBusyPoll(config_.busyPollUs);
+    }
+
+    auto fd   = newSock->getFd();
+    auto conn = std::make_unique< Connection >(newSock, config_, *storage_, roots_, commit_, segments_);
+
+    auto onClose = [this, fd]() {
+        connections_.erase(fd);
+        served_.store(connections_.size(), std::memory_order_relaxed);
+
+        // Освободился дескриптор - можно снова принимать подключения
+        if (acceptPaused_) resumeAccept();
+    };
+
+    if (!conn->attach(loop_, std::move(onClose)))
+    {
+        return;
+    }
+
+    connections_.emplace(fd, std::move(conn));
+    served_.store(connections_.size(), std::memory_order_relaxed);
+    acceptedTotal_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Reactor::pauseAccept()
+{
+    if (acceptPaused_) return;
+
+    acceptPaused_ = true;
+    loop_.modifyFd(listener_->getFd(), listenEvents_ & ~EPOLLIN);
+
+    // Дескрипторы могут освободиться не в этом реакторе и не у соединений, так что пробуем снова и по таймеру
+    acceptTimer_ = loop_.scheduleTimer(acceptRetryMs_, [this]() {
+        acceptTimer_ = 0;
+        resumeAccept();
+    });
+}
+
+void Reactor::resumeAccept()
+{
+    if (!acceptPaused_) return;
+
+    acceptPaused_ = false;
+    loop_.cancelTimer(acceptTimer_);
+    acceptTimer_ = 0;
+    loop_.modifyFd(listener_->getFd(), listenEvents_);
+}
+
+void Reactor::logAcceptError(int error)
+{
+    acceptErrors_++;
+
+    auto now = EventLoop::nowMs();
+    if (acceptLoggedMs_ != 0 && now - acceptLoggedMs_ < acceptLogIntervalMs_) return;
+
+    LOG_ERROR("Can't accept connection to server", std::strerror(error), "- repeated", acceptErrors_, "times");
+    acceptLoggedMs_ = now;
+    acceptErrors_   = 0;
+}
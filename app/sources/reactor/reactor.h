@@ -0,0 +1,116 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+#include "../connection/connection.h"
+#include "../event_loop/eventloop.h"
+#include "../server/serverconfig.h"
+#include "../socket/socket.h"
+#include "../storage/filestorage.h"
+#include "../storage/groupcommit.h"
+#include "../storage/segmentstore.h"
+#include "../storage/storageroots.h"
+
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+
+/**
+ * @brief Реактор: один event loop, обслуживающий множество соединений в одном потоке.
+ * У каждого реактора свой слушающий сокет с SO_REUSEPORT на общем порту, ядро само распределяет
+ * новые подключения между реакторами, так что передавать сокеты между потоками не нужно
+ */
+class Reactor
+{
+  public:
+    /**
+     * @param Настройки сервера
+     * @param Порядковый номер реактора, по нему выбирается ядро из ServerConfig::loopCpus
+     * @param Каталоги для принятых файлов, общие для всех реакторов
+     * @param Сброс файлов на диск для ServerConfig::durability, общий для всех реакторов
+     * @param Хранилище мелких загрузок для ServerConfig::segmentStore, общее для всех реакторов
+     */
+    Reactor(const ServerConfig& config, size_t index, StorageRoots& roots, GroupCommit* commit = nullptr, SegmentStore* segments = nullptr);
+
+    Reactor(const Reactor&)            = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    /**
+     * @brief Открывает слушающий сокет и создаёт epoll (или io_uring, если он запрошен и доступен)
+     * @return false в случае ошибки, ошибка будет напечатана в консоль
+     */
+    bool open();
+
+    /**
+     * @brief Крутит event loop в вызывающем потоке до вызова stop()
+     */
+    void run();
+
+    /**
+     * @brief Просит event loop остановиться, можно вызывать из другого потока
+     */
+    void stop();
+
+    /**
+     * @brief Сколько соединений реактор обслуживает сейчас, можно вызывать из другого потока
+     */
+    size_t connections() const { return served_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Сколько соединений реактор принял за всё время, можно вызывать из другого потока
+     */
+    uint64_t acceptedTotal() const { return acceptedTotal_.load(std::memory_order_relaxed); }
+
+  private:
+    /**
+     * @brief Принимает подключения пачкой, пока очередь ядра не опустеет или не кончится бюджет
+     */
+    EVENT_LOOP_SIGNALS acceptNewConnection();
+
+    /**
+     * @brief Создаёт соединение для принятого сокета и добавляет его в event loop
+     */
+    void serveConnection(SocketPtr newSock);
+
+    /**
+     * @brief Кончились дескрипторы (EMFILE/ENFILE): снимает EPOLLIN со слушающего сокета до освобождения дескриптора
+     * или до таймера. Иначе level-triggered слушающий сокет будил бы реактор на каждой итерации
+     */
+    void pauseAccept();
+
+    /**
+     * @brief Возвращает слушающему сокету EPOLLIN
+     */
+    void resumeAccept();
+
+    /**
+     * @brief Печатает ошибку accept не чаще раза в acceptLogIntervalMs_, с числом пропущенных повторов
+     */
+    void logAcceptError(int error);
+
+  private:
+    const ServerConfig&                                       config_;
+    size_t                                                    index_;
+    int                                                       cpu_ { -1 };     ///< Ядро к которому привязан поток реактора
+    StorageRoots&                                             roots_;
+    GroupCommit*                                              commit_;
+    SegmentStore*                                             segments_;
+    bool                                                      ring_ { false };  ///< Event loop работает через io_uring
+    std::vector< int >                                        accepted_;        ///< Пачка принятых за пробуждение сокетов
+    std::atomic< size_t >                                     served_ { 0 };    ///< Размер connections_ для других потоков
+    std::atomic< uint64_t >                                   acceptedTotal_ { 0 };
+    SocketPtr                                                 listener_ = nullptr;
+    bool                                                      acceptPaused_ { false };
+    TimerWheel::TimerId                                       acceptTimer_ { 0 };
+    uint64_t                                                  acceptLoggedMs_ { 0 };  ///< Когда ошибка accept печаталась последний раз
+    size_t                                                    acceptErrors_ { 0 };    ///< Сколько ошибок accept не напечатано
+
+    inline static const uint32_t listenEvents_ { EPOLLIN | EPOLLPRI | EPOLLHUP | EPOLLERR };
+    inline static const uint64_t acceptRetryMs_ { 100 };         ///< Через сколько мс снова принимать подключения после EMFILE
+    inline static const uint64_t acceptLogIntervalMs_ { 1000 };
+
+    // Порядок важен: соединения удаляются раньше хранилища, хранилище - раньше event loop'а
+    EventLoop                                                 loop_;
+    std::unique_ptr< FileStorage >                            storage_;
+    std::unordered_map< int, std::unique_ptr< Connection > > connections_;
+};
+
+#endif  // REACTOR_H
@@ -1,12 +1,14 @@
 #include "server.h"
-#include "../helpers/helpers.h"
 #include "../logger/logger.h"
-#include "../session/session.h"
-#include <cstring>
-#include <sys/epoll.h>
 
-Server::Server(int port) :
-    port_ { port }
+#include <chrono>
+#include <thread>
+
+Server::Server(const ServerConfig &config) :
+    config_ { config },
+    roots_ { config_.storageRoots, config_.rootDepth,
+             config_.writeBehind ? config_.writerThreads : (config_.cachePolicy != CachePolicy::KEEP ? 1 : 0),
+             config_.workerCpus }
 {
     std::signal(SIGINT, SignalHandler::signalHandler);
     std::signal(SIGKILL, SignalHandler::signalHandler);
@@ -19,290 +21,88 @@ Server::~Server()
 {
     SignalHandler::instance().disableAtomic();
 
-    if (masterSocket_)
-    {
-        masterSocket_->close();
-    }
+    // Поток сброса возвращает результаты в event loop'ы реакторов, а реакторы удаляются раньше него:
+    // останавливаем его, пока они живы. Сам GroupCommit удаляется позже - соединения отменяют в нём свои запросы
+    if (commit_) commit_->stop();
 }
 
 int Server::start()
 {
-    if (!openConnection())  // Открываем сокет
+    if (!roots_.init())
     {
         return -1;
     }
 
-    EventLoop lp(EPOLLIN | EPOLLPRI | EPOLLHUP | EPOLLERR, masterSocket_->getFd());
-
-    lp.initEventPoll();
-
-    lp.bindSlot(EPOLLIN,
-                [this]()
-                {
-                    auto sock = acceptNewConnection();
-                    if (!sock) return EVENT_LOOP_SIGNALS::SIG_NONE;
-
-                    createSubEventLoop(sock);
-                    return EVENT_LOOP_SIGNALS::SIG_NONE;
-                });
-    lp.start();
-    return 0;
-}
-
-bool Server::openConnection()
-{
-    auto pSock = new Socket("0.0.0.0", port_);
-    pSock->setMaximumConnectionsHandle(maxEventsConnectionToHandle_);
-
-    if (!pSock->open())
+    if (config_.segmentStore)
     {
-        LOG_ERROR("Can't start server at localhost", port_);
-        return false;
+        // Сегменты лежат в первом каталоге: объекты мелкие, раскладывать их по дискам незачем
+        segments_ = std::make_unique< SegmentStore >(roots_.path(0) + "/segments", config_.smallObjectLimit);
+        if (!segments_->init()) return -1;
     }
 
-    LOG_INFO("Listening 0.0.0.0:", port_);
-    masterSocket_ = std::shared_ptr< Socket >(pSock);
-    masterSocket_->nonBlockingMode();
-    return true;
-}
-
-SocketPtr Server::acceptNewConnection()
-{
-    SocketPtr newSock = masterSocket_->accept();
-
-    if (newSock)
+    if (config_.durability != Durability::NONE)
     {
-        newSock->nonBlockingMode();
-        return newSock;
-    }
-    else
-    {
-        LOG_ERROR("Can't accept connection to server", std::strerror(errno));
-        return nullptr;
+        commit_ = std::make_unique< GroupCommit >(config_.durability, config_.syncIntervalMs);
     }
 
-    return nullptr;
-}
+    for (size_t i = 0; i < config_.reactors; ++i)
+    {
+        auto reactor = std::make_unique< Reactor >(config_, i, roots_, commit_.get(), segments_.get());
 
-void Server::createSubEventLoop(SocketPtr pSock)
-{
-    tp.enqueue(
-        [pSock, this]()
+        if (!reactor->open())  // Открываем слушающий сокет реактора
         {
-            EventLoop      lp(EPOLLIN | EPOLLOUT | EPOLLHUP | EPOLLERR, pSock->getFd());
-            transmit_state st;
-            Session        ss;
-            st.buffer.resize(2048);
-            recivePackage(lp, st, pSock, ss);
-            sendPackage(lp, st, pSock, ss);
-            if (!lp.initEventPoll()) return;
-            lp.start();
-        });
-}
-
-void Server::recivePackage(EventLoop& ev, transmit_state& state, SocketPtr pSock, Session& ss)
-{
-    ev.bindSlot(EPOLLIN,
-                [&state, pSock, &ss]()
-                {
-                    auto recivedDataSize = pSock->read(state.buffer, state.rwChunkSize);
-                    ss.recivedPackageRef().replacePackage(state.buffer);
-                    LOG_INFO("Recived from client:", recivedDataSize, "bytes");
+            return -1;
+        }
 
-                    if (recivedDataSize < 0)  // Ошибка, отвалился клиент (т.к. принятые данные -1)
-                    {
-                        LOG_ERROR("Less than zero data readed, error");
-                        ss.reset();
-                        return EVENT_LOOP_SIGNALS::SIG_EXIT;
-                    }
-
-                    if (recivedDataSize == 0)  // Ошибка, ничего не прочитали от клиента, получается тоже отвалился
-                    {
-                        LOG_ERROR("0 bytes from client socket read, close socket");
-                        ss.reset();
-                        return EVENT_LOOP_SIGNALS::SIG_EXIT;
-                    }
-
-                    if (recivedDataSize < DatatPackage::minSize())  // Ошибка, количество полученных байт меньше минимально допустимого
-                    {
-                        LOG_ERROR("Package smaller than 8 bytes, error");
-                        ss.packageToSendRef().clearData();
-                        ss.packageToSendRef().setCommand(COMMAND::CHECKSUM_ERROR);
-                        ss.packageToSendRef().calcChecksum();
-                        return EVENT_LOOP_SIGNALS::SIG_NONE;
-                    }
-
-                    if (!ss.recivedPackageRef().verifyCheckSum())  // Ошибка контрольной суммы пакета, нужно уведомить клиента
-                    {
-                        LOG_INFO("Checksum error");
-                        ss.packageToSendRef().clearData();
-                        ss.packageToSendRef().setCommand(COMMAND::CHECKSUM_ERROR);
-                        ss.packageToSendRef().calcChecksum();
-                        return EVENT_LOOP_SIGNALS::SIG_NONE;
-                    }
-
-                    if (ss.recivedPackageRef().getCommand() == COMMAND::CHECKSUM_ERROR)  // Клиенту пришел битый пакет, нужно отправить заново
-                    {
-                        LOG_WARN("Client recive broken package, resend");
-                        return EVENT_LOOP_SIGNALS::SIG_NONE;
-                    }
-
-                    if (state.state == TRANSMISSION_STATE::AWAIT_FILE_SIZE)
-                    {
-                        // Получаем размер файла
-                        std::vector< uint8_t > fSizeArray(8);
-                        ss.recivedPackageRef().getData(fSizeArray);
+        reactors_.push_back(std::move(reactor));
+    }
 
-                        // Устанавливаем размер файла
-                        ss.transmittedDataRef().maxBytes = fromBytes< uint64_t >(fSizeArray);
+    SignalHandler::instance().setAtomic(&stop_);
 
-                        // Проверяем, есть ли возможность сохранить файл, если нет - прервыаем передачу
-                        if (!ss.canSaveFile())
-                        {
-                            LOG_ERROR("Can't save file, path to save files empty");
-                            ss.packageToSendRef().setCommand(COMMAND::REQUEST_TO_SEND_REJECT);
-                            state.state = TRANSMISSION_STATE::ABORT;
-                            state.packageToSend.replacePackage(std::move(ss.packageToSendRef()));
-                            return EVENT_LOOP_SIGNALS::SIG_NONE;
-                        }
+    // У каждого реактора свой поток: слушающие сокеты уже открыты, и ядро раздаёт подключения всем реакторам сразу.
+    // В пуле реактор, которому не хватило потока, так и не начал бы принимать свою долю подключений
+    std::vector< std::thread > running;
 
-                        LOG_INFO("Generated file name", ss.fileName());
-                        ss.transmittedDataRef().convertBytesToPackages(ss.transmittedDataRef().maxBytes);
+    for (auto &reactor : reactors_)
+    {
+        running.emplace_back([&reactor]() { reactor->run(); });
+    }
 
-                        LOG_INFO("Server await", ss.transmittedDataRef().maxPackages, "packages");
-                        LOG_INFO("Package size", ss.transmittedDataRef().packageSizeInBytes, "packages");
-                        ss.packageToSendRef().setCommand(COMMAND::REQUEST_TO_SEND_APPROVED);
-                        std::vector< uint8_t > total_packages = toBytes< std::vector< uint8_t > >(( uint64_t )ss.transmittedDataRef().maxPackages);
-                        std::vector< uint8_t > onePackageSize =  // Размер одного пакета
-                            toBytes< std::vector< uint8_t > >(( uint64_t )ss.transmittedDataRef().packageSizeInBytes);
+    LOG_INFO("Server started with", reactors_.size(), "reactors");
+    logStats();
 
-                        // Сливаем два блока данных в один
-                        //  первые 64 байта - сколько пакетов ожидается
-                        //  вторые 64 байта - размер одного пакета
-                        ss.bufferRef().clear();
-                        ss.packageToSendRef().clearData();
-                        ss.bufferRef().insert(ss.bufferRef().begin(), total_packages.begin(), total_packages.end());
-                        ss.bufferRef().insert(ss.bufferRef().begin() + total_packages.size(), onePackageSize.begin(), onePackageSize.end());
-                        ss.packageToSendRef().setData(ss.bufferRef());
-                        ss.packageToSendRef().calcChecksum();
+    auto lastStats = std::chrono::steady_clock::now();
 
-                        return EVENT_LOOP_SIGNALS::SIG_NONE;
-                    }
-                    else if (state.state == TRANSMISSION_STATE::RECIVE_FILE)
-                    {
-                        if (!ss.openFile())
-                        {
-                            LOG_ERROR("Can't open file");
-                            state.state = TRANSMISSION_STATE::ABORT;
-                            ss.packageToSendRef().setCommand(COMMAND::ABORT);
-                            ss.packageToSendRef().clearData();
-                            ss.packageToSendRef().calcChecksum();
-                            state.packageToSend.replacePackage(std::move(ss.packageToSendRef()));
-                            return EVENT_LOOP_SIGNALS::SIG_NONE;
-                        }
+    while (!stop_)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
 
-                        if (ss.recivedPackageRef().getCommand() != COMMAND::DATA_PACKAGE)
-                        {
-                            ss.packageToSendRef().setCommand(COMMAND::ABORT);
-                            ss.packageToSendRef().clearData();
-                            ss.packageToSendRef().calcChecksum();
-                            return EVENT_LOOP_SIGNALS::SIG_NONE;
-                        }
+        if (std::chrono::steady_clock::now() - lastStats >= std::chrono::milliseconds(statsIntervalMs_))
+        {
+            lastStats = std::chrono::steady_clock::now();
+            logStats();
+        }
+    }
 
-                        ss.bufferRef().clear();
-                        auto bytesToWrite = ss.recivedPackageRef().getData(ss.bufferRef());
-                        ss.writeToFile(ss.bufferRef(), bytesToWrite);
+    LOG_INFO("Stopping server");
 
-                        ss.transmittedDataRef().packageRecived(bytesToWrite);
-                        ss.printInfo();
-                        ss.packageToSendRef().clearData();
-                        ss.packageToSendRef().setCommand(COMMAND::PACKAGE_ACCPTED);
-                        ss.packageToSendRef().setData(state.packagesRecived);
-                        ss.packageToSendRef().calcChecksum();
-                    }
-                    else if (state.state == TRANSMISSION_STATE::AWAIT_FINAL_MESSAGE)
-                    {
-                        if (ss.recivedPackageRef().getCommand() == COMMAND::ALL_DATA_SENDED)
-                        {
-                            LOG_INFO("The client confirmed successful data transfer");
-                            LOG_INFO("Close connection");
-                            ss.printInfo();
-                            return EVENT_LOOP_SIGNALS::SIG_EXIT;
-                        }
-                        return EVENT_LOOP_SIGNALS::SIG_EXIT;
-                    }
-                    else
-                    {
-                        return EVENT_LOOP_SIGNALS::SIG_NONE;
-                    }
+    for (auto &reactor : reactors_)
+    {
+        reactor->stop();
+    }
 
-                    return EVENT_LOOP_SIGNALS::SIG_NONE;
-                });
+    for (auto &thread : running)
+    {
+        thread.join();
+    }
 
-    ev.bindSlot(EPOLLRDHUP, []() { return EVENT_LOOP_SIGNALS::SIG_EXIT; });
-    ev.bindSlot(EPOLLERR, []() { return EVENT_LOOP_SIGNALS::SIG_EXIT; });
-    ev.bindSlot(EPOLLHUP, []() { return EVENT_LOOP_SIGNALS::SIG_EXIT; });
+    return 0;
 }
 
-void Server::sendPackage(EventLoop& ev, transmit_state& state, SocketPtr pSock, Session& ss)
+void Server::logStats()
 {
-    ev.bindSlot(EPOLLOUT,
-                [&state, pSock, &ss]() -> EVENT_LOOP_SIGNALS
-                {
-                    if (ss.packageToSendRef().getCommand() == COMMAND::EMPTY_CMD)
-                    {
-                        // LOG_CRITICAL("Command to send: COMMAND::EMPTY_CMD");
-                        return EVENT_LOOP_SIGNALS::SIG_NONE;
-                    }
-
-                    auto writeResult = pSock->write(ss.packageToSendRef());
-
-                    if (writeResult < 0)
-                    {
-                        LOG_ERROR("Write result less than zero, exit");
-                        ss.reset();
-                        return EVENT_LOOP_SIGNALS::SIG_EXIT;
-                    }
-
-                    if (writeResult == 0)
-                    {
-                        LOG_ERROR("Send responce to client error, 0 bytes written, abort");
-                        ss.reset();
-                        return EVENT_LOOP_SIGNALS::SIG_EXIT;
-                    }
-
-                    ss.lastSendedPackageRef().replacePackage(std::move(ss.packageToSendRef()));
-                    ss.packageToSendRef().setCommand(COMMAND::EMPTY_CMD);
-
-                    if (state.state == TRANSMISSION_STATE::AWAIT_FILE_SIZE)  // Ждём первую посылку от клиента
-                    {
-                        state.state = TRANSMISSION_STATE::RECIVE_FILE;
-                        return EVENT_LOOP_SIGNALS::SIG_NONE;
-                    }
-                    else if (state.state == TRANSMISSION_STATE::RECIVE_FILE)  // Находимся в состоянии приёма файла
-                    {
-                        if (ss.transmittedDataRef().maxPackages == ss.transmittedDataRef().packagesRecived)  // Получили все ождидаемые пакеты
-                        {
-                            state.state = TRANSMISSION_STATE::AWAIT_FINAL_MESSAGE;
-                        }
-                        return EVENT_LOOP_SIGNALS::SIG_NONE;
-                    }
-                    else if (state.state == TRANSMISSION_STATE::AWAIT_FINAL_MESSAGE)
-                    {
-                        return EVENT_LOOP_SIGNALS::SIG_NONE;
-                    }
-                    else if (state.state == TRANSMISSION_STATE::ABORT)
-                    {
-                        LOG_WARN("Abort connection with client");
-                        pSock->write(state.packageToSend);
-                        ss.reset();
-                        return EVENT_LOOP_SIGNALS::SIG_EXIT;
-                    }
-                    else
-                    {
-                        LOG_WARN("Unknown state");
-                        ss.reset();
-                        return EVENT_LOOP_SIGNALS::SIG_EXIT;
-                    }
-                });
+    for (size_t i = 0; i < reactors_.size(); ++i)
+    {
+        LOG_INFO("Reactor", i, "serves", reactors_[i]->connections(), "connections, accepted", reactors_[i]->acceptedTotal());
+    }
 }
@@ -1,14 +1,15 @@
 #ifndef SERVER_H
 #define SERVER_H
-#include "../event_loop/eventloop.h"
-#include "../file_send_state/transmittionStatus.h"
-#include "../session/session.h"
-#include "../socket/socket.h"
-#include "../thread_pool/threadpool.h"
+#include "../reactor/reactor.h"
+#include "../storage/groupcommit.h"
+#include "../storage/segmentstore.h"
+#include "../storage/storageroots.h"
+#include "serverconfig.h"
 
 #include <atomic>
 #include <csignal>
-#include <map>
+#include <memory>
+#include <vector>
 
 struct SignalHandler
 {
@@ -49,30 +50,25 @@ struct SignalHandler
 
 class Server
 {
-    using locker = std::lock_guard< std::mutex >;
-
   public:
-    Server(int port);
+    explicit Server(const ServerConfig& config);
     ~Server();
     int start();
 
   private:
-    bool openConnection();
-
-    SocketPtr acceptNewConnection();
-    void      createSubEventLoop(SocketPtr);
-
-    void recivePackage(EventLoop& ev, transmit_state& state, SocketPtr pSock, Session& ss);
-    void sendPackage(EventLoop& ev, transmit_state& state, SocketPtr pSock, Session& ss);
-
-  private:
-    int epollFd_ = -1;
-    int port_    = 7021;
-
-    const int maxEventsConnectionToHandle_ = std::thread::hardware_concurrency();
-
-    SocketPtr  masterSocket_ = nullptr;
-    ThreadPool tp { static_cast< size_t >(maxEventsConnectionToHandle_) };
+    /**
+     * @brief Печатает состояние реакторов
+     */
+    void logStats();
+
+    inline static const int statsIntervalMs_ { 60000 };
+
+    ServerConfig                              config_;
+    std::atomic_bool                          stop_ { false };
+    StorageRoots                              roots_;     ///< Каталоги для файлов и их потоки записи, живут дольше реакторов
+    std::unique_ptr< GroupCommit >            commit_;    ///< Сброс файлов на диск, если durability не NONE
+    std::unique_ptr< SegmentStore >           segments_;  ///< Хранилище мелких загрузок, если segmentStore
+    std::vector< std::unique_ptr< Reactor > > reactors_;
 };
 
 #endif  // SERVER_H
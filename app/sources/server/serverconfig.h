@@ -0,0 +1,70 @@
+#ifndef SERVERCONFIG_H
+#define SERVERCONFIG_H
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Когда сервер подтверждает клиенту, что файл сохранён
+ */
+enum class Durability
+{
+    NONE,         ///< Сразу, данные могут ещё лежать в страничном кэше
+    ON_COMPLETE,  ///< После fdatasync файла, файлы, закончившиеся одновременно, сбрасываются одной пачкой
+    PERIODIC,     ///< После fdatasync пачки, которая собирается раз в syncIntervalMs
+};
+
+/**
+ * @brief Что делать со страничным кэшем, который заполняют принятые файлы
+ */
+enum class CachePolicy
+{
+    KEEP,       ///< Ничего: ядро само решает, когда писать и вытеснять страницы
+    WRITEBACK,  ///< Начинать запись на диск сразу, держа у сессии не больше dirtyLimit грязных байт
+    DROP,       ///< Как WRITEBACK, и выбрасывать записанные страницы из кэша
+};
+
+/**
+ * @brief Настройки сервера, заполняются из аргументов командной строки
+ */
+struct ServerConfig
+{
+    int port        = 7071;       ///< Порт на котором сервер ожидает подключения
+    int backlog     = SOMAXCONN;  ///< Длина очереди ещё не принятых подключений (man listen)
+    int acceptBatch = 64;         ///< Сколько подключений реактор принимает за одно пробуждение, прежде чем уступить соединениям
+
+    size_t reactors = std::max(1u, std::thread::hardware_concurrency());  ///< Количество реакторов (потоков с event loop)
+
+    std::vector< int > workerCpus {};         ///< Ядра к которым привязываются потоки записи, пусто - без привязки
+    std::vector< int > loopCpus {};           ///< Ядра к которым привязываются потоки event loop'ов
+    bool               followRxCpu = false;  ///< Отдавать соединение реактору на ядре, принявшем его пакеты (SO_INCOMING_CPU)
+
+    bool edgeTriggered = false;  ///< Регистрировать соединения с EPOLLET и вычитывать сокет до EAGAIN
+    int  maxEvents     = 64;     ///< Сколько событий забирается из epoll за один вызов epoll_wait
+    int  ioBudget      = 16;     ///< Сколько пакетов соединение обрабатывает за одно пробуждение, прежде чем уступить другим
+    bool ioUring       = false;  ///< Принимать подключения и обмениваться данными через io_uring, если ядро его поддерживает
+    int  busyPollUs    = 0;      ///< Режим низкой задержки: сколько мкс опрашивать события перед сном, 0 - выключен
+
+    int idleTimeoutMs      = 30000;  ///< Соединение без входящих данных дольше этого времени закрывается, 0 - не закрывать
+    int handshakeTimeoutMs = 5000;   ///< За сколько мс клиент должен прислать размер файла после подключения, 0 - без ограничения
+
+    bool   asyncWrite    = false;  ///< Писать принятые файлы через io_uring, не блокируя event loop
+    bool   writeBehind   = false;  ///< Копить принятые данные в буферах и писать их крупными блоками через O_DIRECT
+    size_t writerThreads = 2;      ///< Сколько потоков пишут буферы на каждый диск в режиме writeBehind
+    bool   splice        = false;  ///< Разрешать клиентам передавать данные блоками без пакетов, которые пишутся в файл через splice
+
+    Durability durability     = Durability::NONE;  ///< Когда подтверждать, что файл сохранён
+    int        syncIntervalMs = 1000;              ///< Как часто сбрасывать файлы на диск в режиме Durability::PERIODIC
+
+    std::vector< std::string > storageRoots {};  ///< Каталоги для принятых файлов, пусто - каталог программы
+    size_t                     rootDepth = 0;    ///< Сколько загрузок одновременно принимает каталог, 0 - без ограничения
+
+    bool   segmentStore     = false;      ///< Складывать мелкие загрузки объектами в сегменты, а не в отдельные файлы
+    size_t smallObjectLimit = 64 * 1024;  ///< Загрузки не больше этого размера считаются мелкими
+
+    CachePolicy cachePolicy = CachePolicy::KEEP;  ///< Что делать со страничным кэшем принятых файлов
+    uint64_t    dirtyLimit  = 16 * 1024 * 1024;    ///< Сколько грязных байт держит сессия в режимах WRITEBACK и DROP
+};
+
+#endif  // SERVERCONFIG_H
@@ -1,6 +1,12 @@
 #include "session.h"
 #include "../helpers/helpers.h"
 #include "../logger/logger.h"
+#include "../storage/diskledger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
 
 Session::Session() :
     connectionTime_ { dateTime_.getCurrentTimestampStr() },
@@ -11,16 +17,54 @@ Session::Session() :
 
 Session::~Session()
 {
+    // Клиент отключился, не получив FILE_SAVED: даже принятый целиком файл мог не дойти до диска, а сам клиент
+    // считает передачу неудачной. Удаляем, как и в reset(), до того как имя станет доступно для скачивания
+    if (closeFile() && !committed_) helpers::removeFile(pathToFile_ + "/" + fileName());
+    endUpload();
+
+    // Объект тоже: его номер клиент не получил, запросить объект никто не сможет
+    if (objectId_ && !committed_) segments_->remove(objectId_);
+
+    releaseSpace();
+    leaveRoot();
     timer_.stop();
 }
 
 void Session::reset()
 {
-    fileToSave_.close();
+    // Недописанный файл удаляем, пока имя ещё указывает на него
+    if (closeFile() && !committed_) helpers::removeFile(pathToFile_ + "/" + fileName());
+    endUpload();
+
+    releaseSpace();
+    leaveRoot();
+
+    // Объект сохранён, но передача не подтверждена: из хранилища его убираем так же, как недописанный файл
+    if (objectId_ && !committed_) segments_->remove(objectId_);
+
+    object_    = false;
+    objectId_  = 0;
+    committed_ = false;
+    data_buffer().swap(objectData_);
+
     connectionTime_ = dateTime_.getCurrentTimestampStr();
     transmittedData_.resetFields();
+    writeOffset_   = 0;
+    writebackFrom_ = 0;
+    settledTo_     = 0;
     timer_.stop();
-    helpers::removeFile(pathToFile_ + "/" + connectionTime_ + ".hex");
+}
+
+bool Session::closeFile()
+{
+    if (fileFd_ < 0) return false;
+
+    // Записи в полёте держат номер дескриптора, забываем их до закрытия
+    if (storage_) storage_->forget(this);
+
+    ::close(fileFd_);
+    fileFd_ = -1;
+    return true;
 }
 
 void Session::setPathToFile(const std::string &pathWhereSaveFile)
@@ -28,21 +72,259 @@ void Session::setPathToFile(const std::string &pathWhereSaveFile)
     pathToFile_ = pathWhereSaveFile;
 }
 
+void Session::setStorage(FileStorage &storage)
+{
+    storage_ = &storage;
+}
+
+void Session::setCachePolicy(CachePolicy policy, uint64_t dirtyLimit)
+{
+    cachePolicy_ = policy;
+    dirtyLimit_  = dirtyLimit;
+}
+
+void Session::setRoots(StorageRoots &roots)
+{
+    roots_ = &roots;
+}
+
+void Session::setSegments(SegmentStore &segments)
+{
+    segments_ = &segments;
+}
+
+bool Session::storesObject() const
+{
+    return object_;
+}
+
+uint64_t Session::objectId() const
+{
+    return objectId_;
+}
+
+void Session::commitUpload()
+{
+    committed_ = true;
+    endUpload();
+}
+
 bool Session::openFile()
 {
-    fileToSave_.open(pathToFile_ + "/" + connectionTime_, std::ios::binary | std::ios::out | std::ios::trunc);
-    return fileToSave_.is_open();
+    if (object_)
+    {
+        objectData_.clear();
+        objectData_.reserve(transmittedData_.maxBytes);
+        return true;
+    }
+
+    if (fileFd_ >= 0) return true;
+
+    // Соединения, принятые в одну и ту же мс, получили бы одно имя файла - добавляем к имени номер
+    auto baseName = connectionTime_;
+
+    for (int attempt = 1; attempt < 100; attempt++)
+    {
+        // Имя занимаем до создания файла: скачивание не должно успеть открыть его пустым
+        beginUpload();
+
+        fileFd_ = ::open((pathToFile_ + "/" + fileName()).c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fileFd_ >= 0 || errno != EEXIST) break;
+
+        endUpload();
+        connectionTime_ = baseName + "_" + std::to_string(attempt);
+    }
+
+    if (fileFd_ < 0)
+    {
+        LOG_ERROR("Can't open file", fileName(), std::strerror(errno));
+        endUpload();
+        return false;
+    }
+
+    if (transmittedData_.maxBytes == 0) return true;
+
+    // Файл получает место одним куском, а не по пакету, и на вращающемся диске меньше дробится.
+    // Размер файла растёт только по мере записи, так что недописанный файл не выглядит целым
+    if (::fallocate(fileFd_, FALLOC_FL_KEEP_SIZE, 0, transmittedData_.maxBytes) == 0)
+    {
+        // Место теперь занято самим файлом и видно через statvfs, держать резерв больше не нужно
+        releaseSpace();
+        return true;
+    }
+
+    // Файловая система не умеет выделять место заранее: резерв остаётся до конца передачи
+    if (errno == EOPNOTSUPP) return true;
+
+    LOG_ERROR("Can't allocate", transmittedData_.maxBytes, "bytes for file", fileName(), std::strerror(errno));
+    closeFile();
+    helpers::removeFile(pathToFile_ + "/" + fileName());
+    endUpload();
+    return false;
+}
+
+void Session::releaseSpace()
+{
+    if (reserved_ == 0) return;
+
+    DiskLedger::getInstance().release(pathToFile_, reserved_);
+    reserved_ = 0;
+}
+
+FileStorage::Result Session::writeToFile(const data_buffer &buff, size_t bytesToWrite, FileStorage::Completion done)
+{
+    if (buff.size() < bytesToWrite) return FileStorage::Result::FAILED;
+
+    if (object_)
+    {
+        if (objectId_ || writeOffset_ + bytesToWrite > transmittedData_.maxBytes) return FileStorage::Result::FAILED;
+
+        objectData_.insert(objectData_.end(), buff.begin(), buff.begin() + bytesToWrite);
+        writeOffset_ += bytesToWrite;
+        return FileStorage::Result::DONE;
+    }
+
+    if (fileFd_ < 0 || !storage_) return FileStorage::Result::FAILED;
+
+    // Свободное место проверено в canSaveFile для всего файла сразу, на каждый пакет statvfs не нужен
+    auto offset = writeOffset_;
+    auto result = storage_->write(fileFd_, offset, buff.data(), bytesToWrite, this, std::move(done));
+
+    if (result != FileStorage::Result::FAILED) writeOffset_ += bytesToWrite;
+    return result;
+}
+
+FileStorage::Result Session::flushFile(FileStorage::Completion done)
+{
+    if (object_)
+    {
+        if (!objectId_) objectId_ = segments_->append(objectData_.data(), objectData_.size());
+        return objectId_ ? FileStorage::Result::DONE : FileStorage::Result::FAILED;
+    }
+
+    if (fileFd_ < 0 || !storage_) return FileStorage::Result::FAILED;
+
+    return storage_->flush(fileFd_, this, std::move(done));
+}
+
+void Session::beginUpload()
+{
+    if (!roots_) return;
+
+    roots_->beginUpload(fileName());
+    uploading_ = true;
+}
+
+void Session::endUpload()
+{
+    if (!uploading_) return;
+
+    roots_->endUpload(fileName());
+    uploading_ = false;
 }
 
-bool Session::writeToFile(const data_buffer &buff, size_t bytesToWrite)
+void Session::leaveRoot()
 {
-    if (!fileToSave_.is_open()) return false;
-    if (buff.size() < bytesToWrite) return false;
-    if (helpers::getFreeDiskSpace(pathToFile_) < bytesToWrite) return false;
-    fileToSave_.write(( char * )buff.data(), bytesToWrite);
+    if (root_ < 0) return;
+
+    roots_->leave(root_);
+    root_ = -1;
+}
+
+uint64_t Session::syncFile(GroupCommit &commit, EventLoop &loop, FileStorage::Completion done)
+{
+    if (object_) return objectId_ ? segments_->sync(objectId_, commit, loop, std::move(done)) : 0;
+    if (fileFd_ < 0) return 0;
+
+    return commit.sync(fileFd_, loop, std::move(done));
+}
+
+bool Session::spliceToFile(int pipeFd, size_t bytes)
+{
+    if (fileFd_ < 0) return false;
+
+    while (bytes > 0)
+    {
+        loff_t offset = writeOffset_;
+        auto   res    = ::splice(pipeFd, nullptr, fileFd_, &offset, bytes, SPLICE_F_MOVE);
+
+        if (res < 0 && errno == EINTR) continue;
+
+        if (res <= 0)
+        {
+            LOG_ERROR("Can't splice to file:", std::strerror(errno));
+            return false;
+        }
+
+        writeOffset_ += res;
+        bytes -= res;
+    }
+
     return true;
 }
 
+bool Session::verifyWritten(uint64_t offset, size_t size, uint32_t crc)
+{
+    if (fileFd_ < 0) return false;
+
+    // Только что записанный блок лежит в страничном кэше, к диску не обращаемся
+    data_buffer chunk(64 * 1024);
+    uint32_t    sum = 0;
+
+    while (size > 0)
+    {
+        auto res = ::pread(fileFd_, chunk.data(), std::min(size, chunk.size()), offset);
+
+        if (res < 0 && errno == EINTR) continue;
+
+        if (res <= 0)
+        {
+            LOG_ERROR("Can't read back file:", res < 0 ? std::strerror(errno) : "unexpected end of file");
+            return false;
+        }
+
+        sum = DatatPackage::checksum(chunk.data(), res, sum);
+        offset += res;
+        size -= res;
+    }
+
+    return sum == crc;
+}
+
+void Session::manageCache()
+{
+    if (cachePolicy_ == CachePolicy::KEEP || fileFd_ < 0) return;
+    if (writeOffset_ - writebackFrom_ < dirtyLimit_ / 2) return;
+
+    // Запускаем запись накопленного, не дожидаясь её
+    if (::sync_file_range(fileFd_, writebackFrom_, writeOffset_ - writebackFrom_, SYNC_FILE_RANGE_WRITE) < 0)
+    {
+        LOG_WARN("Can't start writeback:", std::strerror(errno));
+    }
+
+    // Предыдущая порция запущена половину лимита назад и обычно уже записана, так грязных байт у сессии не бывает
+    // больше лимита. Ждать её в потоке event loop нельзя: медленный диск остановил бы все соединения реактора,
+    // поэтому ожидание уходит в io_uring хранилища или в поток записи устройства. Если отдать некому, порция
+    // присоединится к следующей
+    if (writebackFrom_ > settledTo_ && storage_ && roots_)
+    {
+        auto size = writebackFrom_ - settledTo_;
+        auto drop = cachePolicy_ == CachePolicy::DROP;
+
+        if (storage_->settle(fileFd_, settledTo_, size, drop) || roots_->settle(fileFd_, settledTo_, size, drop))
+        {
+            settledTo_ = writebackFrom_;
+        }
+    }
+
+    writebackFrom_ = writeOffset_;
+}
+
+uint64_t Session::writeOffset() const
+{
+    return writeOffset_;
+}
+
 bool Session::canSaveFile()
 {
     if (pathToFile_.empty())
@@ -51,13 +333,38 @@ bool Session::canSaveFile()
         return false;
     }
 
-    if (helpers::getFreeDiskSpace(pathToFile_) < transmittedData_.maxBytes)
+    releaseSpace();
+    leaveRoot();
+
+    // Мелкие загрузки идут объектами в сегменты, место под них не резервируем
+    object_ = segments_ && transmittedData_.maxBytes <= segments_->objectLimit();
+    if (object_) return true;
+
+    if (roots_)
+    {
+        root_ = roots_->place(transmittedData_.maxBytes);
+
+        if (root_ < 0)
+        {
+            LOG_ERROR("Can't save file");
+            LOG_ERROR("File size: ", transmittedData_.maxBytes);
+            return false;
+        }
+
+        pathToFile_ = roots_->path(root_);
+        reserved_   = transmittedData_.maxBytes;
+        return true;
+    }
+
+    // Учитываем и место, обещанное другим сессиям, которые ещё не выделили его под свои файлы
+    if (!DiskLedger::getInstance().reserve(pathToFile_, transmittedData_.maxBytes))
     {
         LOG_ERROR("Can't save file");
         LOG_ERROR("File size: ", transmittedData_.maxBytes);
-        LOG_ERROR("Free space at path", pathToFile_, "=", helpers::getFreeDiskSpace(pathToFile_));
         return false;
     }
+
+    reserved_ = transmittedData_.maxBytes;
     return true;
 }
 
@@ -1,9 +1,14 @@
 #ifndef SESSION_H
 #define SESSION_H
 #include "../data_package/datatpackage.h"
+#include "../storage/filestorage.h"
+#include "../server/serverconfig.h"
+#include "../storage/groupcommit.h"
+#include "../storage/segmentstore.h"
+#include "../storage/storageroots.h"
 #include "../time/time.h"
 #include <cstdlib>
-#include <fstream>
+#include <string>
 
 struct data_transmitted
 {
@@ -21,7 +26,9 @@ struct data_transmitted
     {
         if (fileSize < 1024)
         {
-            maxPackages = 1;
+            // Размер пакета клиент получает в ответе на запрос, с нулём он не может начать передачу
+            packageSizeInBytes = 1024;
+            maxPackages        = 1;
             maxBytes    = fileSize;
             return maxPackages;
         }
@@ -66,10 +73,103 @@ class Session
   public:
     Session();
     ~Session();
+
+    Session(const Session&)            = delete;
+    Session& operator=(const Session&) = delete;
     void              reset();
     void              setPathToFile(const std::string& pathWhereSaveFile);
-    bool              openFile();
-    bool              writeToFile(const data_buffer&, size_t bytesToWrite);
+
+    /**
+     * @brief Через что писать принятые данные, хранилище должно жить дольше сессии
+     */
+    void setStorage(FileStorage& storage);
+
+    /**
+     * @brief Из каких каталогов выбирать место для файла в canSaveFile, каталоги должны жить дольше сессии.
+     * Без них файл сохраняется в setPathToFile
+     */
+    void setRoots(StorageRoots& roots);
+
+    /**
+     * @brief Куда складывать мелкие загрузки (не больше SegmentStore::objectLimit), хранилище должно жить дольше сессии.
+     * Такая загрузка копится в памяти и на последнем пакете (flushFile) дописывается в сегмент одним объектом
+     */
+    void setSegments(SegmentStore& segments);
+
+    /**
+     * @brief Загрузка сохраняется объектом в SegmentStore, а не отдельным файлом
+     */
+    bool storesObject() const;
+
+    /**
+     * @return Номер сохранённого объекта, 0 если объект ещё не сохранён или загрузка идёт в файл
+     */
+    uint64_t objectId() const;
+
+    /**
+     * @brief Клиент получил имя файла или номер объекта: загрузка остаётся и после reset() или закрытия сессии,
+     * файл с этого момента можно скачивать. До этого объект, который клиент уже не сможет запросить,
+     * из SegmentStore удаляется
+     */
+    void commitUpload();
+
+    /**
+     * @brief Как обращаться со страничным кэшем файла, см. manageCache()
+     * @param Политика
+     * @param Сколько грязных байт может держать сессия
+     */
+    void setCachePolicy(CachePolicy policy, uint64_t dirtyLimit);
+
+    /**
+     * @brief Открывает файл для сохранения и заранее выделяет под него место (fallocate), повторный вызов ничего не делает
+     */
+    bool openFile();
+
+    /**
+     * @brief Дописывает данные в конец уже переданной части файла
+     * @param Буфер с данными
+     * @param Сколько байт из буфера записать
+     * @param Вызывается после записи, если хранилище вернуло FileStorage::Result::PENDING
+     */
+    FileStorage::Result writeToFile(const data_buffer&, size_t bytesToWrite, FileStorage::Completion done);
+
+    /**
+     * @brief Дожидается, пока хранилище не допишет в файл всё, что приняло от сессии (FileStorage::flush).
+     * Мелкая загрузка в этот момент сохраняется в SegmentStore
+     */
+    FileStorage::Result flushFile(FileStorage::Completion done);
+
+    /**
+     * @brief Ставит файл в очередь на сброс на диск (GroupCommit::sync)
+     * @return Номер запроса, 0 в случае ошибки
+     */
+    uint64_t syncFile(GroupCommit& commit, EventLoop& loop, FileStorage::Completion done);
+
+    /**
+     * @brief Переносит данные из канала в конец уже переданной части файла через splice, минуя память процесса.
+     * Запись синхронная, хранилище не используется
+     * @param Канал, в котором лежат данные
+     * @param Сколько байт перенести, в канале должно быть не меньше
+     */
+    bool spliceToFile(int pipeFd, size_t bytes);
+
+    /**
+     * @brief Перечитывает записанную часть файла и сверяет её контрольную сумму
+     */
+    bool verifyWritten(uint64_t offset, size_t size, uint32_t crc);
+
+    /**
+     * @brief Вызывается после того, как данные записаны в файл. Когда с начала последней запущенной записи накопилась
+     * половина лимита, запускает запись накопленного (sync_file_range) и отдаёт ожидание предыдущей FileStorage::settle
+     * или потоку записи устройства, в режиме DROP её страницы ещё и выбрасываются из кэша. Так ядро пишет файл ровным
+     * потоком, а не сбрасывает гигабайты разом, когда грязных страниц становится слишком много
+     */
+    void manageCache();
+
+    uint64_t          writeOffset() const;
+    /**
+     * @brief Выбирает каталог для файла (StorageRoots::place) и резервирует в DiskLedger место под весь файл
+     */
     bool              canSaveFile();
     void              printInfo();
     void              calcPackages();
@@ -80,10 +180,49 @@ class Session
     DatatPackage&     packageToSendRef();
     DatatPackage&     recivedPackageRef();
 
+  private:
+    /**
+     * @brief Закрывает файл, забыв незавершённые записи
+     * @return false если файл не был открыт
+     */
+    bool closeFile();
+
+    /**
+     * @brief Возвращает зарезервированное в DiskLedger место
+     */
+    void releaseSpace();
+
+    /**
+     * @brief Сообщает StorageRoots, что загрузка в выбранный каталог закончилась
+     */
+    void leaveRoot();
+
+    /**
+     * @brief Пока идёт загрузка, StorageRoots не отдаёт файл на скачивание (StorageRoots::beginUpload).
+     * endUpload вызывается, когда файл уже закрыт и, если нужно, удалён
+     */
+    void beginUpload();
+    void endUpload();
+
   private:
     DateTime         dateTime_;
     data_buffer      buffer_;
-    std::fstream     fileToSave_;
+    FileStorage*     storage_ { nullptr };
+    StorageRoots*    roots_ { nullptr };
+    int              root_ { -1 };  ///< Каталог из roots_, в котором лежит файл
+    SegmentStore*    segments_ { nullptr };
+    bool             object_ { false };  ///< Загрузка копится в objectData_ и сохраняется объектом
+    data_buffer      objectData_;
+    uint64_t         objectId_ { 0 };
+    bool             committed_ { false };  ///< Имя файла или номер объекта отправлены клиенту
+    int              fileFd_ { -1 };
+    bool             uploading_ { false };  ///< Имя файла занято в StorageRoots
+    uint64_t         writeOffset_ { 0 };  ///< Куда пойдёт следующая запись: сумма всех отданных хранилищу байт
+    uint64_t         reserved_ { 0 };     ///< Сколько места держит за сессией DiskLedger
+    CachePolicy      cachePolicy_ { CachePolicy::KEEP };
+    uint64_t         dirtyLimit_ { 0 };
+    uint64_t         writebackFrom_ { 0 };  ///< Начало записанного, но ещё не отданного на запись
+    uint64_t         settledTo_ { 0 };      ///< До куда запись на диск завершена
     std::string      connectionTime_;
     std::string      pathToFile_;
     data_transmitted transmittedData_;
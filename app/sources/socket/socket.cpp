@@ -7,9 +7,11 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
 
@@ -49,16 +51,14 @@ Socket::~Socket()
 {
     if (sock_ > 0)
     {
-        auto res = ::shutdown(sock_, SHUT_RDWR);
-
-        if (res < 0)
+        // shutdown у слушающего сокета завершается с ENOTCONN, это не ошибка
+        if (::shutdown(sock_, SHUT_RDWR) < 0 && errno != ENOTCONN)
         {
             handleError("Can't close socket");
         }
-        else
-        {
-            sock_ = -1;
-        }
+
+        ::close(sock_);
+        sock_ = -1;
 
         if (SocketType::LOCAL == sockType_)
         {  // For AF_UNIX | AF_LOCAL you can use call unlink (path); after close() socket in "server" app
@@ -102,17 +102,17 @@ bool Socket::close()
 {
     if (sock_ > 0)
     {
-        auto res = ::shutdown(sock_, 2);
-        if (res < 0)
+        bool res = true;
+
+        if (::shutdown(sock_, SHUT_RDWR) < 0 && errno != ENOTCONN)
         {
             handleError("Can't close socket:");
-            return false;
-        }
-        else
-        {
-            sock_ = -1;
-            return true;
+            res = false;
         }
+
+        ::close(sock_);
+        sock_ = -1;
+        return res;
     }
     return true;
 }
@@ -147,7 +147,10 @@ std::shared_ptr< Socket > Socket::accept()
         return nullptr;
     }
 
-    LOG_INFO("Get connection to server from:", inet_ntoa(cli_addr.sin_addr), ntohs(cli_addr.sin_port));
+    // inet_ntoa пишет в общий статический буфер, а принимать подключения могут несколько потоков
+    char address[INET_ADDRSTRLEN] {};
+    inet_ntop(AF_INET, &cli_addr.sin_addr, address, sizeof(address));
+    LOG_INFO("Get connection to server from:", address, ntohs(cli_addr.sin_port));
 
     return std::make_shared< Socket >(newsockfd);
 }
@@ -185,6 +188,93 @@ void Socket::setMaximumConnectionsHandle(int maxConnections)
     maxConnections_ = maxConnections;
 }
 
+int Socket::incomingCpu() const
+{
+    int       cpu = -1;
+    socklen_t len = sizeof(cpu);
+
+    if (getsockopt(sock_, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) < 0)
+    {
+        return -1;
+    }
+
+    return cpu;
+}
+
+bool Socket::setIncomingCpu(int cpu)
+{
+    if (setsockopt(sock_, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) < 0)
+    {
+        handleError("Can't set SO_INCOMING_CPU:");
+        return false;
+    }
+
+    return true;
+}
+
+bool Socket::setReceiveTimeout(int ms)
+{
+    struct timeval tv;
+    tv.tv_sec  = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+
+    if (setsockopt(sock_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
+    {
+        handleError("Can't set SO_RCVTIMEO:");
+        return false;
+    }
+
+    return true;
+}
+
+bool Socket::reusePort()
+{
+    int val = 1;
+
+    if (setsockopt(sock_, SOL_SOCKET, SO_REUSEPORT, &val, sizeof(val)) < 0)
+    {
+        handleError("Can't set SO_REUSEPORT:");
+        return false;
+    }
+
+    return true;
+}
+
+bool Socket::setBusyPoll(int us)
+{
+    if (setsockopt(sock_, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us)) < 0)
+    {
+        handleError("Can't set SO_BUSY_POLL:");
+        return false;
+    }
+
+#ifdef SO_PREFER_BUSY_POLL
+    // Без этого флага прерывания сетевой карты под нагрузкой забирают пакеты раньше, чем до них дойдёт опрос
+    int prefer = 1;
+
+    if (setsockopt(sock_, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer)) < 0)
+    {
+        handleError("Can't set SO_PREFER_BUSY_POLL:");
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+bool Socket::setNoDelay()
+{
+    int val = 1;
+
+    if (setsockopt(sock_, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val)) < 0)
+    {
+        handleError("Can't set TCP_NODELAY:");
+        return false;
+    }
+
+    return true;
+}
+
 bool Socket::nonBlockingMode()
 {
     if (fcntl(sock_, F_SETFL, fcntl(sock_, F_GETFL, 0) | O_NONBLOCK) == -1)
@@ -224,6 +314,29 @@ int Socket::write(std::vector< uint8_t > &data, int size)
     return res;
 }
 
+int Socket::read(uint8_t *data, size_t size)
+{
+    return ::recv(sock_, data, size, 0);
+}
+
+int Socket::write(const uint8_t *data, size_t size)
+{
+    auto res = ::send(sock_, data, size, MSG_NOSIGNAL);
+    if (res < 0 && errno != EAGAIN && errno != EWOULDBLOCK) handleError("Can't write:");
+    return res;
+}
+
+int Socket::write(const struct iovec *iov, int count)
+{
+    struct msghdr msg {};
+    msg.msg_iov    = const_cast< struct iovec * >(iov);
+    msg.msg_iovlen = count;
+
+    auto res = ::sendmsg(sock_, &msg, MSG_NOSIGNAL);
+    if (res < 0 && errno != EAGAIN && errno != EWOULDBLOCK) handleError("Can't write:");
+    return res;
+}
+
 int Socket::write(const DatatPackage &pkg)
 {
     std::vector< uint8_t > buffer;
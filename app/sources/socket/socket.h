@@ -80,6 +80,24 @@ class Socket : public IODevice
      */
     int write(std::vector< uint8_t > &, int size = -1) override;
 
+    /**
+     * @brief Читает из сокета не более size байт в data
+     * @return Количество прочитанных байт, 0 если соединение закрыто, -1 в случае ошибки (в т.ч. EAGAIN)
+     */
+    int read(uint8_t *data, size_t size);
+
+    /**
+     * @brief Пишет в сокет size байт начиная с data, для неблокирующего сокета может записать меньше
+     * @return Количество записанных байт, -1 в случае ошибки (EAGAIN не логируется)
+     */
+    int write(const uint8_t *data, size_t size);
+
+    /**
+     * @brief Пишет в сокет одним вызовом несколько кусков памяти (sendmsg), может записать меньше суммы их размеров
+     * @return Количество записанных байт, -1 в случае ошибки (EAGAIN не логируется)
+     */
+    int write(const struct iovec *iov, int count);
+
     /**
      * @brief Записывает данные из переданной структуры в сокет
      * @param DataPackage - пакет с данными для передачи
@@ -117,6 +135,42 @@ class Socket : public IODevice
      */
     void setMaximumConnectionsHandle(int maxConnections);
 
+    /**
+     * @brief Возвращает ядро, на котором сетевой стек обрабатывает входящие пакеты сокета (man 7 socket, SO_INCOMING_CPU)
+     * @return Номер ядра или -1 если ядро неизвестно
+     */
+    int incomingCpu() const;
+
+    /**
+     * @brief Просит ядро отдавать этому слушающему сокету подключения, пакеты которых обрабатываются на ядре cpu.
+     * Имеет смысл для группы сокетов с SO_REUSEPORT, вызывается до open()
+     */
+    bool setIncomingCpu(int cpu);
+
+    /**
+     * @brief Ограничивает время ожидания в read (SO_RCVTIMEO), по истечении read возвращает -1 с errno EAGAIN
+     * @param Таймаут в мс, 0 - ждать бесконечно
+     */
+    bool setReceiveTimeout(int ms);
+
+    /**
+     * @brief Разрешает нескольким сокетам слушать один порт (SO_REUSEPORT), ядро распределяет подключения между ними.
+     * Вызывается до open()
+     */
+    bool reusePort();
+
+    /**
+     * @brief Просит ядро при ожидании данных опрашивать очередь сетевой карты, а не засыпать (SO_BUSY_POLL,
+     * SO_PREFER_BUSY_POLL). Значение больше net.core.busy_read требует CAP_NET_ADMIN
+     * @param Сколько мкс опрашивать
+     */
+    bool setBusyPoll(int us);
+
+    /**
+     * @brief Отключает алгоритм Нейгла (TCP_NODELAY): маленькие ответы уходят сразу, не дожидаясь ACK
+     */
+    bool setNoDelay();
+
   private:
     /**
      * @brief Запускает сокет на прослушку соединений, релевантно для мастер-сокета сервера (man listen)
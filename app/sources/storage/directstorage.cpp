@@ -0,0 +1,330 @@
+#include "directstorage.h"
+#include "../logger/logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <string>
+#include <unistd.h>
+
+DirectStorage::DirectStorage(EventLoop &loop, StorageRoots &roots) :
+    loop_ { loop },
+    roots_ { roots }
+{
+}
+
+DirectStorage::~DirectStorage()
+{
+    // Писатели держат буферы и дескрипторы, отпускаем их только после того, как все задачи закончатся
+    {
+        std::unique_lock< std::mutex > lock(mutex_);
+        idle_.wait(lock, [this] { return running_ == 0; });
+    }
+
+    for (auto &[id, file] : files_)
+    {
+        if (file.directFd >= 0) ::close(file.directFd);
+        ::close(file.fd);
+    }
+
+    for (auto buffer : buffers_)
+    {
+        ::operator delete(buffer, std::align_val_t(alignment_));
+    }
+}
+
+FileStorage::Result DirectStorage::write(int fd, uint64_t offset, const uint8_t *data, size_t size, const void *owner, Completion done)
+{
+    auto id = fileOf(fd, owner);
+    if (id == 0) return Result::FAILED;
+
+    auto &file = files_[id];
+
+    // Ошибка записи предыдущего буфера всплывает на следующей записи
+    if (file.failed) return Result::FAILED;
+
+    // Записи файла не обгоняют друг друга, иначе буфер перестанет быть непрерывным куском файла
+    if (file.waiting == 0 && append(id, offset, data, size)) return Result::DONE;
+
+    file.waiting++;
+    waiting_.push_back({ id, offset, std::vector< uint8_t >(data, data + size), std::move(done) });
+    return Result::PENDING;
+}
+
+FileStorage::Result DirectStorage::flush(int, const void *owner, Completion done)
+{
+    auto it = owners_.find(owner);
+    if (it == owners_.end()) return Result::DONE;
+
+    auto &file = files_[it->second];
+
+    if (file.waiting == 0 && file.filled > 0) flushBuffer(it->second);
+
+    if (file.inFlight == 0 && file.waiting == 0) return file.failed ? Result::FAILED : Result::DONE;
+
+    file.flushed = std::move(done);
+    return Result::PENDING;
+}
+
+void DirectStorage::forget(const void *owner)
+{
+    auto it = owners_.find(owner);
+    if (it == owners_.end()) return;
+
+    auto  id   = it->second;
+    auto &file = files_[id];
+    owners_.erase(it);
+
+    for (auto w = waiting_.begin(); w != waiting_.end();)
+    {
+        w = w->id == id ? waiting_.erase(w) : std::next(w);
+    }
+
+    // Недописанный буфер больше никому не нужен, а отданные писателям допишутся в свои копии дескрипторов
+    if (file.buffer) free_.push_back(file.buffer);
+
+    file.buffer    = nullptr;
+    file.filled    = 0;
+    file.waiting   = 0;
+    file.flushed   = nullptr;
+    file.forgotten = true;
+
+    if (file.inFlight == 0) closeFile(id);
+
+    serveWaiting();
+}
+
+uint64_t DirectStorage::fileOf(int fd, const void *owner)
+{
+    auto it = owners_.find(owner);
+    if (it != owners_.end()) return it->second;
+
+    File file;
+    file.writers = roots_.writersFor(fd);
+
+    if (!file.writers)
+    {
+        LOG_ERROR("File is not on a storage root with writer threads");
+        return 0;
+    }
+
+    file.fd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+
+    if (file.fd < 0)
+    {
+        LOG_ERROR("Can't duplicate file descriptor:", std::strerror(errno));
+        return 0;
+    }
+
+    // Открываем файл заново, а не меняем флаги: O_DIRECT на общем описании файла задел бы и запись хвоста
+    auto path     = "/proc/self/fd/" + std::to_string(fd);
+    file.directFd = ::open(path.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+
+    if (file.directFd < 0)
+    {
+        static bool warned = false;
+
+        if (!warned)
+        {
+            LOG_WARN("O_DIRECT is not available, write-behind falls back to buffered writes:", std::strerror(errno));
+            warned = true;
+        }
+    }
+
+    auto id = nextId_++;
+    files_.emplace(id, std::move(file));
+    owners_[owner] = id;
+    return id;
+}
+
+bool DirectStorage::append(uint64_t id, uint64_t &offset, const uint8_t *&data, size_t &size)
+{
+    auto &file = files_[id];
+
+    // Сначала считаем, хватит ли буферов на всю запись, чтобы не оставлять её наполовину скопированной
+    bool   contiguous = file.buffer && (file.filled == 0 || offset == file.base + file.filled);
+    size_t room       = contiguous ? bufferSize_ - file.filled : 0;
+    size_t needed     = size > room ? (size - room + bufferSize_ - 1) / bufferSize_ : 0;
+
+    if (needed > free_.size() + (maxBuffers_ - buffers_.size())) return false;
+
+    while (size > 0)
+    {
+        if (file.buffer && file.filled == 0) file.base = offset;
+
+        if (!file.buffer || offset != file.base + file.filled)
+        {
+            if (file.buffer) flushBuffer(id);
+
+            file.buffer = takeBuffer();
+            file.base   = offset;
+            file.filled = 0;
+        }
+
+        auto chunk = std::min(size, bufferSize_ - file.filled);
+        std::memcpy(file.buffer + file.filled, data, chunk);
+
+        file.filled += chunk;
+        offset += chunk;
+        data += chunk;
+        size -= chunk;
+
+        if (file.filled == bufferSize_) flushBuffer(id);
+    }
+
+    return true;
+}
+
+void DirectStorage::flushBuffer(uint64_t id)
+{
+    auto &file   = files_[id];
+    auto  buffer = file.buffer;
+    auto  size   = file.filled;
+    auto  offset = file.base;
+    auto  fd     = file.fd;
+    auto  direct = file.directFd;
+
+    file.buffer = nullptr;
+    file.filled = 0;
+    file.inFlight++;
+
+    {
+        std::lock_guard< std::mutex > lock(mutex_);
+        running_++;
+    }
+
+    file.writers->post([this, id, buffer, size, offset, fd, direct] {
+        bool ok = writeOut(fd, direct, buffer, size, offset);
+
+        loop_.post([this, id, buffer, ok] { onFlushed(id, buffer, ok); });
+
+        std::lock_guard< std::mutex > lock(mutex_);
+        running_--;
+        idle_.notify_all();
+    });
+}
+
+bool DirectStorage::writeOut(int fd, int directFd, const uint8_t *data, size_t size, uint64_t offset)
+{
+    // O_DIRECT требует выровненных смещения и длины, остаток пишется через страничный кэш
+    size_t aligned = directFd >= 0 && offset % alignment_ == 0 ? size & ~(alignment_ - 1) : 0;
+    size_t written = 0;
+
+    while (written < size)
+    {
+        bool direct = written < aligned;
+        auto res    = direct ? ::pwrite(directFd, data + written, aligned - written, offset + written)
+                             : ::pwrite(fd, data + written, size - written, offset + written);
+
+        if (res < 0 && errno == EINTR) continue;
+
+        if (res <= 0)
+        {
+            LOG_ERROR("Can't write to file:", std::strerror(errno));
+            return false;
+        }
+
+        written += res;
+
+        // Короткая прямая запись сбивает выравнивание, остаток допишем обычной
+        if (direct && written % alignment_ != 0) aligned = written;
+    }
+
+    return true;
+}
+
+void DirectStorage::onFlushed(uint64_t id, uint8_t *buffer, bool ok)
+{
+    free_.push_back(buffer);
+
+    auto it = files_.find(id);
+
+    if (it != files_.end())
+    {
+        it->second.inFlight--;
+        if (!ok) it->second.failed = true;
+
+        if (it->second.forgotten && it->second.inFlight == 0) closeFile(id);
+    }
+
+    serveWaiting();
+    settle(id);
+}
+
+void DirectStorage::settle(uint64_t id)
+{
+    auto it = files_.find(id);
+    if (it == files_.end()) return;
+
+    auto &file = it->second;
+    if (!file.flushed || file.waiting > 0) return;
+
+    // Ожидавшие записи легли в буфер уже после вызова flush, его тоже отдаём писателю
+    if (file.filled > 0) flushBuffer(id);
+    if (file.inFlight > 0) return;
+
+    auto done    = std::move(file.flushed);
+    file.flushed = nullptr;
+    done(!file.failed);
+}
+
+void DirectStorage::serveWaiting()
+{
+    while (!waiting_.empty())
+    {
+        auto &next = waiting_.front();
+        auto  id   = next.id;
+        auto &file = files_[id];
+
+        if (file.failed)
+        {
+            auto done = std::move(next.done);
+            file.waiting--;
+            waiting_.pop_front();
+
+            if (done) done(false);
+            settle(id);
+            continue;
+        }
+
+        auto offset = next.offset;
+        auto data   = static_cast< const uint8_t * >(next.data.data());
+        auto size   = next.data.size();
+
+        if (!append(id, offset, data, size)) break;
+
+        auto done = std::move(next.done);
+        file.waiting--;
+        waiting_.pop_front();
+
+        // Обработчик может сразу прислать следующую запись или забыть владельца, поэтому очередь уже сдвинута
+        if (done) done(true);
+        settle(id);
+    }
+}
+
+uint8_t *DirectStorage::takeBuffer()
+{
+    if (!free_.empty())
+    {
+        auto buffer = free_.back();
+        free_.pop_back();
+        return buffer;
+    }
+
+    auto buffer = static_cast< uint8_t * >(::operator new(bufferSize_, std::align_val_t(alignment_)));
+    buffers_.push_back(buffer);
+    return buffer;
+}
+
+void DirectStorage::closeFile(uint64_t id)
+{
+    auto it = files_.find(id);
+    if (it == files_.end()) return;
+
+    if (it->second.directFd >= 0) ::close(it->second.directFd);
+    ::close(it->second.fd);
+    files_.erase(it);
+}
@@ -0,0 +1,125 @@
+#ifndef DIRECTSTORAGE_H
+#define DIRECTSTORAGE_H
+#include "filestorage.h"
+#include "../event_loop/eventloop.h"
+#include "storageroots.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Отложенная запись крупными блоками. Пакеты сессии копируются в выровненный буфер на bufferSize_ байт,
+ * заполненный буфер пишется потоком из пула писателей через O_DIRECT, минуя страничный кэш, так что тысячи мелких
+ * записей превращаются в одну и не вытесняют из кэша то, что в нём нужно. Хвост, не кратный блоку, и файловые
+ * системы без O_DIRECT пишутся обычным pwrite.
+ *
+ * Запись пакета завершается сразу после копирования в буфер, ошибка записи буфера на диск возвращается
+ * следующей записью или flush(). Обработчики завершения вызываются в потоке event loop
+ */
+class DirectStorage : public FileStorage
+{
+  public:
+    /**
+     * @param Event loop реактора, в его поток возвращаются завершения
+     * @param Каталоги для файлов, буферы пишут потоки устройства, на котором лежит файл. Должны жить дольше хранилища
+     */
+    DirectStorage(EventLoop& loop, StorageRoots& roots);
+    ~DirectStorage();
+
+    Result write(int fd, uint64_t offset, const uint8_t* data, size_t size, const void* owner, Completion done) override;
+    Result flush(int fd, const void* owner, Completion done) override;
+    void   forget(const void* owner) override;
+
+  private:
+    /**
+     * @brief Файл одного владельца. Дескрипторы свои (dup), поэтому владелец может закрыть свой сразу после forget,
+     * а буферы, уже отданные писателям, допишутся
+     */
+    struct File
+    {
+        int         fd { -1 };            ///< Копия дескриптора владельца, для хвоста и при отсутствии O_DIRECT
+        int         directFd { -1 };      ///< Тот же файл, открытый с O_DIRECT
+        ThreadPool* writers { nullptr };  ///< Потоки записи устройства, на котором лежит файл
+        uint8_t*    buffer { nullptr };   ///< Заполняемый буфер
+        uint64_t    base { 0 };           ///< Смещение в файле начала буфера
+        size_t      filled { 0 };
+        size_t      inFlight { 0 };       ///< Буферов у писателей
+        size_t      waiting { 0 };        ///< Записей в waiting_
+        bool        failed { false };
+        bool        forgotten { false };
+        Completion  flushed;              ///< Ждёт, пока писатели не допишут все буферы
+    };
+
+    /**
+     * @brief Запись, ожидающая свободного буфера
+     */
+    struct Waiting
+    {
+        uint64_t               id;
+        uint64_t               offset;
+        std::vector< uint8_t > data;
+        Completion             done;
+    };
+
+    /**
+     * @brief Находит файл владельца или заводит новый
+     * @return 0 если не удалось продублировать дескриптор или у устройства файла нет потоков записи
+     */
+    uint64_t fileOf(int fd, const void* owner);
+
+    /**
+     * @brief Копирует данные в буферы файла, заполненные отдаёт писателям
+     * @return false если свободные буферы кончились, скопированная часть при этом остаётся в буфере
+     */
+    bool append(uint64_t id, uint64_t& offset, const uint8_t*& data, size_t& size);
+
+    /**
+     * @brief Отдаёт текущий буфер файла писателю
+     */
+    void flushBuffer(uint64_t id);
+
+    /**
+     * @brief Выполняется в потоке пула: пишет буфер, выровненную часть через O_DIRECT
+     */
+    static bool writeOut(int fd, int directFd, const uint8_t* data, size_t size, uint64_t offset);
+
+    /**
+     * @brief Писатель закончил с буфером, вызывается в потоке event loop
+     */
+    void onFlushed(uint64_t id, uint8_t* buffer, bool ok);
+
+    /**
+     * @brief Отдаёт освободившиеся буферы ожидающим записям
+     */
+    void serveWaiting();
+
+    /**
+     * @brief Завершает flush файла, если его записи больше не ждут буферов и не пишутся
+     */
+    void settle(uint64_t id);
+
+    uint8_t* takeBuffer();
+    void     closeFile(uint64_t id);
+
+  private:
+    inline static const size_t bufferSize_ { 1024 * 1024 };
+    inline static const size_t maxBuffers_ { 32 };    ///< Сколько буферов реактор может держать одновременно
+    inline static const size_t alignment_ { 4096 };   ///< Выравнивание адреса, смещения и длины для O_DIRECT
+
+    EventLoop&                                   loop_;
+    StorageRoots&                                roots_;
+    uint64_t                                     nextId_ { 1 };
+    std::unordered_map< const void*, uint64_t >  owners_;
+    std::unordered_map< uint64_t, File >         files_;    ///< По номеру, а не по владельцу: адрес владельца может достаться новой сессии
+    std::vector< uint8_t* >                      buffers_;  ///< Все выделенные буферы
+    std::vector< uint8_t* >                      free_;
+    std::deque< Waiting >                        waiting_;
+    std::mutex                                   mutex_;
+    std::condition_variable                      idle_;
+    size_t                                       running_ { 0 };  ///< Задач у писателей, деструктор ждёт их
+};
+
+#endif  // DIRECTSTORAGE_H
@@ -0,0 +1,47 @@
+#include "diskledger.h"
+#include "../helpers/helpers.h"
+#include "../logger/logger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/stat.h>
+
+bool DiskLedger::reserve(const std::string &path, uint64_t bytes)
+{
+    struct stat st;
+
+    if (::stat(path.c_str(), &st) < 0)
+    {
+        LOG_ERROR("Can't stat", path, std::strerror(errno));
+        return false;
+    }
+
+    std::lock_guard< std::mutex > lock(mutex_);
+
+    auto &reserved = reserved_[st.st_dev];
+    auto  free     = helpers::getFreeDiskSpace(path);
+
+    if (free < reserved || free - reserved < bytes)
+    {
+        LOG_ERROR("Not enough space at", path, ": free", free, "reserved", reserved, "requested", bytes);
+        return false;
+    }
+
+    reserved += bytes;
+    return true;
+}
+
+void DiskLedger::release(const std::string &path, uint64_t bytes)
+{
+    struct stat st;
+
+    if (::stat(path.c_str(), &st) < 0) return;
+
+    std::lock_guard< std::mutex > lock(mutex_);
+
+    auto it = reserved_.find(st.st_dev);
+    if (it == reserved_.end()) return;
+
+    it->second -= std::min(it->second, bytes);
+    if (it->second == 0) reserved_.erase(it);
+}
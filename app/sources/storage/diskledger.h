@@ -0,0 +1,45 @@
+#ifndef DISKLEDGER_H
+#define DISKLEDGER_H
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+
+/**
+ * @brief Общий для всех реакторов учёт места, обещанного сессиям, по файловым системам.
+ * statvfs показывает только уже занятое место, поэтому две сессии, одновременно проверившие свободное место,
+ * могли получить его обе. Резерв держится, пока место не займёт сам файл (fallocate) или пока сессия не закончится
+ */
+class DiskLedger
+{
+  public:
+    static DiskLedger& getInstance()
+    {
+        static DiskLedger instance;
+        return instance;
+    }
+
+    DiskLedger(const DiskLedger&)            = delete;
+    DiskLedger& operator=(const DiskLedger&) = delete;
+
+    /**
+     * @brief Резервирует место на файловой системе, где лежит path
+     * @return false если свободного места за вычетом уже зарезервированного не хватает
+     */
+    bool reserve(const std::string& path, uint64_t bytes);
+
+    /**
+     * @brief Возвращает зарезервированное место
+     */
+    void release(const std::string& path, uint64_t bytes);
+
+  private:
+    DiskLedger() = default;
+
+  private:
+    std::mutex                            mutex_;
+    std::unordered_map< dev_t, uint64_t > reserved_;  ///< Сколько зарезервировано на каждой файловой системе
+};
+
+#endif  // DISKLEDGER_H
@@ -0,0 +1,98 @@
+#include "downloadsource.h"
+#include "../data_package/datatpackage.h"
+#include "../logger/logger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+DownloadSource::~DownloadSource()
+{
+    if (fd_ >= 0) ::close(fd_);
+}
+
+bool DownloadSource::openFile(const StorageRoots &roots, const std::string &name)
+{
+    fd_ = roots.openFile(name);
+
+    struct stat st;
+
+    if (fd_ < 0 || ::fstat(fd_, &st) < 0)
+    {
+        LOG_ERROR("Can't open file for download", name);
+        return false;
+    }
+
+    base_   = 0;
+    length_ = st.st_size;
+    return select(0, 0);
+}
+
+bool DownloadSource::openObject(SegmentStore &segments, uint64_t id)
+{
+    SegmentStore::Location location;
+    fd_ = segments.open(id, location);
+
+    if (fd_ < 0)
+    {
+        LOG_ERROR("Can't open object for download", id);
+        return false;
+    }
+
+    base_   = location.offset;
+    length_ = location.length;
+    return select(0, 0);
+}
+
+bool DownloadSource::select(uint64_t offset, uint64_t length)
+{
+    if (offset > length_ || length > length_ - offset) return false;
+
+    from_ = offset;
+    size_ = length ? length : length_ - offset;
+    return true;
+}
+
+int DownloadSource::fd() const
+{
+    return fd_;
+}
+
+uint64_t DownloadSource::size() const
+{
+    return size_;
+}
+
+uint64_t DownloadSource::position(uint64_t pos) const
+{
+    return base_ + from_ + pos;
+}
+
+bool DownloadSource::digest(uint64_t pos, size_t size, uint32_t &crc) const
+{
+    if (size == 0)
+    {
+        crc = 0;
+        return true;
+    }
+
+    // mmap принимает только смещение, кратное странице. Сервер файлы не укорачивает, так что SIGBUS за концом не будет
+    static const uint64_t page  = ::sysconf(_SC_PAGESIZE);
+    auto                  start = position(pos);
+    auto                  head  = start % page;
+
+    // Страницы блока вносятся в отображение одним вызовом, а не по одному page fault на страницу
+    auto addr = ::mmap(nullptr, head + size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd_, start - head);
+
+    if (addr == MAP_FAILED)
+    {
+        LOG_ERROR("Can't map file for download", std::strerror(errno));
+        return false;
+    }
+
+    crc = DatatPackage::checksum(static_cast< const uint8_t * >(addr) + head, size);
+    ::munmap(addr, head + size);
+    return true;
+}
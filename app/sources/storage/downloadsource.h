@@ -0,0 +1,67 @@
+#ifndef DOWNLOADSOURCE_H
+#define DOWNLOADSOURCE_H
+#include "segmentstore.h"
+#include "storageroots.h"
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Откуда сервер отдаёт файл клиенту: принятый файл или объект в сегменте, и запрошенный участок.
+ * Данные уходят в сокет через sendfile, контрольная сумма блока считается по отображению файла в память,
+ * так что байты файла не копируются в буферы процесса
+ */
+class DownloadSource
+{
+  public:
+    DownloadSource() = default;
+    ~DownloadSource();
+
+    DownloadSource(const DownloadSource&)            = delete;
+    DownloadSource& operator=(const DownloadSource&) = delete;
+
+    /**
+     * @brief Открывает принятый файл по имени
+     */
+    bool openFile(const StorageRoots& roots, const std::string& name);
+
+    /**
+     * @brief Открывает объект по номеру: дескриптор его сегмента и место объекта в нём
+     */
+    bool openObject(SegmentStore& segments, uint64_t id);
+
+    /**
+     * @brief Ограничивает передачу участком [offset, offset + length)
+     * @param Начало участка от начала файла или объекта
+     * @param Длина участка, 0 - до конца
+     * @return false если участок выходит за конец
+     */
+    bool select(uint64_t offset, uint64_t length);
+
+    int fd() const;
+
+    /**
+     * @brief Сколько байт передать
+     */
+    uint64_t size() const;
+
+    /**
+     * @brief Смещение в дескрипторе байта pos передаваемого участка
+     */
+    uint64_t position(uint64_t pos) const;
+
+    /**
+     * @brief Считает контрольную сумму size байт участка начиная с pos, читая их прямо из страничного кэша
+     * @return false если файл не удалось отобразить
+     */
+    bool digest(uint64_t pos, size_t size, uint32_t& crc) const;
+
+  private:
+    int      fd_ { -1 };
+    uint64_t base_ { 0 };    ///< Где в дескрипторе начинается файл: для объекта - его смещение в сегменте
+    uint64_t length_ { 0 };  ///< Размер файла или объекта
+    uint64_t from_ { 0 };    ///< Начало участка от base_
+    uint64_t size_ { 0 };
+};
+
+#endif  // DOWNLOADSOURCE_H
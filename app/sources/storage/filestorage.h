@@ -0,0 +1,64 @@
+#ifndef FILESTORAGE_H
+#define FILESTORAGE_H
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+/**
+ * @brief Куда сессии пишут принятые данные. Один объект на реактор, вызывается только из его потока.
+ * Запись идёт по явному смещению, так что порядок завершения записей не важен
+ */
+class FileStorage
+{
+  public:
+    /**
+     * @brief Вызывается в потоке event loop, когда запись завершилась, true - записано полностью
+     */
+    using Completion = std::function< void(bool) >;
+
+    enum class Result
+    {
+        FAILED,   ///< Запись не выполнена, обработчик завершения не вызывается
+        DONE,     ///< Данные уже записаны, обработчик завершения не вызывается
+        PENDING,  ///< Запись принята, обработчик завершения будет вызван позже
+    };
+
+    FileStorage()          = default;
+    virtual ~FileStorage() = default;
+
+    FileStorage(const FileStorage&)            = delete;
+    FileStorage& operator=(const FileStorage&) = delete;
+
+    /**
+     * @brief Пишет данные в файл
+     * @param Файловый дескриптор, должен оставаться открытым пока не вызван обработчик или forget()
+     * @param Смещение в файле
+     * @param Данные, копируются до возврата из функции
+     * @param Размер данных
+     * @param Владелец записи, по нему forget() отменяет обработчики
+     * @param Обработчик завершения для Result::PENDING
+     */
+    virtual Result write(int fd, uint64_t offset, const uint8_t* data, size_t size, const void* owner, Completion done) = 0;
+
+    /**
+     * @brief Дожидается, пока все записи владельца, принятые раньше, не попадут в файл.
+     * Хранилища, которые не откладывают записи, завершают его сразу
+     * @return FAILED если какая-то из записей не удалась, для PENDING результат придёт в обработчик
+     */
+    virtual Result flush(int, const void*, Completion) { return Result::DONE; }
+
+    /**
+     * @brief Забывает записи владельца: ещё не начатые отменяются, обработчики начатых не будут вызваны.
+     * После возврата дескриптор можно закрывать
+     */
+    virtual void forget(const void* owner) = 0;
+
+    /**
+     * @brief Не задерживая event loop, дожидается записи диапазона файла на диск и, если drop, выбрасывает его
+     * страницы из кэша. Результат не сообщается, дескриптор можно закрывать сразу после возврата
+     * @return false если хранилище этого не умеет, тогда ожидание нужно отдать другому потоку
+     */
+    virtual bool settle(int, uint64_t, uint64_t, bool) { return false; }
+};
+
+#endif  // FILESTORAGE_H
@@ -0,0 +1,156 @@
+#include "groupcommit.h"
+#include "../logger/logger.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+GroupCommit::GroupCommit(Durability mode, int intervalMs) :
+    mode_ { mode },
+    intervalMs_ { std::max(1, intervalMs) },
+    thread_ { &GroupCommit::run, this }
+{
+}
+
+GroupCommit::~GroupCommit()
+{
+    stop();
+}
+
+void GroupCommit::stop()
+{
+    {
+        std::lock_guard< std::mutex > lock(mutex_);
+        stop_ = true;
+    }
+
+    wake_.notify_one();
+    if (thread_.joinable()) thread_.join();
+
+    // Event loop'ы к этому моменту остановлены, сбрасывать оставшиеся файлы уже некому ждать
+    std::lock_guard< std::mutex > lock(mutex_);
+
+    for (auto &request : queue_)
+    {
+        ::close(request.fd);
+        if (request.after >= 0) ::close(request.after);
+    }
+
+    queue_.clear();
+    pending_.clear();
+}
+
+uint64_t GroupCommit::sync(int fd, EventLoop &loop, Completion done, int after)
+{
+    auto dup      = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    auto dupAfter = after >= 0 && dup >= 0 ? ::fcntl(after, F_DUPFD_CLOEXEC, 0) : -1;
+
+    if (dup < 0 || (after >= 0 && dupAfter < 0))
+    {
+        LOG_ERROR("Can't duplicate file descriptor:", std::strerror(errno));
+        if (dup >= 0) ::close(dup);
+        return 0;
+    }
+
+    uint64_t ticket = 0;
+
+    {
+        std::lock_guard< std::mutex > lock(mutex_);
+        ticket = nextTicket_++;
+        queue_.push_back({ ticket, dup, dupAfter, &loop });
+        pending_.emplace(ticket, std::move(done));
+    }
+
+    if (mode_ == Durability::ON_COMPLETE) wake_.notify_one();
+    return ticket;
+}
+
+void GroupCommit::cancel(uint64_t ticket)
+{
+    std::lock_guard< std::mutex > lock(mutex_);
+    pending_.erase(ticket);
+}
+
+void GroupCommit::run()
+{
+    std::vector< Request > batch;
+    auto                   interval = std::chrono::milliseconds(intervalMs_);
+    auto                   deadline = std::chrono::steady_clock::now() + interval;
+
+    while (true)
+    {
+        {
+            std::unique_lock< std::mutex > lock(mutex_);
+
+            if (mode_ == Durability::PERIODIC)
+            {
+                wake_.wait_until(lock, deadline, [this] { return stop_; });
+                deadline = std::chrono::steady_clock::now() + interval;
+            }
+            else
+            {
+                wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            }
+
+            if (stop_) return;
+
+            batch.swap(queue_);
+        }
+
+        if (!batch.empty()) commit(batch);
+        batch.clear();
+    }
+}
+
+void GroupCommit::commit(std::vector< Request > &batch)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // Запускаем запись всех файлов, не дожидаясь её: устройство получает одну большую очередь вместо череды мелких
+    for (auto &request : batch)
+    {
+        ::sync_file_range(request.fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+    }
+
+    for (auto &request : batch)
+    {
+        int res = 0;
+        while ((res = ::fdatasync(request.fd)) < 0 && errno == EINTR) {}
+
+        // Второй файл сбрасываем только за успешно сброшенным первым
+        if (res == 0 && request.after >= 0)
+        {
+            while ((res = ::fdatasync(request.after)) < 0 && errno == EINTR) {}
+        }
+
+        bool ok = res == 0;
+        if (!ok) LOG_ERROR("Can't sync file:", std::strerror(errno));
+
+        ::close(request.fd);
+        if (request.after >= 0) ::close(request.after);
+
+        auto ticket = request.ticket;
+        request.loop->post([this, ticket, ok] { finish(ticket, ok); });
+    }
+
+    auto ms = std::chrono::duration_cast< std::chrono::milliseconds >(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("Synced", batch.size(), "files in", ms, "ms");
+}
+
+void GroupCommit::finish(uint64_t ticket, bool ok)
+{
+    Completion done;
+
+    {
+        std::lock_guard< std::mutex > lock(mutex_);
+        auto                          it = pending_.find(ticket);
+        if (it == pending_.end()) return;
+
+        done = std::move(it->second);
+        pending_.erase(it);
+    }
+
+    done(ok);
+}
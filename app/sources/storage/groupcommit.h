@@ -0,0 +1,94 @@
+#ifndef GROUPCOMMIT_H
+#define GROUPCOMMIT_H
+#include "../event_loop/eventloop.h"
+#include "../server/serverconfig.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Общий для всех реакторов поток, сбрасывающий принятые файлы на диск пачками.
+ * Для всех файлов пачки сначала запускается запись страниц (sync_file_range), и только потом каждый ждёт fdatasync,
+ * так что устройство получает данные всех файлов разом, а коммит журнала файловой системы достаётся сразу нескольким.
+ * В режиме ON_COMPLETE пачку составляют файлы, пришедшие пока сбрасывалась предыдущая, в режиме PERIODIC - все файлы,
+ * пришедшие за интервал
+ */
+class GroupCommit
+{
+  public:
+    /**
+     * @brief Вызывается в потоке event loop, который попросил сброс, true - данные на диске
+     */
+    using Completion = std::function< void(bool) >;
+
+    /**
+     * @param Режим, Durability::NONE не используется
+     * @param Интервал между пачками в режиме PERIODIC, мс
+     */
+    GroupCommit(Durability mode, int intervalMs);
+    ~GroupCommit();
+
+    GroupCommit(const GroupCommit&)            = delete;
+    GroupCommit& operator=(const GroupCommit&) = delete;
+
+    /**
+     * @brief Ставит файл в следующую пачку
+     * @param Дескриптор файла, дублируется, так что его можно закрыть не дожидаясь сброса
+     * @param Event loop, в потоке которого вызывается обработчик
+     * @param Обработчик завершения
+     * @param Файл, который сбрасывается только после первого, -1 - нет такого. Например индекс, указывающий на данные
+     * первого файла: на диске он не должен опережать данные. Тоже дублируется
+     * @return Номер запроса для cancel(), 0 если файл не удалось поставить в очередь
+     */
+    uint64_t sync(int fd, EventLoop& loop, Completion done, int after = -1);
+
+    /**
+     * @brief Отменяет обработчик запроса, вызывается из того же event loop. Сам сброс всё равно выполняется
+     */
+    void cancel(uint64_t ticket);
+
+    /**
+     * @brief Останавливает поток сброса: дожидается текущей пачки, а ещё не начатые запросы отбрасывает без обработчиков.
+     * После возврата поток больше не обращается к event loop'ам, так что их можно удалять. Повторный вызов ничего не делает
+     */
+    void stop();
+
+  private:
+    struct Request
+    {
+        uint64_t   ticket;
+        int        fd;
+        int        after;  ///< Сбрасывается после fd, -1 - нет
+        EventLoop* loop;
+    };
+
+    void run();
+
+    /**
+     * @brief Сбрасывает пачку на диск и возвращает результаты в event loop'ы
+     */
+    void commit(std::vector< Request >& batch);
+
+    /**
+     * @brief Результат сброса пришёл в event loop
+     */
+    void finish(uint64_t ticket, bool ok);
+
+  private:
+    const Durability                           mode_;
+    const int                                  intervalMs_;
+    std::mutex                                 mutex_;
+    std::condition_variable                    wake_;
+    bool                                       stop_ { false };
+    uint64_t                                   nextTicket_ { 1 };
+    std::vector< Request >                     queue_;
+    std::unordered_map< uint64_t, Completion > pending_;  ///< Обработчики ещё не завершённых запросов
+    std::thread                                thread_;   ///< Объявлен последним: запускается, когда остальное готово
+};
+
+#endif  // GROUPCOMMIT_H
@@ -0,0 +1,493 @@
+#include "segmentstore.h"
+#include "../logger/logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(SegmentStore::Location) == 16, "Index entry layout is part of the file format");
+
+namespace
+{
+    bool writeAll(int fd, const uint8_t *data, size_t size, uint64_t offset)
+    {
+        while (size > 0)
+        {
+            auto res = ::pwrite(fd, data, size, offset);
+
+            if (res < 0 && errno == EINTR) continue;
+            if (res <= 0) return false;
+
+            data += res;
+            size -= res;
+            offset += res;
+        }
+
+        return true;
+    }
+
+    bool readAll(int fd, uint8_t *data, size_t size, uint64_t offset)
+    {
+        while (size > 0)
+        {
+            auto res = ::pread(fd, data, size, offset);
+
+            if (res < 0 && errno == EINTR) continue;
+            if (res <= 0) return false;
+
+            data += res;
+            size -= res;
+            offset += res;
+        }
+
+        return true;
+    }
+}  // namespace
+
+SegmentStore::SegmentStore(std::string dir, size_t objectLimit) :
+    dir_ { std::move(dir) },
+    objectLimit_ { std::min< size_t >(objectLimit, UINT32_MAX) }
+{
+}
+
+SegmentStore::~SegmentStore()
+{
+    if (compactor_.joinable())
+    {
+        {
+            std::lock_guard< std::mutex > lock(mutex_);
+            stop_ = true;
+        }
+
+        wake_.notify_one();
+        compactor_.join();
+    }
+
+    for (auto &[number, segment] : segments_)
+    {
+        ::close(segment.fd);
+    }
+
+    if (header_) ::munmap(header_, indexSize_);
+    if (indexFd_ >= 0) ::close(indexFd_);
+}
+
+bool SegmentStore::init()
+{
+    if (::mkdir(dir_.c_str(), 0755) < 0 && errno != EEXIST)
+    {
+        LOG_ERROR("Can't create segment store at", dir_, std::strerror(errno));
+        return false;
+    }
+
+    auto indexPath = dir_ + "/index";
+    indexFd_       = ::open(indexPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    struct stat st;
+
+    if (indexFd_ < 0 || ::fstat(indexFd_, &st) < 0)
+    {
+        LOG_ERROR("Can't open segment index", indexPath, std::strerror(errno));
+        return false;
+    }
+
+    bool fresh = st.st_size == 0;
+    auto size  = fresh ? sizeof(Header) + initialEntries_ * sizeof(Location) : size_t(st.st_size);
+
+    if (fresh && ::ftruncate(indexFd_, size) < 0)
+    {
+        LOG_ERROR("Can't size segment index", std::strerror(errno));
+        return false;
+    }
+
+    if (!mapIndex(size)) return false;
+
+    if (fresh)
+    {
+        std::memcpy(header_->magic, magic_, sizeof(magic_));
+        header_->nextSegment = 1;
+    }
+    else if (std::memcmp(header_->magic, magic_, sizeof(magic_)) != 0 || size < sizeof(Header))
+    {
+        LOG_ERROR("File", indexPath, "is not a segment index");
+        return false;
+    }
+
+    // Сегменты ищем по каталогу, а не по индексу: в сегменте могут быть только удалённые объекты
+    if (auto dir = ::opendir(dir_.c_str()))
+    {
+        bool ok = true;
+
+        while (auto item = ::readdir(dir))
+        {
+            unsigned number = 0;
+            char     tail   = 0;
+
+            if (std::sscanf(item->d_name, "%u.seg%c", &number, &tail) != 1 || number == 0) continue;
+
+            ok = openSegment(number, false);
+            if (!ok) break;
+        }
+
+        ::closedir(dir);
+        if (!ok) return false;
+    }
+
+    // Запись индекса могла дойти до диска раньше данных объекта: такие объекты считаем потерянными
+    size_t lost = 0;
+
+    for (uint64_t i = 0; i < header_->count; i++)
+    {
+        auto &location = entries_[i];
+        if (location.segment == 0) continue;
+
+        auto segment = segments_.find(location.segment);
+
+        if (segment == segments_.end() || location.offset + location.length > segment->second.size)
+        {
+            location = {};
+            lost++;
+            continue;
+        }
+
+        segment->second.live += location.length;
+    }
+
+    if (lost > 0) LOG_WARN("Segment store lost", lost, "objects that were not fully written");
+
+    // Дописываем в последний сегмент, пока он не заполнен, иначе каждый перезапуск оставлял бы по недописанному сегменту
+    if (!segments_.empty() && segments_.rbegin()->second.size < segmentSize_)
+    {
+        active_ = segments_.rbegin()->first;
+    }
+    else if (!openSegment(header_->nextSegment++, true))
+    {
+        return false;
+    }
+
+    LOG_INFO("Segment store at", dir_, ":", header_->count, "ids issued,", segments_.size(), "segments");
+
+    compactor_ = std::thread(&SegmentStore::run, this);
+    return true;
+}
+
+size_t SegmentStore::objectLimit() const
+{
+    return objectLimit_;
+}
+
+uint64_t SegmentStore::append(const uint8_t *data, size_t size)
+{
+    if (size > objectLimit_) return 0;
+
+    Location location;
+    uint64_t id = 0;
+    int      fd = -1;
+
+    {
+        std::lock_guard< std::mutex > lock(mutex_);
+
+        id = nextId();
+        if (id == 0 || !reserve(size, location, fd)) return 0;
+    }
+
+    // Место выдано, пишем без блокировки: сегмент не уплотняется, пока в него пишут
+    bool ok = writeAll(fd, data, size, location.offset);
+
+    std::lock_guard< std::mutex > lock(mutex_);
+
+    auto &segment = segments_[location.segment];
+    segment.writers--;
+
+    if (!ok)
+    {
+        LOG_ERROR("Can't write object to segment", location.segment, std::strerror(errno));
+        return 0;
+    }
+
+    // Объект становится видим только теперь, когда данные уже в сегменте
+    segment.live += size;
+    entries_[id - 1] = location;
+    return id;
+}
+
+std::optional< SegmentStore::Location > SegmentStore::lookup(uint64_t id)
+{
+    std::lock_guard< std::mutex > lock(mutex_);
+
+    auto location = entry(id);
+    if (location.segment == 0) return std::nullopt;
+
+    return location;
+}
+
+bool SegmentStore::read(uint64_t id, std::vector< uint8_t > &data)
+{
+    std::lock_guard< std::mutex > lock(mutex_);
+
+    auto location = entry(id);
+    if (location.segment == 0) return false;
+
+    data.resize(location.length);
+    return readAll(segments_[location.segment].fd, data.data(), location.length, location.offset);
+}
+
+int SegmentStore::open(uint64_t id, Location &location)
+{
+    std::lock_guard< std::mutex > lock(mutex_);
+
+    location = entry(id);
+    if (location.segment == 0) return -1;
+
+    return ::fcntl(segments_[location.segment].fd, F_DUPFD_CLOEXEC, 0);
+}
+
+bool SegmentStore::remove(uint64_t id)
+{
+    std::lock_guard< std::mutex > lock(mutex_);
+
+    auto location = entry(id);
+    if (location.segment == 0) return false;
+
+    auto &segment = segments_[location.segment];
+    segment.live -= location.length;
+    entries_[id - 1] = {};
+
+    if (location.segment != active_ && segment.live * 2 < segment.size)
+    {
+        compactWanted_ = true;
+        wake_.notify_one();
+    }
+
+    return true;
+}
+
+uint64_t SegmentStore::sync(uint64_t id, GroupCommit &commit, EventLoop &loop, GroupCommit::Completion done)
+{
+    std::lock_guard< std::mutex > lock(mutex_);
+
+    auto location = entry(id);
+    if (location.segment == 0) return 0;
+
+    // Объект найдётся после перезапуска, только если на диске и данные, и запись индекса. Индекс отображён с MAP_SHARED,
+    // fdatasync его дескриптора сбрасывает и изменённые через отображение страницы. GroupCommit дублирует дескрипторы,
+    // так что уплотнение может закрыть сегмент, не дожидаясь сброса
+    return commit.sync(segments_[location.segment].fd, loop, std::move(done), indexFd_);
+}
+
+bool SegmentStore::reserve(uint32_t size, Location &location, int &fd)
+{
+    if (segments_[active_].size + size > segmentSize_)
+    {
+        if (!openSegment(header_->nextSegment++, true)) return false;
+    }
+
+    auto &segment = segments_[active_];
+
+    location = { active_, size, segment.size };
+    fd       = segment.fd;
+
+    segment.size += size;
+    segment.writers++;
+    return true;
+}
+
+uint64_t SegmentStore::nextId()
+{
+    size_t capacity = (indexSize_ - sizeof(Header)) / sizeof(Location);
+
+    if (header_->count == capacity)
+    {
+        auto size = sizeof(Header) + capacity * 2 * sizeof(Location);
+
+        if (::ftruncate(indexFd_, size) < 0)
+        {
+            LOG_ERROR("Can't grow segment index", std::strerror(errno));
+            return 0;
+        }
+
+        auto addr = ::mremap(header_, indexSize_, size, MREMAP_MAYMOVE);
+
+        if (addr == MAP_FAILED)
+        {
+            LOG_ERROR("Can't remap segment index", std::strerror(errno));
+            return 0;
+        }
+
+        header_    = static_cast< Header * >(addr);
+        entries_   = reinterpret_cast< Location * >(header_ + 1);
+        indexSize_ = size;
+    }
+
+    return ++header_->count;
+}
+
+bool SegmentStore::openSegment(uint32_t number, bool create)
+{
+    auto path = segmentPath(number);
+    int  fd   = ::open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0), 0644);
+
+    struct stat st;
+
+    if (fd < 0 || ::fstat(fd, &st) < 0)
+    {
+        LOG_ERROR("Can't open segment", path, std::strerror(errno));
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+
+    auto &segment = segments_[number];
+    segment.fd    = fd;
+    segment.size  = st.st_size;
+
+    if (number >= header_->nextSegment) header_->nextSegment = number + 1;
+    if (create) active_ = number;
+    return true;
+}
+
+bool SegmentStore::mapIndex(size_t size)
+{
+    auto addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, indexFd_, 0);
+
+    if (addr == MAP_FAILED)
+    {
+        LOG_ERROR("Can't map segment index", std::strerror(errno));
+        return false;
+    }
+
+    header_    = static_cast< Header * >(addr);
+    entries_   = reinterpret_cast< Location * >(header_ + 1);
+    indexSize_ = size;
+    return true;
+}
+
+SegmentStore::Location SegmentStore::entry(uint64_t id) const
+{
+    if (id == 0 || id > header_->count) return {};
+    return entries_[id - 1];
+}
+
+void SegmentStore::run()
+{
+    while (true)
+    {
+        std::vector< uint32_t > victims;
+
+        {
+            std::unique_lock< std::mutex > lock(mutex_);
+            wake_.wait_for(lock, std::chrono::milliseconds(compactIntervalMs_), [this] { return stop_ || compactWanted_; });
+
+            if (stop_) return;
+            compactWanted_ = false;
+
+            for (auto &[number, segment] : segments_)
+            {
+                if (number == active_ || segment.writers > 0) continue;
+                if (segment.live * 2 < segment.size || segment.live == 0) victims.push_back(number);
+            }
+        }
+
+        for (auto number : victims)
+        {
+            compact(number);
+        }
+    }
+}
+
+void SegmentStore::compact(uint32_t number)
+{
+    std::vector< uint8_t > data;
+    std::set< uint32_t >   written;  ///< Сегменты, в которые переехали объекты
+    size_t                 moved = 0;
+    uint64_t               count = 0;
+
+    {
+        std::lock_guard< std::mutex > lock(mutex_);
+        count = header_->count;
+    }
+
+    for (uint64_t id = 1; id <= count; id++)
+    {
+        // Блокировка на каждый объект: приём новых объектов ждёт не дольше одного переноса
+        std::lock_guard< std::mutex > lock(mutex_);
+
+        if (stop_) return;
+
+        auto from = entries_[id - 1];
+        if (from.segment != number) continue;
+
+        Location to;
+        int      fd = -1;
+
+        data.resize(from.length);
+
+        if (!readAll(segments_[number].fd, data.data(), from.length, from.offset) || !reserve(from.length, to, fd))
+        {
+            LOG_ERROR("Can't compact segment", number, std::strerror(errno));
+            return;
+        }
+
+        bool ok = writeAll(fd, data.data(), from.length, to.offset);
+        segments_[to.segment].writers--;
+
+        if (!ok)
+        {
+            LOG_ERROR("Can't compact segment", number, std::strerror(errno));
+            return;
+        }
+
+        segments_[to.segment].live += from.length;
+        segments_[number].live -= from.length;
+        entries_[id - 1] = to;
+        written.insert(to.segment);
+        moved++;
+    }
+
+    // Старый сегмент удаляем только когда новые копии и индекс, который на них указывает, уже на диске
+    for (auto segment : written)
+    {
+        int fd = -1;
+
+        {
+            std::lock_guard< std::mutex > lock(mutex_);
+            fd = ::fcntl(segments_[segment].fd, F_DUPFD_CLOEXEC, 0);
+        }
+
+        if (fd < 0 || ::fdatasync(fd) < 0)
+        {
+            LOG_ERROR("Can't sync segment", segment, std::strerror(errno));
+            if (fd >= 0) ::close(fd);
+            return;
+        }
+
+        ::close(fd);
+    }
+
+    std::lock_guard< std::mutex > lock(mutex_);
+
+    if (::msync(header_, indexSize_, MS_SYNC) < 0)
+    {
+        LOG_ERROR("Can't sync segment index", std::strerror(errno));
+        return;
+    }
+
+    ::close(segments_[number].fd);
+    segments_.erase(number);
+    ::unlink(segmentPath(number).c_str());
+
+    LOG_INFO("Segment", number, "compacted,", moved, "objects moved");
+}
+
+std::string SegmentStore::segmentPath(uint32_t number) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%08u.seg", number);
+    return dir_ + name;
+}
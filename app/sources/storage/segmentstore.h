@@ -0,0 +1,152 @@
+#ifndef SEGMENTSTORE_H
+#define SEGMENTSTORE_H
+#include "../event_loop/eventloop.h"
+#include "groupcommit.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <set>
+#include <vector>
+
+/**
+ * @brief Хранилище мелких объектов: объекты дописываются подряд в большие файлы-сегменты, а не получают по файлу,
+ * так что миллион мелких загрузок - это несколько сегментов, а не миллион inode, записей в каталоге и сбросов метаданных.
+ *
+ * Индекс - отображённый в память файл из записей по 16 байт, номер объекта - номер записи, поиск по номеру - одно
+ * обращение к памяти. Удалённые объекты оставляют в сегментах дыры, фоновый поток переносит живые объекты из сегментов,
+ * где дыр больше половины, в текущий сегмент и удаляет старый. Общее для всех реакторов, потокобезопасно
+ */
+class SegmentStore
+{
+  public:
+    /**
+     * @brief Где лежит объект. Это же запись индекса на диске
+     */
+    struct Location
+    {
+        uint32_t segment { 0 };  ///< Номер сегмента, 0 - объекта нет
+        uint32_t length { 0 };
+        uint64_t offset { 0 };
+    };
+
+    /**
+     * @param Каталог для сегментов и индекса, создаётся если его нет
+     * @param Загрузки не больше этого размера в байтах сохраняются как объекты
+     */
+    SegmentStore(std::string dir, size_t objectLimit);
+    ~SegmentStore();
+
+    SegmentStore(const SegmentStore&)            = delete;
+    SegmentStore& operator=(const SegmentStore&) = delete;
+
+    /**
+     * @brief Открывает индекс и сегменты, запускает уплотнение
+     * @return false если каталог или индекс недоступны
+     */
+    bool init();
+
+    size_t objectLimit() const;
+
+    /**
+     * @brief Дописывает объект в текущий сегмент. Запись идёт без блокировки, одновременно могут писать многие потоки
+     * @return Номер объекта, 0 в случае ошибки
+     */
+    uint64_t append(const uint8_t* data, size_t size);
+
+    /**
+     * @return Где лежит объект, пусто если его нет
+     */
+    std::optional< Location > lookup(uint64_t id);
+
+    /**
+     * @brief Читает объект целиком
+     */
+    bool read(uint64_t id, std::vector< uint8_t >& data);
+
+    /**
+     * @brief Открывает объект для отправки прямо из сегмента (sendfile)
+     * @param Куда положить расположение объекта в сегменте
+     * @return Копия дескриптора сегмента, -1 если объекта нет. Копия остаётся годной, даже если уплотнение
+     * перенесёт объект и удалит сегмент
+     */
+    int open(uint64_t id, Location& location);
+
+    /**
+     * @brief Удаляет объект из индекса, место в сегменте освобождает уплотнение
+     */
+    bool remove(uint64_t id);
+
+    /**
+     * @brief Ставит сегмент объекта, а за ним индекс, в очередь на сброс на диск (GroupCommit::sync)
+     * @return Номер запроса, 0 в случае ошибки
+     */
+    uint64_t sync(uint64_t id, GroupCommit& commit, EventLoop& loop, GroupCommit::Completion done);
+
+  private:
+    struct Header
+    {
+        char     magic[8];
+        uint64_t count;        ///< Сколько номеров выдано
+        uint32_t nextSegment;  ///< Номер следующего сегмента
+        uint32_t reserved;
+        uint64_t padding;
+    };
+
+    struct Segment
+    {
+        int      fd { -1 };
+        uint64_t size { 0 };     ///< Сколько байт выдано под объекты
+        uint64_t live { 0 };     ///< Сколько из них занято неудалёнными объектами
+        size_t   writers { 0 };  ///< Сколько объектов пишется в сегмент прямо сейчас
+    };
+
+    /**
+     * @brief Выдаёт место под объект в текущем сегменте, заполненный сегмент сменяется новым. Под mutex_
+     */
+    bool reserve(uint32_t size, Location& location, int& fd);
+
+    /**
+     * @brief Выдаёт номер для нового объекта, при необходимости увеличивает индекс. Под mutex_
+     */
+    uint64_t nextId();
+
+    bool     openSegment(uint32_t number, bool create);
+    bool     mapIndex(size_t size);
+    Location entry(uint64_t id) const;
+
+    void run();
+
+    /**
+     * @brief Переносит живые объекты сегмента в текущий и удаляет его
+     */
+    void compact(uint32_t number);
+
+    std::string segmentPath(uint32_t number) const;
+
+  private:
+    inline static const char     magic_[8] = { 'D', 'T', 'S', 'E', 'G', 'I', 'D', 'X' };
+    inline static const uint64_t segmentSize_ { 256 * 1024 * 1024 };  ///< После этого размера начинается новый сегмент
+    inline static const size_t   initialEntries_ { 64 * 1024 };
+    inline static const int      compactIntervalMs_ { 10000 };
+
+    const std::string                 dir_;
+    const size_t                      objectLimit_;
+    std::mutex                        mutex_;
+    std::condition_variable           wake_;
+    bool                              stop_ { false };
+    bool                              compactWanted_ { false };
+    int                               indexFd_ { -1 };
+    size_t                            indexSize_ { 0 };
+    Header*                           header_ { nullptr };   ///< Начало отображения индекса
+    Location*                         entries_ { nullptr };  ///< Запись объекта с номером id - entries_[id - 1]
+    uint32_t                          active_ { 0 };         ///< Сегмент, в который дописываются объекты
+    std::map< uint32_t, Segment >     segments_;
+    std::thread                       compactor_;
+};
+
+#endif  // SEGMENTSTORE_H
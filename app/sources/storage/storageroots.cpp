@@ -0,0 +1,222 @@
+#include "storageroots.h"
+#include "../helpers/helpers.h"
+#include "../logger/logger.h"
+#include "diskledger.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    /**
+     * @brief Имя вида 19-10-2026_02:31:41.155[_n].hex, какие сервер даёт принятым файлам (Session::openFile)
+     */
+    bool isUploadName(const std::string &name)
+    {
+        const std::string_view stamp  = "00-00-0000_00:00:00.000";
+        const std::string_view suffix = ".hex";
+
+        if (name.size() < stamp.size() + suffix.size() || !name.ends_with(suffix)) return false;
+
+        for (size_t i = 0; i < stamp.size(); i++)
+        {
+            bool ok = stamp[i] == '0' ? std::isdigit(static_cast< unsigned char >(name[i])) : name[i] == stamp[i];
+            if (!ok) return false;
+        }
+
+        auto counter = std::string_view(name).substr(stamp.size(), name.size() - stamp.size() - suffix.size());
+        if (counter.empty()) return true;
+
+        return counter.size() > 1 && counter.size() <= 3 && counter[0] == '_' &&
+               std::all_of(counter.begin() + 1, counter.end(), [](char c) { return std::isdigit(static_cast< unsigned char >(c)); });
+    }
+}  // namespace
+
+StorageRoots::StorageRoots(std::vector< std::string > paths, size_t depthLimit, size_t writersPerDevice, std::vector< int > writerCpus) :
+    depthLimit_ { depthLimit },
+    writersPerDevice_ { writersPerDevice },
+    writerCpus_ { std::move(writerCpus) }
+{
+    if (paths.empty()) paths.push_back(helpers::getDir(helpers::pathToExec()));
+
+    for (auto &path : paths)
+    {
+        roots_.push_back({ std::move(path) });
+    }
+}
+
+bool StorageRoots::init()
+{
+    for (auto &root : roots_)
+    {
+        struct stat st;
+
+        if (::stat(root.path.c_str(), &st) < 0)
+        {
+            LOG_ERROR("Can't stat storage root", root.path, std::strerror(errno));
+            return false;
+        }
+
+        if (!S_ISDIR(st.st_mode) || ::access(root.path.c_str(), W_OK) < 0)
+        {
+            LOG_ERROR("Storage root", root.path, "is not a writable directory");
+            return false;
+        }
+
+        root.dev = st.st_dev;
+
+        auto device = std::find_if(devices_.begin(), devices_.end(), [&](const Device &d) { return d.dev == st.st_dev; });
+
+        if (device != devices_.end())
+        {
+            LOG_WARN("Storage root", root.path, "shares a device with another root");
+            continue;
+        }
+
+        auto &added = devices_.emplace_back();
+        added.dev   = st.st_dev;
+
+        if (writersPerDevice_ > 0) added.writers = std::make_unique< ThreadPool >(writersPerDevice_, writerCpus_);
+
+        LOG_INFO("Storage root", root.path, "free", helpers::getFreeDiskSpace(root.path), "bytes");
+    }
+
+    return true;
+}
+
+int StorageRoots::place(uint64_t bytes)
+{
+    std::lock_guard< std::mutex > lock(mutex_);
+
+    // Свободное место на одну идущую загрузку: пустой диск поменьше обгоняет большой, в который уже пишут многие
+    std::vector< std::pair< double, int > > candidates;
+
+    for (size_t i = 0; i < roots_.size(); i++)
+    {
+        if (depthLimit_ > 0 && roots_[i].depth >= depthLimit_) continue;
+
+        auto free = double(helpers::getFreeDiskSpace(roots_[i].path));
+        candidates.emplace_back(free / (roots_[i].depth + 1), int(i));
+    }
+
+    std::sort(candidates.begin(), candidates.end(), std::greater<>());
+
+    for (auto [score, i] : candidates)
+    {
+        if (!DiskLedger::getInstance().reserve(roots_[i].path, bytes)) continue;
+
+        roots_[i].depth++;
+        return i;
+    }
+
+    LOG_ERROR("No storage root can take", bytes, "bytes");
+    return -1;
+}
+
+void StorageRoots::leave(int root)
+{
+    std::lock_guard< std::mutex > lock(mutex_);
+    if (root >= 0 && size_t(root) < roots_.size() && roots_[root].depth > 0) roots_[root].depth--;
+}
+
+const std::string &StorageRoots::path(int root) const
+{
+    return roots_[root].path;
+}
+
+void StorageRoots::beginUpload(const std::string &name)
+{
+    std::lock_guard< std::mutex > lock(mutex_);
+    uploading_.insert(name);
+}
+
+void StorageRoots::endUpload(const std::string &name)
+{
+    std::lock_guard< std::mutex > lock(mutex_);
+
+    auto it = uploading_.find(name);
+    if (it != uploading_.end()) uploading_.erase(it);
+}
+
+int StorageRoots::openFile(const std::string &name) const
+{
+    // Имя приходит от клиента: отдаём только принятые файлы, а не всё, что лежит в каталоге. По умолчанию это
+    // каталог программы, там лежит и она сама
+    if (!isUploadName(name)) return -1;
+
+    {
+        std::lock_guard< std::mutex > lock(mutex_);
+        if (uploading_.count(name) > 0) return -1;
+    }
+
+    for (const auto &root : roots_)
+    {
+        // O_NONBLOCK: на месте файла может оказаться FIFO, открытие которого ждало бы писателя
+        int fd = ::open((root.path + "/" + name).c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK | O_NOFOLLOW);
+        if (fd < 0) continue;
+
+        struct stat st;
+
+        if (::fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+        {
+            ::close(fd);
+            return -1;
+        }
+
+        return fd;
+    }
+
+    return -1;
+}
+
+ThreadPool *StorageRoots::writersFor(int fd) const
+{
+    struct stat st;
+    if (::fstat(fd, &st) < 0) return nullptr;
+
+    for (const auto &device : devices_)
+    {
+        if (device.dev == st.st_dev) return device.writers.get();
+    }
+
+    return nullptr;
+}
+
+bool StorageRoots::settle(int fd, uint64_t offset, uint64_t size, bool drop) const
+{
+    auto writers = writersFor(fd);
+    if (!writers) return false;
+
+    // Свой дескриптор: сессия может закрыть файл раньше, чем поток записи до него дойдёт
+    int copy = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+
+    if (copy < 0)
+    {
+        LOG_WARN("Can't duplicate file descriptor:", std::strerror(errno));
+        return false;
+    }
+
+    writers->post([copy, offset, size, drop]() {
+        auto flags = SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER;
+
+        if (::sync_file_range(copy, offset, size, flags) < 0)
+        {
+            LOG_WARN("Can't wait for writeback:", std::strerror(errno));
+        }
+        else if (drop)
+        {
+            ::posix_fadvise(copy, offset, size, POSIX_FADV_DONTNEED);
+        }
+
+        ::close(copy);
+    });
+
+    return true;
+}
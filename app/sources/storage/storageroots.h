@@ -0,0 +1,104 @@
+#ifndef STORAGEROOTS_H
+#define STORAGEROOTS_H
+#include "../thread_pool/threadpool.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+/**
+ * @brief Каталоги, по которым сервер раскладывает принятые файлы, обычно по одному на диск. Общие для всех реакторов.
+ * Новая загрузка попадает в каталог с наибольшим свободным местом в расчёте на одну уже идущую в нём загрузку,
+ * так что и место, и нагрузка расходятся по дискам. У каждого устройства свои потоки записи для режима writeBehind
+ * и ожидания записи страничного кэша, медленный диск не задерживает запись на остальные
+ */
+class StorageRoots
+{
+  public:
+    /**
+     * @param Каталоги, пусто - каталог программы
+     * @param Сколько загрузок одновременно принимает каталог, 0 - без ограничения
+     * @param Сколько потоков записи завести на каждое устройство, 0 - не заводить
+     * @param Ядра, к которым по кругу привязываются потоки записи, пусто - без привязки
+     */
+    StorageRoots(std::vector< std::string > paths, size_t depthLimit, size_t writersPerDevice, std::vector< int > writerCpus = {});
+
+    StorageRoots(const StorageRoots&)            = delete;
+    StorageRoots& operator=(const StorageRoots&) = delete;
+
+    /**
+     * @brief Проверяет каталоги и заводит потоки записи
+     * @return false если какой-то каталог недоступен для записи
+     */
+    bool init();
+
+    /**
+     * @brief Выбирает каталог для новой загрузки и резервирует в нём место в DiskLedger
+     * @return Номер каталога, -1 если места или свободных очередей нет нигде
+     */
+    int place(uint64_t bytes);
+
+    /**
+     * @brief Загрузка в каталоге закончилась, резерв в DiskLedger возвращает сама сессия
+     */
+    void leave(int root);
+
+    const std::string& path(int root) const;
+
+    /**
+     * @brief Загрузка в файл с этим именем началась: пока не вызван endUpload(), openFile() его не отдаёт
+     */
+    void beginUpload(const std::string& name);
+
+    void endUpload(const std::string& name);
+
+    /**
+     * @brief Открывает на чтение принятый файл, ищет его во всех каталогах
+     * @param Имя файла без каталога, как его сообщил сервер в FILE_SAVED
+     * @return Дескриптор, -1 если имя не из тех, что даёт сервер, файл ещё принимается, не обычный файл
+     * или его нет ни в одном каталоге
+     */
+    int openFile(const std::string& name) const;
+
+    /**
+     * @brief Потоки записи устройства, на котором лежит файл
+     * @return nullptr если потоки не заводились или файл лежит не в одном из каталогов
+     */
+    ThreadPool* writersFor(int fd) const;
+
+    /**
+     * @brief В потоке записи устройства дожидается, пока диапазон файла не запишется на диск, и в режиме drop
+     * выбрасывает его страницы из кэша. Результат не сообщается: это ограничение грязных страниц, а не сохранность
+     * @return false если у устройства нет потоков записи
+     */
+    bool settle(int fd, uint64_t offset, uint64_t size, bool drop) const;
+
+  private:
+    struct Root
+    {
+        std::string path;
+        dev_t       dev { 0 };
+        size_t      depth { 0 };  ///< Сколько загрузок сейчас идёт в каталог
+    };
+
+    struct Device
+    {
+        dev_t                         dev { 0 };
+        std::unique_ptr< ThreadPool > writers;
+    };
+
+  private:
+    const size_t                 depthLimit_;
+    const size_t                 writersPerDevice_;
+    const std::vector< int >     writerCpus_;
+    mutable std::mutex           mutex_;
+    std::vector< Root >          roots_;
+    std::vector< Device >        devices_;
+    std::multiset< std::string > uploading_;  ///< Имена файлов, в которые идёт загрузка, по всем каталогам
+};
+
+#endif  // STORAGEROOTS_H
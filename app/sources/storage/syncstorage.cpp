@@ -0,0 +1,28 @@
+#include "syncstorage.h"
+#include "../logger/logger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+FileStorage::Result SyncStorage::write(int fd, uint64_t offset, const uint8_t* data, size_t size, const void*, Completion)
+{
+    size_t written = 0;
+
+    while (written < size)
+    {
+        auto res = ::pwrite(fd, data + written, size - written, offset + written);
+
+        if (res < 0 && errno == EINTR) continue;
+
+        if (res <= 0)
+        {
+            LOG_ERROR("Can't write to file:", std::strerror(errno));
+            return Result::FAILED;
+        }
+
+        written += res;
+    }
+
+    return Result::DONE;
+}
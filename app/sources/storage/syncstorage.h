@@ -0,0 +1,15 @@
+#ifndef SYNCSTORAGE_H
+#define SYNCSTORAGE_H
+#include "filestorage.h"
+
+/**
+ * @brief Запись через pwrite прямо в потоке event loop, используется когда асинхронная запись не нужна или недоступна
+ */
+class SyncStorage : public FileStorage
+{
+  public:
+    Result write(int fd, uint64_t offset, const uint8_t* data, size_t size, const void* owner, Completion done) override;
+    void   forget(const void*) override {}
+};
+
+#endif  // SYNCSTORAGE_H
@@ -0,0 +1,312 @@
+#include "uringstorage.h"
+#include "../logger/logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+UringStorage::UringStorage(EventLoop &loop) :
+    loop_ { loop }
+{
+}
+
+UringStorage::~UringStorage()
+{
+    if (eventFd_ >= 0)
+    {
+        loop_.removeFd(eventFd_);
+        ::close(eventFd_);
+    }
+
+    // Начатые операции держат ссылку на файл сами, копии дескрипторов больше не нужны
+    for (const auto &[id, settle] : settles_)
+    {
+        ::close(settle.fd);
+    }
+}
+
+bool UringStorage::init()
+{
+    if (!ring_.init(slots_))
+    {
+        return false;
+    }
+
+    if (!ring_.supports(IORING_OP_WRITE_FIXED))
+    {
+        LOG_WARN("io_uring doesn't support fixed buffer writes");
+        return false;
+    }
+
+    canSettle_ = ring_.supports(IORING_OP_SYNC_FILE_RANGE) && ring_.supports(IORING_OP_FADVISE);
+
+    buffers_.resize(size_t(slots_) * slotSize_);
+
+    if (!ring_.registerBuffers(buffers_.data(), slots_, slotSize_))
+    {
+        return false;
+    }
+
+    eventFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (eventFd_ < 0)
+    {
+        LOG_ERROR("Can't create eventfd", std::strerror(errno));
+        return false;
+    }
+
+    if (!ring_.registerEventFd(eventFd_) || !loop_.addFd(eventFd_, EPOLLIN))
+    {
+        ::close(eventFd_);
+        eventFd_ = -1;
+        return false;
+    }
+
+    loop_.bindSlot< &UringStorage::onCompletion >(eventFd_, EPOLLIN, this);
+
+    requests_.resize(slots_);
+
+    for (uint32_t slot = slots_; slot > 0; slot--)
+    {
+        free_.push_back(slot - 1);
+    }
+
+    return true;
+}
+
+FileStorage::Result UringStorage::write(int fd, uint64_t offset, const uint8_t *data, size_t size, const void *owner, Completion done)
+{
+    if (size > slotSize_)
+    {
+        LOG_ERROR("Write of", size, "bytes doesn't fit io_uring buffer");
+        return Result::FAILED;
+    }
+
+    if (free_.empty())
+    {
+        waiting_.push_back({ fd, offset, std::vector< uint8_t >(data, data + size), owner, std::move(done) });
+        return Result::PENDING;
+    }
+
+    return start(fd, offset, data, size, owner, std::move(done)) ? Result::PENDING : Result::FAILED;
+}
+
+void UringStorage::forget(const void *owner)
+{
+    for (auto &request : requests_)
+    {
+        if (request.owner != owner) continue;
+
+        // Запись уже в ядре и держит ссылку на файл, дожидаемся её, но результат никому не нужен
+        request.owner = nullptr;
+        request.done  = nullptr;
+    }
+
+    waiting_.erase(std::remove_if(waiting_.begin(), waiting_.end(), [owner](const Waiting &w) { return w.owner == owner; }), waiting_.end());
+}
+
+bool UringStorage::settle(int fd, uint64_t offset, uint64_t size, bool drop)
+{
+    // В заявке длина 32-битная
+    if (!canSettle_ || size > std::numeric_limits< uint32_t >::max()) return false;
+
+    // Своя копия дескриптора: сессия закрывает файл, не дожидаясь ожидания
+    int copy = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+
+    if (copy < 0)
+    {
+        LOG_WARN("Can't duplicate file descriptor:", std::strerror(errno));
+        return false;
+    }
+
+    auto id      = settleTag_ | nextSettle_++;
+    settles_[id] = { copy, offset, size, drop };
+
+    if (!submitSettle(id, IORING_OP_SYNC_FILE_RANGE))
+    {
+        ::close(copy);
+        settles_.erase(id);
+        return false;
+    }
+
+    return true;
+}
+
+bool UringStorage::start(int fd, uint64_t offset, const uint8_t *data, size_t size, const void *owner, Completion done)
+{
+    auto slot = free_.back();
+    free_.pop_back();
+
+    std::memcpy(slotData(slot), data, size);
+    requests_[slot] = { fd, offset, size, 0, owner, std::move(done) };
+
+    if (!submit(slot))
+    {
+        requests_[slot] = {};
+        free_.push_back(slot);
+        return false;
+    }
+
+    return true;
+}
+
+bool UringStorage::submit(uint32_t slot)
+{
+    auto &request = requests_[slot];
+    auto  sqe     = ring_.getSqe();
+
+    if (!sqe)
+    {
+        LOG_ERROR("io_uring submission queue is full");
+        return false;
+    }
+
+    sqe->opcode    = IORING_OP_WRITE_FIXED;
+    sqe->fd        = request.fd;
+    sqe->addr      = reinterpret_cast< uint64_t >(slotData(slot) + request.written);
+    sqe->len       = request.size - request.written;
+    sqe->off       = request.offset + request.written;
+    sqe->buf_index = slot;
+    sqe->user_data = slot;
+
+    auto res = ring_.submit();
+
+    if (res < 0)
+    {
+        LOG_ERROR("io_uring submit failed", std::strerror(-res));
+        return false;
+    }
+
+    return true;
+}
+
+bool UringStorage::submitSettle(uint64_t id, uint8_t opcode)
+{
+    const auto &settle = settles_[id];
+    auto        sqe    = ring_.getSqe();
+
+    if (!sqe)
+    {
+        LOG_WARN("io_uring submission queue is full");
+        return false;
+    }
+
+    sqe->opcode    = opcode;
+    sqe->fd        = settle.fd;
+    sqe->off       = settle.offset;
+    sqe->len       = static_cast< uint32_t >(settle.size);
+    sqe->user_data = id;
+
+    if (opcode == IORING_OP_SYNC_FILE_RANGE)
+    {
+        sqe->sync_range_flags = SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER;
+    }
+    else
+    {
+        sqe->fadvise_advice = POSIX_FADV_DONTNEED;
+    }
+
+    auto res = ring_.submit();
+
+    if (res < 0)
+    {
+        LOG_WARN("io_uring submit failed", std::strerror(-res));
+        return false;
+    }
+
+    return true;
+}
+
+void UringStorage::onSettled(uint64_t id, int res)
+{
+    auto it = settles_.find(id);
+    if (it == settles_.end()) return;
+
+    auto &settle = it->second;
+
+    // Страницы выбрасываем только после того, как ожидание записи успешно завершилось
+    if (res < 0)
+    {
+        LOG_WARN("Can't settle written range:", std::strerror(-res));
+    }
+    else if (settle.drop)
+    {
+        settle.drop = false;
+        if (submitSettle(id, IORING_OP_FADVISE)) return;
+    }
+
+    ::close(settle.fd);
+    settles_.erase(it);
+}
+
+EVENT_LOOP_SIGNALS UringStorage::onCompletion()
+{
+    uint64_t counter = 0;
+    while (::read(eventFd_, &counter, sizeof(counter)) < 0 && errno == EINTR) {}
+
+    ring_.reapCqes(cqes_);
+
+    for (const auto &cqe : cqes_)
+    {
+        if (cqe.user_data & settleTag_)
+        {
+            onSettled(cqe.user_data, cqe.res);
+            continue;
+        }
+
+        auto  slot    = static_cast< uint32_t >(cqe.user_data);
+        auto &request = requests_[slot];
+
+        if (cqe.res < 0 && cqe.res != -EAGAIN && cqe.res != -EINTR)
+        {
+            LOG_ERROR("Async write failed:", std::strerror(-cqe.res));
+            finish(slot, false);
+            continue;
+        }
+
+        if (cqe.res == 0)
+        {
+            LOG_ERROR("Async write made no progress");
+            finish(slot, false);
+            continue;
+        }
+
+        if (cqe.res > 0) request.written += cqe.res;
+
+        if (request.written == request.size)
+        {
+            finish(slot, true);
+            continue;
+        }
+
+        // Дописываем остаток, только если запись ещё кому-то нужна: после forget дескриптор может быть уже закрыт
+        if (!request.done || !submit(slot)) finish(slot, false);
+    }
+
+    return EVENT_LOOP_SIGNALS::SIG_NONE;
+}
+
+void UringStorage::finish(uint32_t slot, bool ok)
+{
+    auto done       = std::move(requests_[slot].done);
+    requests_[slot] = {};
+    free_.push_back(slot);
+
+    // Освободившийся буфер сразу отдаём ожидающей записи
+    while (!waiting_.empty() && !free_.empty())
+    {
+        auto next = std::move(waiting_.front());
+        waiting_.pop_front();
+
+        if (!start(next.fd, next.offset, next.data.data(), next.data.size(), next.owner, next.done))
+        {
+            if (next.done) next.done(false);
+        }
+    }
+
+    if (done) done(ok);
+}
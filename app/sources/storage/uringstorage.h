@@ -0,0 +1,105 @@
+#ifndef URINGSTORAGE_H
+#define URINGSTORAGE_H
+#include "filestorage.h"
+#include "../event_loop/eventloop.h"
+#include "../io_uring/iouring.h"
+
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Асинхронная запись через отдельный io_uring реактора.
+ * Данные копируются в один из заранее зарегистрированных в ядре буферов и пишутся IORING_OP_WRITE_FIXED,
+ * так что медленный диск не останавливает event loop. О завершениях ядро сообщает через eventfd,
+ * который слушает event loop, поэтому обработчики завершения вызываются в его потоке.
+ * Если свободных буферов нет, запись ждёт в очереди
+ */
+class UringStorage : public FileStorage
+{
+  public:
+    explicit UringStorage(EventLoop& loop);
+    ~UringStorage();
+
+    /**
+     * @brief Создаёт кольцо, регистрирует буферы и eventfd
+     * @return false если io_uring недоступен, тогда нужно использовать SyncStorage
+     */
+    bool init();
+
+    Result write(int fd, uint64_t offset, const uint8_t* data, size_t size, const void* owner, Completion done) override;
+    void   forget(const void* owner) override;
+    bool   settle(int fd, uint64_t offset, uint64_t size, bool drop) override;
+
+  private:
+    /**
+     * @brief Запись в одном из зарегистрированных буферов
+     */
+    struct Request
+    {
+        int         fd { -1 };
+        uint64_t    offset { 0 };
+        size_t      size { 0 };
+        size_t      written { 0 };  ///< Сколько уже записано, ядро может записать не всё за раз
+        const void* owner { nullptr };
+        Completion  done;
+    };
+
+    /**
+     * @brief Запись, ожидающая свободного буфера
+     */
+    struct Waiting
+    {
+        int                    fd;
+        uint64_t               offset;
+        std::vector< uint8_t > data;
+        const void*            owner;
+        Completion             done;
+    };
+
+    /**
+     * @brief Ожидание записи диапазона: IORING_OP_SYNC_FILE_RANGE, затем, если drop, IORING_OP_FADVISE
+     */
+    struct Settle
+    {
+        int      fd { -1 };  ///< Копия дескриптора сессии, закрывается после последней операции
+        uint64_t offset { 0 };
+        uint64_t size { 0 };
+        bool     drop { false };
+    };
+
+    /**
+     * @brief Слот eventfd: забирает завершения и вызывает обработчики
+     */
+    EVENT_LOOP_SIGNALS onCompletion();
+
+    /**
+     * @brief Копирует данные в свободный буфер и отправляет запись ядру
+     * @return false если ядро не приняло заявку, буфер при этом освобождается
+     */
+    bool     start(int fd, uint64_t offset, const uint8_t* data, size_t size, const void* owner, Completion done);
+    bool     submit(uint32_t slot);
+    void     finish(uint32_t slot, bool ok);
+    bool     submitSettle(uint64_t id, uint8_t opcode);
+    void     onSettled(uint64_t id, int res);
+    uint8_t* slotData(uint32_t slot) { return buffers_.data() + size_t(slot) * slotSize_; }
+
+  private:
+    inline static const unsigned slots_ { 64 };              ///< Сколько записей может быть в ядре одновременно
+    inline static const size_t   slotSize_ { 64 * 1024 };     ///< Больше, чем данные самого большого пакета
+    inline static const uint64_t settleTag_ { 1ULL << 63 };  ///< Бит user_data, отличающий ожидания от записей
+
+    EventLoop&                             loop_;
+    int                                    eventFd_ { -1 };
+    std::vector< uint8_t >                 buffers_;  ///< Зарегистрированные в ядре буферы, slots_ кусков по slotSize_
+    std::vector< Request >                 requests_;
+    std::vector< uint32_t >                free_;     ///< Свободные буферы
+    std::deque< Waiting >                  waiting_;
+    bool                                   canSettle_ { false };  ///< Ядро умеет SYNC_FILE_RANGE и FADVISE
+    uint64_t                               nextSettle_ { 0 };
+    std::unordered_map< uint64_t, Settle > settles_;  ///< Ожидания в ядре по номеру
+    std::vector< io_uring_cqe >            cqes_;
+    IoUring                                ring_;     ///< Объявлен последним: закрывается раньше, чем освобождаются буферы
+};
+
+#endif  // URINGSTORAGE_H
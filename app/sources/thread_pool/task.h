@@ -0,0 +1,123 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @brief Перемещаемая (но не копируемая) обёртка над вызываемым объектом без возвращаемого значения.
+ * В отличие от std::function не требует копируемости (можно хранить std::packaged_task, unique_ptr и т.д.)
+ * и хранит небольшие объекты прямо внутри себя, без выделения памяти в куче
+ */
+class Task
+{
+  public:
+    static constexpr size_t inlineSize_ = 6 * sizeof(void*);  ///< Размер встроенного буфера под вызываемый объект
+
+    Task() noexcept = default;
+
+    template< class F, class = std::enable_if_t< !std::is_same_v< std::decay_t< F >, Task > > >
+    Task(F&& f)
+    {
+        using Fn = std::decay_t< F >;
+
+        if constexpr (fitsInline< Fn >())
+        {
+            ::new (static_cast< void* >(&storage_)) Fn(std::forward< F >(f));
+            vtable_ = &inlineVTable< Fn >;
+        }
+        else
+        {
+            ::new (static_cast< void* >(&storage_)) Fn*(new Fn(std::forward< F >(f)));
+            vtable_ = &heapVTable< Fn >;
+        }
+    }
+
+    Task(Task&& other) noexcept { moveFrom(other); }
+
+    Task& operator=(Task&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    Task(const Task&)            = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() { reset(); }
+
+    /**
+     * @brief Вызывает сохранённый объект, вызов пустой задачи - неопределённое поведение
+     */
+    void operator()() { vtable_->invoke(&storage_); }
+
+    explicit operator bool() const noexcept { return vtable_ != nullptr; }
+
+    /**
+     * @brief Уничтожает сохранённый объект, задача становится пустой
+     */
+    void reset() noexcept
+    {
+        if (vtable_)
+        {
+            vtable_->destroy(&storage_);
+            vtable_ = nullptr;
+        }
+    }
+
+  private:
+    using Storage = std::aligned_storage_t< inlineSize_, alignof(std::max_align_t) >;
+
+    struct VTable
+    {
+        void (*invoke)(void*);
+        void (*move)(void* dst, void* src) noexcept;
+        void (*destroy)(void*) noexcept;
+    };
+
+    template< class Fn >
+    static constexpr bool fitsInline()
+    {
+        return sizeof(Fn) <= inlineSize_ && alignof(Fn) <= alignof(Storage) && std::is_nothrow_move_constructible_v< Fn >;
+    }
+
+    template< class Fn >
+    inline static constexpr VTable inlineVTable {
+        [](void* p) { (*static_cast< Fn* >(p))(); },
+        [](void* dst, void* src) noexcept
+        {
+            ::new (dst) Fn(std::move(*static_cast< Fn* >(src)));
+            static_cast< Fn* >(src)->~Fn();
+        },
+        [](void* p) noexcept { static_cast< Fn* >(p)->~Fn(); },
+    };
+
+    template< class Fn >
+    inline static constexpr VTable heapVTable {
+        [](void* p) { (**static_cast< Fn** >(p))(); },
+        [](void* dst, void* src) noexcept { ::new (dst) Fn*(*static_cast< Fn** >(src)); },
+        [](void* p) noexcept { delete *static_cast< Fn** >(p); },
+    };
+
+    void moveFrom(Task& other) noexcept
+    {
+        if (other.vtable_)
+        {
+            other.vtable_->move(&storage_, &other.storage_);
+            vtable_       = other.vtable_;
+            other.vtable_ = nullptr;
+        }
+    }
+
+  private:
+    Storage       storage_;
+    const VTable* vtable_ { nullptr };
+};
+
+#endif  // TASK_H
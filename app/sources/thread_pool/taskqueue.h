@@ -0,0 +1,135 @@
+#ifndef TASKQUEUE_H
+#define TASKQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "task.h"
+
+/**
+ * @brief Ограниченная lock-free очередь задач (алгоритм Д. Вьюкова), много писателей и много читателей.
+ * Задачи хранятся прямо в ячейках кольцевого буфера, так что постановка в очередь не выделяет память.
+ * Используется как локальная очередь воркера: хозяин забирает задачи из неё, остальные воркеры воруют из неё же
+ */
+class TaskQueue
+{
+  public:
+    /**
+     * @param Ёмкость очереди, округляется вверх до степени двойки
+     */
+    explicit TaskQueue(size_t capacity = 1024) :
+        mask_ { roundUp(capacity) - 1 },
+        cells_ { new Cell[mask_ + 1] }
+    {
+        for (size_t i = 0; i <= mask_; ++i)
+        {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    TaskQueue(const TaskQueue&)            = delete;
+    TaskQueue& operator=(const TaskQueue&) = delete;
+
+    /**
+     * @brief Кладёт задачу в очередь
+     * @return false если очередь заполнена, в этом случае задача остаётся у вызывающего
+     */
+    bool tryPush(Task& task)
+    {
+        Cell* cell;
+        auto  pos = enqueuePos_.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            cell      = &cells_[pos & mask_];
+            auto seq  = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast< intptr_t >(seq) - static_cast< intptr_t >(pos);
+
+            if (diff == 0)
+            {
+                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->task = std::move(task);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Забирает самую старую задачу из очереди
+     * @return false если очередь пуста
+     */
+    bool tryPop(Task& task)
+    {
+        Cell* cell;
+        auto  pos = dequeuePos_.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            cell      = &cells_[pos & mask_];
+            auto seq  = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast< intptr_t >(seq) - static_cast< intptr_t >(pos + 1);
+
+            if (diff == 0)
+            {
+                if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = dequeuePos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        task = std::move(cell->task);
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Приблизительное количество задач в очереди, точное значение может поменяться сразу после вызова
+     */
+    size_t sizeApprox() const
+    {
+        auto head = dequeuePos_.load(std::memory_order_relaxed);
+        auto tail = enqueuePos_.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+  private:
+    struct Cell
+    {
+        std::atomic< size_t > sequence;
+        Task                  task;
+    };
+
+    static size_t roundUp(size_t value)
+    {
+        size_t res = 2;
+        while (res < value) res <<= 1;
+        return res;
+    }
+
+  private:
+    const size_t              mask_;
+    std::unique_ptr< Cell[] > cells_;
+
+    alignas(64) std::atomic< size_t > enqueuePos_ { 0 };
+    alignas(64) std::atomic< size_t > dequeuePos_ { 0 };
+};
+
+#endif  // TASKQUEUE_H
@@ -2,6 +2,7 @@
 #define THREADPOOL_H
 
 #include <algorithm>
+#include <atomic>
 #include <condition_variable>
 #include <functional>
 #include <future>
@@ -10,85 +11,262 @@
 #include <queue>
 #include <stdexcept>
 #include <thread>
+#include <type_traits>
 #include <vector>
 
+#include "../cpu_affinity/cpuaffinity.h"
+#include "task.h"
+#include "taskqueue.h"
+
 class Server;
 
-using SocketTask = std::function< void() >;
+using SocketTask = Task;
 
+/**
+ * @brief Пул потоков с воровством задач.
+ * У каждого воркера своя lock-free очередь, задачи поставленные из воркера попадают в его же очередь,
+ * задачи из сторонних потоков раскладываются по очередям воркеров по кругу. Воркер без работы ворует задачи
+ * у случайных соседей, какое-то время крутится в ожидании и только потом засыпает на condition_variable.
+ * Воркеры можно привязать к ядрам, тогда память которую они выделяют будет браться с их узла NUMA
+ */
 class ThreadPool
 {
   public:
-    ThreadPool(size_t threadNumber);
+    /**
+     * @param Количество потоков
+     * @param Ядра к которым по кругу привязываются воркеры, пусто - потоки не привязываются
+     */
+    ThreadPool(size_t threadNumber, std::vector< int > cpus = {});
     ~ThreadPool();
 
+    /**
+     * @brief Ставит задачу в очередь и возвращает future с её результатом
+     */
     template< class F, class... Args >
-    auto enqueue(F&& f, Args&&... args) -> std::future< typename std::result_of< F(Args...) >::type >;
+    auto enqueue(F&& f, Args&&... args) -> std::future< std::invoke_result_t< F, Args... > >;
+
+    /**
+     * @brief Ставит задачу в очередь без создания future, для задач результат которых никому не нужен
+     */
+    template< class F >
+    void post(F&& f);
 
   private:
-    std::vector< std::thread > m_workers;
-    std::queue< SocketTask >   m_tasks;
+    struct Worker
+    {
+        TaskQueue   queue;
+        std::thread thread;
+        int         cpu { -1 };
+        int         node { -1 };
+    };
+
+    void workerLoop(size_t index);
+    bool tryGetTask(size_t index, uint32_t& rng, Task& task);
+    bool trySteal(size_t index, uint32_t& rng, Task& task);
+    void push(Task&& task);
+    void park();
+
+    static uint32_t nextRandom(uint32_t& state)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    static void cpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+  private:
+    std::vector< std::unique_ptr< Worker > > m_workers;
+    std::queue< Task >                       m_overflow;  ///< Задачи, не поместившиеся в очереди воркеров
 
     std::mutex              m_mutex;
     std::condition_variable m_condition;
-    bool                    m_stop;
+    std::atomic_bool        m_stop { false };
+    std::atomic< size_t >   m_queued { 0 };    ///< Сколько задач ожидает выполнения во всех очередях
+    std::atomic< size_t >   m_sleepers { 0 };  ///< Сколько воркеров спит на m_condition
+    std::atomic< size_t >   m_nextWorker { 0 };
+
+    inline static int spinCount_ { 2000 };  ///< Сколько раз воркер проверяет очереди перед тем как уснуть
+
+    inline static thread_local ThreadPool* currentPool_ { nullptr };
+    inline static thread_local size_t      currentIndex_ { 0 };
 };
 
-inline ThreadPool::ThreadPool(size_t threadNumber) :
-    m_stop(false)
+inline ThreadPool::ThreadPool(size_t threadNumber, std::vector< int > cpus)
 {
+    threadNumber = std::max< size_t >(threadNumber, 1);
+
     for (size_t i = 0; i < threadNumber; ++i)
     {
-        m_workers.emplace_back(
-            [this]
+        auto& worker = m_workers.emplace_back(std::make_unique< Worker >());
+
+        if (!cpus.empty())
+        {
+            worker->cpu  = cpus[i % cpus.size()];
+            worker->node = cpu_affinity::nodeOfCpu(worker->cpu);
+        }
+    }
+
+    for (size_t i = 0; i < threadNumber; ++i)
+    {
+        m_workers[i]->thread = std::thread(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+inline void ThreadPool::workerLoop(size_t index)
+{
+    currentPool_  = this;
+    currentIndex_ = index;
+    uint32_t rng  = static_cast< uint32_t >(index) * 2654435761u + 1;
+
+    if (m_workers[index]->cpu >= 0 && cpu_affinity::pinCurrentThread(m_workers[index]->cpu))
+    {
+        cpu_affinity::preferLocalMemory(m_workers[index]->node);
+    }
+
+    for (;;)
+    {
+        Task task;
+
+        if (!tryGetTask(index, rng, task))
+        {
+            for (int i = 0; i < spinCount_ && m_queued.load(std::memory_order_relaxed) == 0 && !m_stop; ++i)
             {
-                for (;;)
-                {
-                    SocketTask task;
+                cpuRelax();
+            }
 
-                    {
-                        std::unique_lock< std::mutex > lock(this->m_mutex);
-                        this->m_condition.wait(lock, [this] { return this->m_stop || !this->m_tasks.empty(); });
+            if (tryGetTask(index, rng, task))
+            {
+                task();
+                continue;
+            }
 
-                        if (this->m_stop && this->m_tasks.empty())
-                        {
-                            return;
-                        }
+            if (m_stop && m_queued.load() == 0)
+            {
+                return;
+            }
 
-                        task = std::move(this->m_tasks.front());
-                        this->m_tasks.pop();
-                    }
+            park();
+            continue;
+        }
 
-                    task();
-                }
-            });
+        task();
     }
 }
 
-template< class F, class... Args >
-auto ThreadPool::enqueue(F&& f, Args&&... args) -> std::future< typename std::result_of< F(Args...) >::type >
+inline bool ThreadPool::tryGetTask(size_t index, uint32_t& rng, Task& task)
 {
-    using return_type = typename std::invoke_result< F, Args... >::type;
-    if (m_stop)
+    if (m_workers[index]->queue.tryPop(task) || trySteal(index, rng, task))
+    {
+        m_queued.fetch_sub(1);
+        return true;
+    }
+
+    std::unique_lock< std::mutex > lock(m_mutex);
+
+    if (m_overflow.empty())
+    {
+        return false;
+    }
+
+    task = std::move(m_overflow.front());
+    m_overflow.pop();
+    m_queued.fetch_sub(1);
+    return true;
+}
+
+inline bool ThreadPool::trySteal(size_t index, uint32_t& rng, Task& task)
+{
+    const auto count = m_workers.size();
+
+    if (count < 2) return false;
+
+    // Начинаем со случайной жертвы и обходим всех по кругу
+    auto start = nextRandom(rng) % count;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto victim = (start + i) % count;
+
+        if (victim == index) continue;
+        if (m_workers[victim]->queue.tryPop(task)) return true;
+    }
+
+    return false;
+}
+
+inline void ThreadPool::park()
+{
+    std::unique_lock< std::mutex > lock(m_mutex);
+    m_sleepers.fetch_add(1);
+    m_condition.wait(lock, [this] { return m_stop || m_queued.load() > 0; });
+    m_sleepers.fetch_sub(1);
+}
+
+inline void ThreadPool::push(Task&& task)
+{
+    // Воркеры остановленного пула ещё дорабатывают очередь, им разрешаем досылать задачи
+    if (m_stop && currentPool_ != this)
     {
-        //        return false;
         throw std::runtime_error("enqueue on stopped ThreadPool");
-        //        return std::future<return_type>;
-        //        return std::future<bool>(false);
     }
 
-    auto task = std::make_shared< std::packaged_task< return_type() > >(std::bind(std::forward< F >(f), std::forward< Args >(args)...));
+    // Счётчик увеличиваем заранее, чтобы воркер забравший задачу не увёл его в минус
+    m_queued.fetch_add(1);
+
+    bool pushed = false;
+
+    if (currentPool_ == this)
+    {
+        pushed = m_workers[currentIndex_]->queue.tryPush(task);
+    }
 
-    std::future< return_type > res = task->get_future();
+    for (size_t i = 0, count = m_workers.size(); !pushed && i < count; ++i)
+    {
+        auto index = m_nextWorker.fetch_add(1, std::memory_order_relaxed) % count;
+        pushed     = m_workers[index]->queue.tryPush(task);
+    }
+
+    if (!pushed)
     {
         std::unique_lock< std::mutex > lock(m_mutex);
+        m_overflow.emplace(std::move(task));
+    }
 
-        m_tasks.emplace([task]() { (*task)(); });
+    if (m_sleepers.load() > 0)
+    {
+        {
+            std::unique_lock< std::mutex > lock(m_mutex);
+        }
+        m_condition.notify_one();
     }
-    m_condition.notify_one();
+}
+
+template< class F, class... Args >
+auto ThreadPool::enqueue(F&& f, Args&&... args) -> std::future< std::invoke_result_t< F, Args... > >
+{
+    using return_type = std::invoke_result_t< F, Args... >;
+
+    std::packaged_task< return_type() > task(std::bind(std::forward< F >(f), std::forward< Args >(args)...));
+    std::future< return_type >          res = task.get_future();
+    post(std::move(task));
     return res;
 }
 
+template< class F >
+void ThreadPool::post(F&& f)
+{
+    push(Task(std::forward< F >(f)));
+}
+
 inline ThreadPool::~ThreadPool()
 {
     {
@@ -98,9 +276,9 @@ inline ThreadPool::~ThreadPool()
 
     m_condition.notify_all();
 
-    for (std::thread& worker : m_workers)
+    for (auto& worker : m_workers)
     {
-        worker.join();
+        worker->thread.join();
     }
 }
 
@@ -0,0 +1,234 @@
+#include "timerwheel.h"
+
+#include <algorithm>
+
+TimerWheel::TimerWheel(uint64_t nowMs) :
+    now_ { nowMs }
+{
+    for (auto& level : levels_)
+    {
+        level.heads.fill(nil_);
+    }
+}
+
+TimerWheel::TimerId TimerWheel::schedule(uint64_t delayMs, Task callback)
+{
+    // Нулевая задержка попала бы в уже обработанную ячейку и сработала бы только через полный оборот колеса
+    delayMs = std::clamp< uint64_t >(delayMs, 1, UINT32_MAX);
+
+    auto  index    = allocNode();
+    auto& node     = nodes_[index];
+    node.expires   = now_ + delayMs;
+    node.callback  = std::move(callback);
+    node.active    = true;
+    link(index);
+    count_++;
+
+    return (static_cast< uint64_t >(node.generation) << 32) | (index + 1);
+}
+
+bool TimerWheel::cancel(TimerId id)
+{
+    if (id == 0) return false;
+
+    auto index      = static_cast< uint32_t >(id & 0xFFFFFFFF) - 1;
+    auto generation = static_cast< uint32_t >(id >> 32);
+
+    if (index >= nodes_.size()) return false;
+
+    auto& node = nodes_[index];
+    if (!node.active || node.generation != generation) return false;
+
+    unlink(index);
+    freeNode(index);
+    count_--;
+    return true;
+}
+
+void TimerWheel::advance(uint64_t nowMs)
+{
+    while (now_ < nowMs)
+    {
+        auto distance = ticksToNextEvent();
+
+        // До nowMs ничего не срабатывает и не переносится между уровнями - перескакиваем сразу
+        if (distance == 0 || now_ + distance > nowMs)
+        {
+            now_ = nowMs;
+            return;
+        }
+
+        now_ += distance - 1;
+        tick();
+    }
+}
+
+int TimerWheel::nextTimeoutMs(int maxMs) const
+{
+    auto distance = ticksToNextEvent();
+    if (distance == 0) return maxMs;
+    return static_cast< int >(std::min< uint64_t >(distance, maxMs));
+}
+
+uint64_t TimerWheel::ticksToNextEvent() const
+{
+    if (count_ == 0) return 0;
+
+    uint64_t best = 0;
+
+    for (int level = 0; level < levelCount_; level++)
+    {
+        auto shift   = slotBits_ * level;
+        auto current = static_cast< uint32_t >((now_ >> shift) & slotMask_);
+        auto ahead   = nextOccupied(level, current);
+
+        if (ahead == 0) continue;
+
+        // Таймеры нулевого уровня срабатывают в момент прихода в ячейку, остальные - переносятся ниже
+        // когда младшие уровни проходят полный оборот
+        uint64_t distance = (((now_ >> shift) + ahead) << shift) - now_;
+
+        if (best == 0 || distance < best) best = distance;
+    }
+
+    return best;
+}
+
+uint32_t TimerWheel::nextOccupied(int level, uint32_t current) const
+{
+    const auto&        occupied = levels_[level].occupied;
+    constexpr uint32_t words    = slots_ / 64;
+
+    // Обходим слова карты начиная с ячейки после текущей. Пятое слово - снова первое, но уже биты до начала обхода,
+    // так что текущая ячейка проверяется последней (полный оборот)
+    auto start = (current + 1) & slotMask_;
+    auto first = start / 64;
+    auto lower = (uint64_t(1) << (start % 64)) - 1;
+
+    for (uint32_t i = 0; i <= words; i++)
+    {
+        auto word = (first + i) % words;
+        auto bits = occupied[word];
+
+        if (i == 0) bits &= ~lower;
+        if (i == words) bits &= lower;
+        if (bits == 0) continue;
+
+        auto slot  = word * 64 + __builtin_ctzll(bits);
+        auto ahead = (slot - current) & slotMask_;
+        return ahead == 0 ? slots_ : ahead;
+    }
+
+    return 0;
+}
+
+void TimerWheel::tick()
+{
+    now_++;
+
+    // Старшие уровни переносим раньше младших, чтобы таймер мог за один тик спуститься до нулевого уровня
+    int top = 0;
+    while (top + 1 < levelCount_ && (now_ & ((uint64_t(1) << (slotBits_ * (top + 1))) - 1)) == 0) top++;
+
+    for (int level = top; level > 0; level--)
+    {
+        cascade(level, (now_ >> (slotBits_ * level)) & slotMask_);
+    }
+
+    auto& heads = levels_[0].heads;
+    auto  slot  = static_cast< uint32_t >(now_ & slotMask_);
+
+    while (heads[slot] != nil_)
+    {
+        auto index = heads[slot];
+        unlink(index);
+
+        // Обработчик забираем до вызова: он может ставить таймеры, а пул узлов при этом может переехать
+        auto callback = std::move(nodes_[index].callback);
+        freeNode(index);
+        count_--;
+        callback();
+    }
+}
+
+void TimerWheel::cascade(int level, uint32_t slot)
+{
+    auto& lvl   = levels_[level];
+    auto  index = lvl.heads[slot];
+
+    lvl.heads[slot] = nil_;
+    lvl.occupied[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+
+    while (index != nil_)
+    {
+        auto next = nodes_[index].next;
+        link(index);
+        index = next;
+    }
+}
+
+uint32_t TimerWheel::allocNode()
+{
+    if (!free_.empty())
+    {
+        auto index = free_.back();
+        free_.pop_back();
+        return index;
+    }
+
+    nodes_.emplace_back();
+    return static_cast< uint32_t >(nodes_.size() - 1);
+}
+
+void TimerWheel::freeNode(uint32_t index)
+{
+    auto& node = nodes_[index];
+    node.callback.reset();
+    node.active = false;
+    node.generation++;
+    free_.push_back(index);
+}
+
+void TimerWheel::link(uint32_t index)
+{
+    auto& node  = nodes_[index];
+    auto  diff  = node.expires - now_;
+    int   level = 0;
+
+    while (level + 1 < levelCount_ && (diff >> (slotBits_ * (level + 1))) != 0) level++;
+
+    auto  slot = static_cast< uint32_t >((node.expires >> (slotBits_ * level)) & slotMask_);
+    auto& lvl  = levels_[level];
+
+    node.slot = static_cast< uint16_t >(level * slots_ + slot);
+    node.prev = nil_;
+    node.next = lvl.heads[slot];
+
+    if (node.next != nil_) nodes_[node.next].prev = index;
+
+    lvl.heads[slot] = index;
+    lvl.occupied[slot / 64] |= uint64_t(1) << (slot % 64);
+}
+
+void TimerWheel::unlink(uint32_t index)
+{
+    auto& node = nodes_[index];
+    auto& lvl  = levels_[node.slot / slots_];
+    auto  slot = node.slot % slots_;
+
+    if (node.prev != nil_)
+    {
+        nodes_[node.prev].next = node.next;
+    }
+    else
+    {
+        lvl.heads[slot] = node.next;
+    }
+
+    if (node.next != nil_) nodes_[node.next].prev = node.prev;
+
+    if (lvl.heads[slot] == nil_) lvl.occupied[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+
+    node.prev = nil_;
+    node.next = nil_;
+}
@@ -0,0 +1,110 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../thread_pool/task.h"
+
+/**
+ * @brief Иерархическое колесо таймеров с точностью в 1 мс.
+ * Четыре уровня по 256 ячеек покрывают задержки до 2^32 мс, постановка и отмена таймера - O(1).
+ * Таймеры хранятся в пуле узлов и связаны в двусвязные списки по индексам, так что после прогрева
+ * постановка таймера не выделяет память. Не потокобезопасно, предназначено для одного event loop
+ */
+class TimerWheel
+{
+  public:
+    /**
+     * @brief Идентификатор таймера, 0 - недействительный таймер
+     */
+    using TimerId = uint64_t;
+
+    /**
+     * @param Текущее время в мс, от которого отсчитываются задержки
+     */
+    explicit TimerWheel(uint64_t nowMs = 0);
+
+    TimerWheel(const TimerWheel&)            = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    /**
+     * @brief Ставит таймер
+     * @param Через сколько мс от текущего времени колеса вызвать обработчик, не меньше 1
+     * @param Обработчик
+     * @return Идентификатор для отмены
+     */
+    TimerId schedule(uint64_t delayMs, Task callback);
+
+    /**
+     * @brief Отменяет таймер, если он ещё не сработал
+     * @return false если таймер уже сработал, отменён или идентификатор недействителен
+     */
+    bool cancel(TimerId id);
+
+    /**
+     * @brief Продвигает колесо до nowMs и вызывает обработчики всех истёкших таймеров.
+     * Обработчики могут ставить и отменять таймеры
+     */
+    void advance(uint64_t nowMs);
+
+    /**
+     * @brief Сколько мс можно ждать до срабатывания ближайшего таймера (с учётом переноса между уровнями)
+     * @param Верхняя граница результата, возвращается если таймеров нет
+     */
+    int nextTimeoutMs(int maxMs) const;
+
+    size_t size() const { return count_; }
+
+  private:
+    static constexpr int      levelCount_ = 4;
+    static constexpr int      slotBits_   = 8;
+    static constexpr int      slots_      = 1 << slotBits_;
+    static constexpr uint32_t slotMask_   = slots_ - 1;
+    static constexpr uint32_t nil_        = UINT32_MAX;
+
+    struct Node
+    {
+        uint64_t expires { 0 };
+        uint32_t generation { 0 };  ///< Увеличивается при освобождении узла, чтобы старые идентификаторы не отменили чужой таймер
+        uint32_t prev { nil_ };
+        uint32_t next { nil_ };
+        uint16_t slot { 0 };        ///< level * slots_ + индекс ячейки
+        bool     active { false };
+        Task     callback;
+    };
+
+    struct Level
+    {
+        std::array< uint32_t, slots_ >      heads;
+        std::array< uint64_t, slots_ / 64 > occupied {};  ///< Битовая карта непустых ячеек
+    };
+
+    uint32_t allocNode();
+    void     freeNode(uint32_t index);
+    void     link(uint32_t index);
+    void     unlink(uint32_t index);
+    void     cascade(int level, uint32_t slot);
+    void     tick();
+
+    /**
+     * @brief Через сколько тиков что-то сработает или перенесётся между уровнями, 0 если таймеров нет
+     */
+    uint64_t ticksToNextEvent() const;
+
+    /**
+     * @brief Расстояние (в ячейках, от 1 до slots_) до ближайшей непустой ячейки уровня после текущей, 0 если уровень пуст
+     */
+    uint32_t nextOccupied(int level, uint32_t current) const;
+
+  private:
+    uint64_t                         now_;
+    size_t                           count_ { 0 };
+    std::array< Level, levelCount_ > levels_ {};
+    std::vector< Node >              nodes_;
+    std::vector< uint32_t >          free_;  ///< Индексы свободных узлов
+};
+
+#endif  // TIMERWHEEL_H